@@ -16,7 +16,7 @@ int main(int argc, char **argv)
 	Vec4 clrColor = Vec4{88.f, 93.f, 102.f, 255.f};
 	mat4x4 perspective = perspectiveProjection(60.f, ctx.window.width / ctx.window.height, 0.1f, 10.f);
 	mat4x4 viewPort = viewport(ctx.window.width, ctx.window.height);
-	setRenderState(viewPort, perspective, clrColor);
+	setRenderState(&ctx, viewPort, perspective, clrColor);
 
 	Mesh monkeyMesh = {};
 	if(!loadMesh("./resources/monkey.obj", &monkeyMesh))
@@ -30,15 +30,11 @@ int main(int argc, char **argv)
 	shader.zNear = 0.1f;
 	shader.zFar = 10.f;
 
-	RenderObject monkey1 = {};
-	monkey1.mesh = &monkeyMesh;
-	monkey1.transform.scale = Vec3{0.5f, 0.5f, 0.5f};
-	monkey1.transform.translate = Vec3{0.f, 0.f, -1.f};
-
-	RenderObject monkey2 = {};
-	monkey2.mesh = &monkeyMesh;
-	monkey2.transform.scale = Vec3{0.5f, 0.5f, 0.5f};
-	monkey2.transform.translate = Vec3{1.f, 0.f, -3.f};
+	Transform monkeys[2] = {};
+	monkeys[0].scale = Vec3{0.5f, 0.5f, 0.5f};
+	monkeys[0].translate = Vec3{0.f, 0.f, -1.f};
+	monkeys[1].scale = Vec3{0.5f, 0.5f, 0.5f};
+	monkeys[1].translate = Vec3{1.f, 0.f, -3.f};
 
 	RenderObject plane = {};
 	plane.mesh = &planeMesh;
@@ -54,8 +50,7 @@ int main(int argc, char **argv)
 		updateCameraPosition(&camera, deltaTime);
 
 		beginFrame(&ctx);
-			renderObject(&ctx, monkey1, camera, shader);
-			renderObject(&ctx, monkey2, camera, shader);
+			renderObjectInstanced(&ctx, monkeyMesh, camera, shader, monkeys, 2);
 			renderObject(&ctx, plane, camera, shader);
 		endFrame(&ctx);
 		deltaTime = tick.stopMs();
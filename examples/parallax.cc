@@ -4,6 +4,11 @@
 
 #include <softy.h>
 
+static void printQualityChange(const QualityChange& change, void* user)
+{
+	printf("Quality level %u -> %u at %.2f[ms] per frame\n", change.fromLevel, change.toLevel, change.averageFrameMs);
+}
+
 int main(int argc, char **argv)
 {
 	RenderContext ctx = {};
@@ -16,22 +21,30 @@ int main(int argc, char **argv)
 	Vec4 clrColor = Vec4{88.f, 93.f, 102.f, 255.f};
 	mat4x4 perspective = perspectiveProjection(60.f, ctx.window.width / ctx.window.height, 0.1f, 100.f);
 	mat4x4 viewPort = viewport(ctx.window.width, ctx.window.height);
-	setRenderState(viewPort, perspective, clrColor);
+	setRenderState(&ctx, viewPort, perspective, clrColor);
+
+	//parallax steps, specular and msaa follow the frame time
+	AdaptiveQualityConfig qualityConfig;
+	qualityConfig.targetFrameMs = 33.3f;
+	qualityConfig.onChange = printQualityChange;
+	setAdaptiveQuality(&ctx, &qualityConfig);
 
 	RenderObject cube1 = {};
-	Texture cubeTexture = {};
 	Mesh cubeMesh = {};
 	if(!loadMesh("./resources/planeZ.obj", &cubeMesh))
 		return -1;
-	if(!loadTexture("./resources/rough_block_wall_diff_2k.jpg", &cubeTexture))
-		return -1;
-	Texture normalMap = {};
-	if(!loadTexture("./resources/rough_block_wall_nor_2k.jpg", &normalMap))
-		return -1;
 
-	Texture heightMap = {};
-	if(!loadTexture("./resources/rough_block_wall_disp_2k.jpg", &heightMap))
+	const char* texturePaths[] = {
+		"./resources/rough_block_wall_diff_2k.jpg",
+		"./resources/rough_block_wall_nor_2k.jpg",
+		"./resources/rough_block_wall_disp_2k.jpg"
+	};
+	Texture textures[3] = {};
+	if(!loadTextures(ctx.jobs, texturePaths, textures, 3))
 		return -1;
+	Texture& cubeTexture = textures[0];
+	Texture& normalMap = textures[1];
+	Texture& heightMap = textures[2];
 
 	averageNormals(&cubeMesh);
 	fillTangent(&cubeMesh);
@@ -16,13 +16,15 @@ int main(int argc, char **argv)
 	Vec4 clrColor = Vec4{88.f, 93.f, 102.f, 255.f};
 	mat4x4 perspective = perspectiveProjection(60.f, ctx.window.width / ctx.window.height, 0.1f, 10.f);
 	mat4x4 viewPort = viewport(ctx.window.width, ctx.window.height);
-	setRenderState(viewPort, perspective, clrColor);
+	setRenderState(&ctx, viewPort, perspective, clrColor);
 
 	Mesh monkeyMesh = {};
 	if(!loadMesh("./resources/monkey.obj", &monkeyMesh))
 		return -1;
 
 	averageNormals(&monkeyMesh);
+	buildLodChain(&monkeyMesh);
+	ctx.lodErrorThreshold = 1.f;
 
 	RenderObject monkey1 = {};
 	monkey1.mesh = &monkeyMesh;
@@ -49,20 +51,31 @@ int main(int argc, char **argv)
 	pshader.uniforms.in_flatColor = {154.f,205.f,50.f};
 
 	Timer tick = {};
+	Timer shaderTick = {};
+	double shaderTimes[3] = {};
 	double deltaTime = 0.f;
 	while(!windowClosed()) {
 		tick.start();
 
 		pollEvents();
 		updateCameraPosition(&camera, deltaTime);
+		//hold V to compare against shaders called through the virtual interface
+		ctx.virtualShaders = isKeyPressed(BTN_V);
 
 		beginFrame(&ctx);
+			shaderTick.start();
 			renderObject(&ctx, monkey1, camera, fshader);
+			shaderTimes[0] = shaderTick.stopMs();
+			shaderTick.start();
 			renderObject(&ctx, monkey2, camera, gshader);
+			shaderTimes[1] = shaderTick.stopMs();
+			shaderTick.start();
 			renderObject(&ctx, monkey3, camera, pshader);
+			shaderTimes[2] = shaderTick.stopMs();
 		endFrame(&ctx);
 		deltaTime = tick.stopMs();
-		printf("Frame took %.2f[ms] \n", deltaTime);
+		printf("Frame took %.2f[ms] %s flat %.2f gouraud %.2f phong %.2f[ms]\n", deltaTime,
+			ctx.virtualShaders ? "virtual" : "specialized", shaderTimes[0], shaderTimes[1], shaderTimes[2]);
 	}
 
 	destroySoftwareRenderer(&ctx);
@@ -0,0 +1,196 @@
+#include "checkerboard.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+//view depth difference relative to the depth for two samples to be taken as the same surface
+static const float DEPTH_TOLERANCE = 0.02f;
+
+//frames whose targets hold one depth per pixel and whose surface is the finished frame when endFrame resolves
+static bool keepsHistory(const RenderContext* context)
+{
+	return !context->pipeline && !context->gbuffer && !context->visibility && !msaaEnabled(context);
+}
+
+static bool reserveHistory(RenderContext* context, Checkerboard* board)
+{
+	RenderTargetPool* pool = context->targetPool;
+	size_t numPixels = (size_t)context->window.width * context->window.height;
+	board->width = 0;
+	board->height = 0;
+	if(!reservePoolMemory(pool, (void**)&board->history, numPixels * sizeof(uint32_t))
+		|| !reservePoolMemory(pool, (void**)&board->historyDepth, numPixels * sizeof(float))
+		|| !reservePoolMemory(pool, (void**)&board->nextHistory, numPixels * sizeof(uint32_t))
+		|| !reservePoolMemory(pool, (void**)&board->nextHistoryDepth, numPixels * sizeof(float))) {
+		printf("Failed to allocate checkerboard history memory\n");
+		return false;
+	}
+	board->width = context->window.width;
+	board->height = context->window.height;
+	return true;
+}
+
+//tiles nothing was drawn to keep stale depth
+static float pixelDepth(const RenderTargets& targets, int x, int y)
+{
+	if(targets.tileFlags[(y / RENDER_TILE_SIZE) * targets.tilesX + x / RENDER_TILE_SIZE] & TILE_CLEARED)
+		return std::numeric_limits<float>::max();
+	return targets.zBuffer[y * targets.width + x];
+}
+
+static bool sameSurface(float depth, float otherDepth)
+{
+	return std::abs(otherDepth - depth) <= DEPTH_TOLERANCE * depth;
+}
+
+static uint32_t pixelChannel(uint32_t pixel, int channel)
+{
+	return pixel >> channel * 8 & 0xff;
+}
+
+//pixel of the other parity from the previous frame where its surface was at the same depth, limited to the colors of
+//the neighbors on that surface unless nothing moved, so moving objects don't smear. Blended from those neighbors
+//where there is no history
+static uint32_t reconstructPixel(const RenderContext* context, const Checkerboard& board, const mat4x4& invVP,
+	const mat4x4& invViewport, int x, int y, float depth)
+{
+	const RenderTargets& targets = context->rtargets;
+	const PixelBuffer& surface = context->surface;
+	const int offsetX[4] = {-1, 1, 0, 0};
+	const int offsetY[4] = {0, 0, -1, 1};
+
+	//the neighbors are all of the shaded parity, the closest one in depth stands in when none is on the same surface
+	uint32_t sum[4] = {};
+	uint32_t low[4] = {255, 255, 255, 255};
+	uint32_t high[4] = {};
+	uint32_t numSame = 0;
+	uint32_t closest = 0;
+	float closestDifference = std::numeric_limits<float>::max();
+	for(int i = 0; i < 4; i++) {
+		int nx = x + offsetX[i];
+		int ny = y + offsetY[i];
+		if(nx < 0 || ny < 0 || nx >= surface.width || ny >= surface.height)
+			continue;
+		uint32_t color = pixelRow(surface, ny)[nx];
+		float neighborDepth = pixelDepth(targets, nx, ny);
+		if(std::abs(neighborDepth - depth) < closestDifference) {
+			closestDifference = std::abs(neighborDepth - depth);
+			closest = color;
+		}
+		if(!sameSurface(depth, neighborDepth))
+			continue;
+		for(int channel = 0; channel < 4; channel++) {
+			uint32_t value = pixelChannel(color, channel);
+			sum[channel] += value;
+			low[channel] = min(low[channel], value);
+			high[channel] = max(high[channel], value);
+		}
+		numSame++;
+	}
+	if(!numSame) {
+		for(int channel = 0; channel < 4; channel++) {
+			sum[channel] = pixelChannel(closest, channel);
+			low[channel] = sum[channel];
+			high[channel] = sum[channel];
+		}
+		numSame = 1;
+	}
+
+	//a pixel whose depth didn't change at all shows the same thing it did, it's taken as it is
+	uint32_t index = y * board.width + x;
+	if(board.historyDepth[index] == depth && !std::memcmp(&board.historyVP, &board.recordingVP, sizeof(mat4x4)))
+		return board.history[index];
+
+	Vec3 position = reconstructPosition(invVP, invViewport, x, y, depth);
+	Vec4 historyClip = homogenize(position) * board.historyVP;
+	bool hasHistory = false;
+	uint32_t history = 0;
+	if(historyClip.w > 0.f) {
+		Vec4 historyScreen = perspectiveDivide(historyClip) * context->viewportTransform;
+		int hx = (int)std::floor(historyScreen.x + 0.5f);
+		int hy = (int)std::floor(historyScreen.y + 0.5f);
+		if(hx >= 0 && hy >= 0 && hx < board.width && hy < board.height) {
+			hasHistory = sameSurface(historyClip.w, board.historyDepth[hy * board.width + hx]);
+			history = board.history[hy * board.width + hx];
+		}
+	}
+
+	uint32_t out = 0;
+	for(int channel = 0; channel < 4; channel++) {
+		uint32_t value = hasHistory ? clamp(pixelChannel(history, channel), low[channel], high[channel]) : (sum[channel] + numSame / 2) / numSame;
+		out |= value << channel * 8;
+	}
+	return out;
+}
+
+Checkerboard* createCheckerboard(RenderContext* context)
+{
+	Checkerboard* board = new Checkerboard();
+	context->checkerboard = board;
+	return board;
+}
+
+void destroyCheckerboard(RenderContext* context)
+{
+	Checkerboard* board = context->checkerboard;
+	releasePoolMemory(context->targetPool, board->history);
+	releasePoolMemory(context->targetPool, board->historyDepth);
+	releasePoolMemory(context->targetPool, board->nextHistory);
+	releasePoolMemory(context->targetPool, board->nextHistoryDepth);
+	delete board;
+	context->checkerboard = nullptr;
+}
+
+void beginCheckerboardFrame(RenderContext* context)
+{
+	Checkerboard* board = context->checkerboard;
+	board->parity ^= 1;
+	board->active = false;
+	if(!keepsHistory(context)) {
+		board->historyValid = false;
+		return;
+	}
+	if(board->width != context->window.width || board->height != context->window.height) {
+		board->historyValid = false;
+		if(!reserveHistory(context, board))
+			return;
+	}
+	board->active = board->historyValid;
+}
+
+void resolveCheckerboard(RenderContext* context)
+{
+	Checkerboard* board = context->checkerboard;
+	//the sample layout is latched at beginFrame, a frame that began shading half of the pixels is resolved in any case.
+	//A mode switched on since then only keeps its history from being used by the next frame. Active frames always
+	//have history memory of their size
+	bool keep = keepsHistory(context) && board->width == context->window.width && board->height == context->window.height;
+	if(!board->active && !keep) {
+		board->historyValid = false;
+		return;
+	}
+
+	const RenderTargets& targets = context->rtargets;
+	const PixelBuffer& surface = context->surface;
+	mat4x4 invVP = inverse(board->recordingVP);
+	mat4x4 invViewport = inverse(context->viewportTransform);
+	//shaded pixels are only read, so rows can be filled in independently
+	parallelFor(context->jobs, surface.height, 16, [&](uint32_t first, uint32_t end) {
+		for(uint32_t y = first; y < end; y++) {
+			uint32_t* row = pixelRow(surface, y);
+			for(int x = 0; x < surface.width; x++) {
+				float depth = pixelDepth(targets, x, y);
+				//pixels nothing covered hold the clear color already
+				if(board->active && (x + y + board->parity) & 1 && depth != std::numeric_limits<float>::max())
+					row[x] = reconstructPixel(context, *board, invVP, invViewport, x, y, depth);
+				board->nextHistory[y * board->width + x] = row[x];
+				board->nextHistoryDepth[y * board->width + x] = depth;
+			}
+		}
+	});
+
+	std::swap(board->history, board->nextHistory);
+	std::swap(board->historyDepth, board->nextHistoryDepth);
+	board->historyVP = board->recordingVP;
+	board->historyValid = keep;
+}
@@ -0,0 +1,41 @@
+#ifndef CHECKERBOARD_H
+#define CHECKERBOARD_H
+
+#include "renderer.h"
+
+//alternate frames shade alternate pixels of a checkerboard, every pixel is still depth tested. The pixels a frame
+//doesn't shade are taken from the previous frame where their position lands on the same surface there, or are
+//blended from the neighbors the frame did shade. History buffers are tightly packed, y goes up like the zBuffer's
+struct Checkerboard
+{
+	uint32_t* history;//!<previous finished frame
+	float* historyDepth;
+	uint32_t* nextHistory;//!<the frame being finished, swapped with history afterwards
+	float* nextHistoryDepth;
+	int width;
+	int height;
+	mat4x4 historyVP;//!<camera the history was rendered with
+	mat4x4 recordingVP;//!<camera of the last draw of the frame being recorded
+	uint32_t parity;//!<pixels with x + y + parity even are shaded this frame
+	bool active;//!<this frame shades half of the pixels
+	bool historyValid;
+};
+
+Checkerboard* createCheckerboard(RenderContext* context);
+
+void destroyCheckerboard(RenderContext* context);
+
+//flips the parity and decides if the frame renders half of the pixels. Pipelined, deferred, visibility buffer and msaa
+//frames are rendered in full, as is the first frame after them or after a resize since there's no history to fill in from
+void beginCheckerboardFrame(RenderContext* context);
+
+//fills in the pixels the frame didn't shade and keeps it as the next frame's history, called by endFrame
+void resolveCheckerboard(RenderContext* context);
+
+//parity of the pixels rasterizers shade this frame, -1 when they shade all of them
+inline int checkerboardParity(const RenderContext* context)
+{
+	return context->checkerboard && context->checkerboard->active ? (int)context->checkerboard->parity : -1;
+}
+
+#endif
@@ -17,10 +17,10 @@ const uint8_t PLANE_COUNT = 6;
 struct VertexBuffer
 {
 	size_t size;
-	Vertex clippedVertices[MAX_CLIPPED_VERTEX_COUNT];
+	ShadedVertex clippedVertices[MAX_CLIPPED_VERTEX_COUNT];
 };
 
-static void vbPushData(VertexBuffer& vbuffer, const Vertex& data)
+static void vbPushData(VertexBuffer& vbuffer, const ShadedVertex& data)
 {
 	assert(vbuffer.size < MAX_CLIPPED_VERTEX_COUNT);
 	vbuffer.clippedVertices[vbuffer.size] = data;
@@ -48,7 +48,7 @@ static inline bool isVertexInsidePlane(const Vec4& vertex, PlaneBits plane)
 	}
 }
 
-static Vertex intersectPlaneSegment(const Vertex& v1, const Vertex& v2, PlaneBits plane)
+static ShadedVertex intersectPlaneSegment(const ShadedVertex& v1, const ShadedVertex& v2, PlaneBits plane, int numVaryings)
 {
 
 	float sign = 0.f;
@@ -78,25 +78,23 @@ static Vertex intersectPlaneSegment(const Vertex& v1, const Vertex& v2, PlaneBit
 
 	float amount = (v1.pos.w + val1 * sign) / (v1.pos.w  + val1 * sign - v2.pos.w  - val2 * sign);
 
-	Vertex straddledVertex = {};
+	ShadedVertex straddledVertex;
 	straddledVertex.pos = lerp(v1.pos, v2.pos, amount);
-	straddledVertex.texCoords = lerp(v1.texCoords, v2.texCoords, amount);
-	straddledVertex.color = lerp(v1.color, v2.color, amount);
-	straddledVertex.normal = lerp(v1.normal, v2.normal, amount);
-	straddledVertex.tangent = lerp(v1.tangent, v2.tangent, amount);
+	for(int i = 0; i < numVaryings; i++)
+		straddledVertex.varyings[i] = lerp(v1.varyings[i], v2.varyings[i], amount);
 	return straddledVertex;
 }
 
-static VertexBuffer clipAgainstEdge(const VertexBuffer& in, PlaneBits clipPlane)
+static VertexBuffer clipAgainstEdge(const VertexBuffer& in, PlaneBits clipPlane, int numVaryings)
 {
 	//setting starting point equals to last point in input array
-	Vertex startPoint = in.clippedVertices[in.size - 1];
+	ShadedVertex startPoint = in.clippedVertices[in.size - 1];
 	
 	//resetting output buffer
 	VertexBuffer out = {};
 
 	for(size_t i = 0; i < in.size; i++) {
-		Vertex endPoint = in.clippedVertices[i];
+		const ShadedVertex& endPoint = in.clippedVertices[i];
 		if(isVertexInsidePlane(startPoint.pos, clipPlane)) {
 			if(isVertexInsidePlane(endPoint.pos, clipPlane)) {
 				//printf("CLIPPER: IN_IN\n");
@@ -105,7 +103,7 @@ static VertexBuffer clipAgainstEdge(const VertexBuffer& in, PlaneBits clipPlane)
 				//IN_OUT
 				//printf("CLIPPER: IN_OUT\n");
 				//push straddled point
-				Vertex straddledPoint = intersectPlaneSegment(startPoint, endPoint, clipPlane);
+				ShadedVertex straddledPoint = intersectPlaneSegment(startPoint, endPoint, clipPlane, numVaryings);
 				vbPushData(out, straddledPoint);
 			}
 		}
@@ -113,7 +111,7 @@ static VertexBuffer clipAgainstEdge(const VertexBuffer& in, PlaneBits clipPlane)
 			if(isVertexInsidePlane(endPoint.pos, clipPlane)) { //OUT_IN
 				//printf("CLIPPER: OUT_IN\n"); 
 				//push straddled point
-				Vertex straddledPoint = intersectPlaneSegment(startPoint, endPoint, clipPlane);
+				ShadedVertex straddledPoint = intersectPlaneSegment(startPoint, endPoint, clipPlane, numVaryings);
 				vbPushData(out, straddledPoint);
 				//push end Point
 				vbPushData(out, endPoint);
@@ -130,7 +128,7 @@ static VertexBuffer clipAgainstEdge(const VertexBuffer& in, PlaneBits clipPlane)
 	return out;
 }
 
-ClippResult clipTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3)
+ClippResult clipTriangle(const ShadedVertex& v1, const ShadedVertex& v2, const ShadedVertex& v3, int numVaryings)
 {
 	ClippResult result = {};
 	VertexBuffer in = {3, {v1, v2, v3}};
@@ -138,7 +136,7 @@ ClippResult clipTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3)
 
 	int currentPlane = PLANE_LEFT_BIT;
 	for(int i = 0; i < PLANE_COUNT; i++) {
-		out = clipAgainstEdge(in, (PlaneBits)currentPlane);
+		out = clipAgainstEdge(in, (PlaneBits)currentPlane, numVaryings);
 		currentPlane <<= 1;
 		in = out;
 	}
@@ -148,34 +146,12 @@ ClippResult clipTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3)
 	
 	result.numTriangles = in.size - 2;
 
-	Vec4 refPoint = in.clippedVertices[0].pos;
-	Vec3 refT = in.clippedVertices[0].texCoords;
-	Vec3 refC = in.clippedVertices[0].color;
-	Vec3 refN = in.clippedVertices[0].normal;
-	Vec3 refTan = in.clippedVertices[0].tangent;
-
+	//fan around the first vertex
 	for(size_t i = 0; i < result.numTriangles; i++) {
-		Triangle& tr = result.triangles[i];
-		tr.v1.pos = refPoint;
-		tr.v1.texCoords = refT;
-		tr.v1.color = refC;
-		tr.v1.normal = refN;
-		tr.v1.tangent = refTan;
-
-		tr.v2.pos = in.clippedVertices[i + 1].pos; 
-		tr.v3.pos = in.clippedVertices[i + 2].pos;
-
-		tr.v2.texCoords = in.clippedVertices[i + 1].texCoords; 
-		tr.v3.texCoords = in.clippedVertices[i + 2].texCoords;
-
-		tr.v2.color = in.clippedVertices[i + 1].color; 
-		tr.v3.color = in.clippedVertices[i + 2].color;
-
-		tr.v2.normal = in.clippedVertices[i + 1].normal; 
-		tr.v3.normal = in.clippedVertices[i + 2].normal;
-
-		tr.v2.tangent = in.clippedVertices[i + 1].tangent; 
-		tr.v3.tangent = in.clippedVertices[i + 2].tangent;
+		ShadedTriangle& tr = result.triangles[i];
+		tr.v1 = in.clippedVertices[0];
+		tr.v2 = in.clippedVertices[i + 1];
+		tr.v3 = in.clippedVertices[i + 2];
 
  //       printf("Triangle: v1 : {%f, %f, %f} v2:{%f, %f, %f} v3:{%f, %f, %f}\n",
  //       tr.v1.x,tr.v1.y,tr.v1.z,
@@ -6,14 +6,30 @@
 static const int MAX_CLIPPED_TRIANGLE_COUNT = 5;
 static const int MAX_CLIPPED_VERTEX_COUNT = 7;
 
+//clip space triangle after the vertex stage
+struct ShadedTriangle
+{
+	ShadedVertex v1;
+	ShadedVertex v2;
+	ShadedVertex v3;
+};
+
 struct ClippResult
 {
-	Triangle triangles[MAX_CLIPPED_TRIANGLE_COUNT];
+	ShadedTriangle triangles[MAX_CLIPPED_TRIANGLE_COUNT];
 	size_t numTriangles;//num vertices - 2
 };
 
 bool isInsideViewFrustum(const Vec4& pos);
 
-ClippResult clipTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3);
+//one bit per frustum plane the clip space point is outside of
+inline uint8_t frustumOutcode(const Vec4& clip)
+{
+	return (clip.x < -clip.w) | (clip.x > clip.w) << 1 | (clip.y < -clip.w) << 2
+		| (clip.y > clip.w) << 3 | (clip.z < -clip.w) << 4 | (clip.z > clip.w) << 5;
+}
+
+//only the first numVaryings varyings of the vertices are interpolated along clipped edges
+ClippResult clipTriangle(const ShadedVertex& v1, const ShadedVertex& v2, const ShadedVertex& v3, int numVaryings);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "deferred.h"
+
+bool resizeGBuffer(RenderContext* context, GBuffer* gbuffer, uint32_t width, uint32_t height)
+{
+	gbuffer->width = width;
+	gbuffer->height = height;
+	return reservePoolMemory(context->targetPool, (void**)&gbuffer->normals, width * height * sizeof(uint32_t))
+		&& reservePoolMemory(context->targetPool, (void**)&gbuffer->albedo, width * height * sizeof(uint32_t));
+}
+
+void releaseGBuffer(RenderContext* context, GBuffer* gbuffer)
+{
+	releasePoolMemory(context->targetPool, gbuffer->normals);
+	releasePoolMemory(context->targetPool, gbuffer->albedo);
+	gbuffer->normals = nullptr;
+	gbuffer->albedo = nullptr;
+}
+
+static bool sameMaterial(const DeferredMaterial& a, const DeferredMaterial& b)
+{
+	auto sameVec3 = [](const Vec3& u, const Vec3& v) { return u.x == v.x && u.y == v.y && u.z == v.z; };
+	return sameVec3(a.ambientReflectivity, b.ambientReflectivity) && sameVec3(a.diffuseReflectivity, b.diffuseReflectivity)
+		&& sameVec3(a.specularReflectivity, b.specularReflectivity) && a.glossinessPower == b.glossinessPower;
+}
+
+uint32_t registerDeferredMaterial(RenderContext* context, const Shader& shader, const mat4x4& invVP, const Vec3& cameraPosition)
+{
+	DeferredMaterial material = {};
+	if(!shader.deferredMaterial(&material))
+		return 0;
+
+	DeferredFrame& frame = context->gbuffer->recording;
+	frame.invVP = invVP;
+	frame.invViewport = inverse(context->viewportTransform);
+	frame.cameraPosition = cameraPosition;
+	frame.specular = context->quality.specular;
+
+	//draws sharing a shader setup share the id
+	for(uint32_t i = 0; i < frame.materials.size(); i++) {
+		if(sameMaterial(frame.materials[i], material))
+			return i + 1;
+	}
+	if(frame.materials.size() == MAX_DEFERRED_MATERIALS)
+		return 0;
+	frame.materials.push_back(material);
+	return frame.materials.size();
+}
+
+void shadeGBuffer(JobSystem* jobs, const GBuffer& gbuffer, const DeferredFrame& frame, const RenderTargets& targets, const PixelBuffer& surface)
+{
+	if(frame.materials.empty())
+		return;
+
+	parallelFor(jobs, targets.tilesY, 1, [&](uint32_t firstTileRow, uint32_t endTileRow) {
+		for(uint32_t ty = firstTileRow; ty < endTileRow; ty++) {
+			int minY = ty * RENDER_TILE_SIZE;
+			int maxY = min(minY + RENDER_TILE_SIZE, surface.height);
+			for(int tx = 0; tx < targets.tilesX; tx++) {
+				if(targets.tileFlags[ty * targets.tilesX + tx] & TILE_CLEARED)
+					continue;
+				int minX = tx * RENDER_TILE_SIZE;
+				int maxX = min(minX + RENDER_TILE_SIZE, surface.width);
+				for(int y = minY; y < maxY; y++) {
+					uint32_t* row = pixelRow(surface, y);
+					for(int x = minX; x < maxX; x++) {
+						uint32_t albedo = gbuffer.albedo[y * gbuffer.width + x];
+						uint32_t materialId = albedo >> 24;
+						if(!materialId)
+							continue;
+
+						const DeferredMaterial& material = frame.materials[materialId - 1];
+						Vec3 color = {(float)(albedo & 0xff), (float)((albedo >> 8) & 0xff), (float)((albedo >> 16) & 0xff)};
+						Vec3 normal = decodeNormal(gbuffer.normals[y * gbuffer.width + x]);
+						Vec3 position = reconstructPosition(frame.invVP, frame.invViewport, x, y, targets.zBuffer[y * gbuffer.width + x]);
+
+						//light comes from the camera like it does for the forward shaders
+						Vec3 viewVector = normaliseVec3(frame.cameraPosition - position);
+						Vec3 lightVector = viewVector;
+						Vec3 diffuseContribution = material.diffuseReflectivity * max(0.f, dotVec3(lightVector, normal));
+						Vec3 reflectedVector = 2.f * dotVec3(normal, lightVector) * normal - lightVector;
+						Vec3 specularContribution = material.specularReflectivity
+							* (frame.specular ? pow(max(0.f, dotVec3(reflectedVector, viewVector)), material.glossinessPower) : 0.f);
+						Vec3 fragColor = (diffuseContribution + specularContribution + material.ambientReflectivity) ^ color;
+						fragColor = clamp(fragColor, RGB_BLACK, RGB_WHITE);
+						row[x] = packPixel(surface.format, Vec4{fragColor.R, fragColor.G, fragColor.B, 255.f});
+					}
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,79 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <vector>
+#include "renderer.h"
+
+//materials and camera of the frame being recorded, the lighting pass of that frame shades with them
+struct DeferredFrame
+{
+	std::vector<DeferredMaterial> materials;//!<material id - 1
+	mat4x4 invVP;
+	mat4x4 invViewport;
+	Vec3 cameraPosition;
+	bool specular;//!<quality setting of the draws, see QualityLevel
+};
+
+//one sample per pixel, depth lives in the context zBuffer. 8 bytes a pixel on top of it
+struct GBuffer
+{
+	uint32_t* normals;//!<octahedral encoded world space normals, 16 bits per axis
+	uint32_t* albedo;//!<rgb albedo with the material id in the top byte, 0 marks pixels shaded on the forward path
+	int width;
+	int height;
+	DeferredFrame recording;
+};
+
+//8 bit ids in the G-buffer
+static const uint32_t MAX_DEFERRED_MATERIALS = 255;
+
+bool resizeGBuffer(RenderContext* context, GBuffer* gbuffer, uint32_t width, uint32_t height);
+
+void releaseGBuffer(RenderContext* context, GBuffer* gbuffer);
+
+//material id draws with shader write into the G-buffer with, 0 when it has to be shaded forward
+//(no deferred material or the frame ran out of ids). All deferred draws of a frame are lit with the camera of the last one
+uint32_t registerDeferredMaterial(RenderContext* context, const Shader& shader, const mat4x4& invVP, const Vec3& cameraPosition);
+
+inline uint32_t encodeNormal(const Vec3& n)
+{
+	//octahedral mapping, the lower hemisphere is folded over the diagonals
+	float invL1 = 1.f / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+	float x = n.x * invL1;
+	float y = n.y * invL1;
+	if(n.z < 0.f) {
+		float foldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+		y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+		x = foldedX;
+	}
+	uint32_t ux = (uint32_t)((x * 0.5f + 0.5f) * 65535.f + 0.5f);
+	uint32_t uy = (uint32_t)((y * 0.5f + 0.5f) * 65535.f + 0.5f);
+	return uy << 16 | ux;
+}
+
+inline Vec3 decodeNormal(uint32_t encoded)
+{
+	float x = (encoded & 0xffff) / 65535.f * 2.f - 1.f;
+	float y = (encoded >> 16) / 65535.f * 2.f - 1.f;
+	Vec3 n = {x, y, 1.f - std::abs(x) - std::abs(y)};
+	if(n.z < 0.f) {
+		float unfoldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+		n.y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+		n.x = unfoldedX;
+	}
+	return normaliseVec3(n);
+}
+
+inline void writeGBuffer(const GBuffer& gbuffer, int x, int y, const SurfaceSample& sample, uint32_t materialId)
+{
+	uint32_t r = (uint8_t)clamp(sample.albedo.R, 0.f, 255.f);
+	uint32_t g = (uint8_t)clamp(sample.albedo.G, 0.f, 255.f);
+	uint32_t b = (uint8_t)clamp(sample.albedo.B, 0.f, 255.f);
+	gbuffer.normals[y * gbuffer.width + x] = encodeNormal(sample.normal);
+	gbuffer.albedo[y * gbuffer.width + x] = materialId << 24 | b << 16 | g << 8 | r;
+}
+
+//full screen lighting pass, shades every pixel with a deferred material exactly once. Tiles nothing was drawn to are skipped
+void shadeGBuffer(JobSystem* jobs, const GBuffer& gbuffer, const DeferredFrame& frame, const RenderTargets& targets, const PixelBuffer& surface);
+
+#endif
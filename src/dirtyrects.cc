@@ -0,0 +1,128 @@
+#include "dirtyrects.h"
+#include <cstring>
+
+//past this share of the tiles the display gets the whole frame
+static const float FULL_PRESENT_SHARE = 0.5f;
+//more rects than this are merged into their bounds
+static const size_t MAX_DIRTY_RECTS = 32;
+
+static bool reserveFrame(RenderContext* context, DirtyRects* dirty, const PixelBuffer& frame)
+{
+	dirty->width = 0;
+	dirty->height = 0;
+	if(!reservePoolMemory(context->targetPool, (void**)&dirty->previous, (size_t)frame.width * frame.height * sizeof(uint32_t))) {
+		printf("Failed to allocate dirty rect memory\n");
+		return false;
+	}
+	dirty->width = frame.width;
+	dirty->height = frame.height;
+	dirty->tilesX = (frame.width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	dirty->tilesY = (frame.height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	dirty->dirtyTiles.assign(dirty->tilesX * dirty->tilesY, 1);
+	return true;
+}
+
+//rows of tiles bottom up become rects top down, runs of dirty tiles are joined with the run below when they line up
+void buildRects(DirtyRects* dirty)
+{
+	dirty->rects.clear();
+	//rect each tile column's open run was last extended into
+	std::vector<int> openRect(dirty->tilesX, -1);
+	for(int ty = dirty->tilesY - 1; ty >= 0; ty--) {
+		const uint8_t* tiles = &dirty->dirtyTiles[ty * dirty->tilesX];
+		int minY = ty * RENDER_TILE_SIZE;
+		int maxY = min(minY + RENDER_TILE_SIZE, dirty->height);
+		std::vector<int> nextOpen(dirty->tilesX, -1);
+		for(int tx = 0; tx < dirty->tilesX;) {
+			if(!tiles[tx]) {
+				tx++;
+				continue;
+			}
+			int first = tx;
+			while(tx < dirty->tilesX && tiles[tx])
+				tx++;
+			int x = first * RENDER_TILE_SIZE;
+			int width = min(tx * RENDER_TILE_SIZE, dirty->width) - x;
+
+			int above = openRect[first];
+			if(above >= 0 && dirty->rects[above].x == x && dirty->rects[above].width == width) {
+				dirty->rects[above].height += maxY - minY;
+			}
+			else {
+				above = dirty->rects.size();
+				dirty->rects.push_back(DirtyRect{x, dirty->height - maxY, width, maxY - minY});
+			}
+			nextOpen[first] = above;
+		}
+		openRect.swap(nextOpen);
+	}
+
+	if(dirty->rects.size() > MAX_DIRTY_RECTS) {
+		DirtyRect bounds = dirty->rects[0];
+		for(const DirtyRect& rect : dirty->rects) {
+			int right = max(bounds.x + bounds.width, rect.x + rect.width);
+			int bottom = max(bounds.y + bounds.height, rect.y + rect.height);
+			bounds.x = min(bounds.x, rect.x);
+			bounds.y = min(bounds.y, rect.y);
+			bounds.width = right - bounds.x;
+			bounds.height = bottom - bounds.y;
+		}
+		dirty->rects.assign(1, bounds);
+	}
+}
+
+DirtyRects* createDirtyRects(RenderContext* context)
+{
+	DirtyRects* dirty = new DirtyRects();
+	context->dirtyRects = dirty;
+	return dirty;
+}
+
+void destroyDirtyRects(RenderContext* context)
+{
+	releasePoolMemory(context->targetPool, context->dirtyRects->previous);
+	delete context->dirtyRects;
+	context->dirtyRects = nullptr;
+}
+
+void findDirtyRects(RenderContext* context, const PixelBuffer& frame)
+{
+	DirtyRects* dirty = context->dirtyRects;
+	dirty->rects.clear();
+	dirty->full = true;
+	bool resized = frame.width != dirty->width || frame.height != dirty->height;
+	if(resized && !reserveFrame(context, dirty, frame))
+		return;
+
+	//changed row segments are copied right away, previous ends up holding this frame
+	parallelFor(context->jobs, dirty->tilesY, 1, [&](uint32_t firstTileRow, uint32_t endTileRow) {
+		for(uint32_t ty = firstTileRow; ty < endTileRow; ty++) {
+			uint8_t* tiles = &dirty->dirtyTiles[ty * dirty->tilesX];
+			std::fill(tiles, tiles + dirty->tilesX, resized);
+			int minY = ty * RENDER_TILE_SIZE;
+			int maxY = min(minY + RENDER_TILE_SIZE, frame.height);
+			for(int y = minY; y < maxY; y++) {
+				const uint32_t* row = pixelRow(frame, y);
+				uint32_t* previousRow = dirty->previous + y * frame.width;
+				for(int tx = 0; tx < dirty->tilesX; tx++) {
+					int minX = tx * RENDER_TILE_SIZE;
+					size_t bytes = (min(minX + RENDER_TILE_SIZE, frame.width) - minX) * sizeof(uint32_t);
+					if(!resized && !memcmp(row + minX, previousRow + minX, bytes))
+						continue;
+					memcpy(previousRow + minX, row + minX, bytes);
+					tiles[tx] = 1;
+				}
+			}
+		}
+	});
+	if(resized)
+		return;
+
+	size_t numDirty = 0;
+	for(uint8_t tile : dirty->dirtyTiles)
+		numDirty += tile;
+	if(numDirty > FULL_PRESENT_SHARE * dirty->dirtyTiles.size())
+		return;
+	dirty->full = false;
+	buildRects(dirty);
+}
@@ -0,0 +1,32 @@
+#ifndef DIRTY_RECTS_H
+#define DIRTY_RECTS_H
+
+#include <vector>
+#include "renderer.h"
+
+//presented frames are compared with the one before tile by tile, only the tiles that differ are sent to the window.
+//Comparing takes a read of the frame, which is far cheaper than copying all of it to the display
+struct DirtyRects
+{
+	uint32_t* previous;//!<last presented frame, tightly packed with y going up like pixelRow's
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	std::vector<uint8_t> dirtyTiles;
+	std::vector<DirtyRect> rects;
+	bool full;//!<the whole frame changed or there's nothing to compare with
+};
+
+DirtyRects* createDirtyRects(RenderContext* context);
+
+void destroyDirtyRects(RenderContext* context);
+
+//compares frame with the previously presented one and keeps it for the next call. Leaves the changed parts in rects,
+//or sets full when it's cheaper to present everything
+void findDirtyRects(RenderContext* context, const PixelBuffer& frame);
+
+//turns dirtyTiles into rects, merged into their bounds when there are too many of them
+void buildRects(DirtyRects* dirty);
+
+#endif
@@ -0,0 +1,260 @@
+#include "framecache.h"
+#include "hash.h"
+#include <typeinfo>
+
+//past this share of the screen a single pass over every draw is cheaper than a pass per changed region
+static const float FULL_RENDER_SHARE = 0.5f;
+//more regions than this are merged into their bounds
+static const size_t MAX_CHANGED_REGIONS = 16;
+
+static const ScissorRect OFF_SCREEN = {0, 0, -1, -1};
+
+//anything every draw depends on, a change renders the whole frame
+static uint64_t hashRenderState(const RenderContext* context)
+{
+	int size[2] = {context->window.width, context->window.height};
+	const void* buffers[3] = {context->surface.pixels, context->rtargets.zBuffer, context->shadingRateImage};
+	bool flags[3] = {msaaEnabled(context), context->virtualShaders, context->quality.specular};
+	uint64_t hash = hashBytes(FNV_OFFSET, &context->perspectiveTransform, sizeof(mat4x4));
+	hash = hashBytes(hash, &context->viewportTransform, sizeof(mat4x4));
+	hash = hashBytes(hash, &context->clearColor, sizeof(Vec4));
+	hash = hashBytes(hash, size, sizeof(size));
+	hash = hashBytes(hash, buffers, sizeof(buffers));
+	hash = hashBytes(hash, flags, sizeof(flags));
+	hash = hashBytes(hash, &context->lodErrorThreshold, sizeof(float));
+	hash = hashBytes(hash, &context->quality.parallaxLayers, sizeof(int));
+	return hash;
+}
+
+//meshes are identified by their buffers and shaders by their type, the uniforms the application sets and Shader::hashState
+static uint64_t hashDraw(const CachedDraw& draw)
+{
+	const Mesh* mesh = draw.object.mesh;
+	const void* buffers[6] = {mesh, mesh->faces.data(), mesh->vertPos.data(), draw.object.texture, draw.object.normalMap, draw.object.heightMap};
+	size_t numFaces = mesh->faces.size();
+	size_t shaderType = typeid(*draw.shader).hash_code();
+	const ShaderUniforms& uniforms = draw.shader->uniforms;
+	uint64_t hash = hashBytes(FNV_OFFSET, buffers, sizeof(buffers));
+	hash = hashBytes(hash, &numFaces, sizeof(numFaces));
+	hash = hashBytes(hash, &shaderType, sizeof(shaderType));
+	hash = hashBytes(hash, &draw.modelToWorldTransform, sizeof(mat4x4));
+	hash = hashBytes(hash, &draw.camera.worldToCameraTransform, sizeof(mat4x4));
+	hash = hashBytes(hash, &draw.camera.camPos, sizeof(Vec3));
+	hash = hashBytes(hash, &uniforms.in_flatColor, sizeof(Vec3));
+	hash = hashBytes(hash, &uniforms.in_shadingRate, sizeof(uniforms.in_shadingRate));
+	return draw.shader->hashState(hash);
+}
+
+//projected bounding box of the mesh grown to whole tiles, the whole screen when it crosses the camera plane
+static ScissorRect drawBounds(const RenderContext* context, const CachedDraw& draw)
+{
+	const Mesh& mesh = *draw.object.mesh;
+	AABB box = transformAABB(mesh.lods.empty() ? computeMeshBounds(mesh) : mesh.bounds, draw.modelToWorldTransform);
+	mat4x4 VP = draw.camera.worldToCameraTransform * context->perspectiveTransform;
+	int width = context->window.width;
+	int height = context->window.height;
+
+	Vec2 screenMin = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+	Vec2 screenMax = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+	for(uint8_t i = 0; i < 8; i++) {
+		Vec4 corner = {
+			i & 1 ? box.max.x : box.min.x,
+			i & 2 ? box.max.y : box.min.y,
+			i & 4 ? box.max.z : box.min.z,
+			1.f
+		};
+		corner *= VP;
+		if(corner.w <= 0.f)
+			return ScissorRect{0, 0, width - 1, height - 1};
+		Vec4 screen = perspectiveDivide(corner) * context->viewportTransform;
+		screenMin = Vec2{min(screenMin.x, screen.x), min(screenMin.y, screen.y)};
+		screenMax = Vec2{max(screenMax.x, screen.x), max(screenMax.y, screen.y)};
+	}
+	if(screenMax.x < 0.f || screenMax.y < 0.f || screenMin.x >= width || screenMin.y >= height)
+		return OFF_SCREEN;
+
+	//a pixel of slack for the rasterizer's rounding
+	int minX = (int)max(screenMin.x - 1.f, 0.f) / RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+	int minY = (int)max(screenMin.y - 1.f, 0.f) / RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+	int maxX = min(((int)min(screenMax.x + 1.f, width - 1.f) / RENDER_TILE_SIZE + 1) * RENDER_TILE_SIZE, width) - 1;
+	int maxY = min(((int)min(screenMax.y + 1.f, height - 1.f) / RENDER_TILE_SIZE + 1) * RENDER_TILE_SIZE, height) - 1;
+	return ScissorRect{minX, minY, maxX, maxY};
+}
+
+static bool offScreen(const ScissorRect& rect)
+{
+	return rect.minX > rect.maxX || rect.minY > rect.maxY;
+}
+
+static bool overlaps(const ScissorRect& a, const ScissorRect& b)
+{
+	return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+static ScissorRect unionRect(const ScissorRect& a, const ScissorRect& b)
+{
+	return ScissorRect{min(a.minX, b.minX), min(a.minY, b.minY), max(a.maxX, b.maxX), max(a.maxY, b.maxY)};
+}
+
+//overlapping regions would render the same tiles twice
+static void mergeRegions(std::vector<ScissorRect>& regions)
+{
+	bool merged = true;
+	while(merged) {
+		merged = false;
+		for(size_t i = 0; i < regions.size() && !merged; i++) {
+			for(size_t j = i + 1; j < regions.size(); j++) {
+				if(!overlaps(regions[i], regions[j]))
+					continue;
+				regions[i] = unionRect(regions[i], regions[j]);
+				regions.erase(regions.begin() + j);
+				merged = true;
+				break;
+			}
+		}
+	}
+
+	if(regions.size() > MAX_CHANGED_REGIONS) {
+		for(size_t i = 1; i < regions.size(); i++)
+			regions[0] = unionRect(regions[0], regions[i]);
+		regions.resize(1);
+	}
+}
+
+static void releaseDraws(std::vector<CachedDraw>& draws)
+{
+	for(CachedDraw& draw : draws)
+		delete draw.shader;
+	draws.clear();
+}
+
+static void replayDraws(RenderContext* context, const ScissorRect& region)
+{
+	FrameCache* cache = context->frameCache;
+	cache->replaying = true;
+	cache->replayRect = region;
+	for(const CachedDraw& draw : cache->recording) {
+		if(overlaps(draw.bounds, region))
+			renderObject(context, draw.object, draw.modelToWorldTransform, draw.camera, *draw.shader);
+	}
+	cache->replaying = false;
+}
+
+FrameCache* createFrameCache(RenderContext* context)
+{
+	FrameCache* cache = new FrameCache();
+	context->frameCache = cache;
+	return cache;
+}
+
+void destroyFrameCache(RenderContext* context)
+{
+	FrameCache* cache = context->frameCache;
+	releaseDraws(cache->previous);
+	releaseDraws(cache->recording);
+	delete cache;
+	context->frameCache = nullptr;
+}
+
+bool beginCachedFrame(RenderContext* context)
+{
+	FrameCache* cache = context->frameCache;
+	releaseDraws(cache->recording);
+	cache->recordingFrame = !context->pipeline && !context->gbuffer && !context->visibility && !context->checkerboard;
+	if(!cache->recordingFrame)
+		cache->valid = false;
+	return cache->recordingFrame;
+}
+
+bool recordCachedDraw(RenderContext* context, const RenderObject& object, const mat4x4& modelToWorldTransform,
+	const Camera& camera, const Shader& shader)
+{
+	if(!recordingCachedDraws(context))
+		return false;
+
+	Shader* snapshot = shader.clone();
+	if(!snapshot) {
+		//the draw can't be replayed later, so nothing can be
+		flushFrameCache(context);
+		return false;
+	}
+	CachedDraw draw = {object, modelToWorldTransform, camera, snapshot, 0, OFF_SCREEN};
+	draw.key = hashDraw(draw);
+	context->frameCache->recording.push_back(draw);
+	return true;
+}
+
+void flushFrameCache(RenderContext* context)
+{
+	FrameCache* cache = context->frameCache;
+	if(!cache->recordingFrame)
+		return;
+	cache->recordingFrame = false;
+	cache->valid = false;
+	clearRenderTargets(&context->rtargets, context->clearColor);
+	//bounds are only computed in endFrame, every draw may cover the screen
+	for(CachedDraw& draw : cache->recording)
+		draw.bounds = ScissorRect{0, 0, context->window.width - 1, context->window.height - 1};
+	replayDraws(context, ScissorRect{0, 0, context->window.width - 1, context->window.height - 1});
+	releaseDraws(cache->recording);
+}
+
+void renderCachedFrame(RenderContext* context)
+{
+	FrameCache* cache = context->frameCache;
+	RenderTargets& targets = context->rtargets;
+	uint32_t numTiles = targets.tilesX * targets.tilesY;
+	cache->renderedTiles = numTiles;
+	if(!cache->recordingFrame)
+		return;
+	cache->recordingFrame = false;
+
+	std::vector<CachedDraw>& draws = cache->recording;
+	const std::vector<CachedDraw>& previous = cache->previous;
+	uint64_t stateKey = hashRenderState(context);
+	bool full = !cache->valid || stateKey != cache->stateKey;
+
+	//draws that moved, changed or came and went leave their old and new bounds to be rendered again
+	std::vector<ScissorRect> regions;
+	for(size_t i = 0; i < max(draws.size(), previous.size()); i++) {
+		if(!full && i < draws.size() && i < previous.size() && draws[i].key == previous[i].key) {
+			draws[i].bounds = previous[i].bounds;
+			continue;
+		}
+		if(i < draws.size())
+			draws[i].bounds = drawBounds(context, draws[i]);
+		if(full)
+			continue;
+		if(i < previous.size() && !offScreen(previous[i].bounds))
+			regions.push_back(previous[i].bounds);
+		if(i < draws.size() && !offScreen(draws[i].bounds))
+			regions.push_back(draws[i].bounds);
+	}
+	mergeRegions(regions);
+
+	uint32_t changedTiles = 0;
+	for(const ScissorRect& region : regions)
+		changedTiles += ((region.maxX - region.minX) / RENDER_TILE_SIZE + 1) * ((region.maxY - region.minY) / RENDER_TILE_SIZE + 1);
+	full = full || changedTiles > FULL_RENDER_SHARE * numTiles;
+
+	if(full) {
+		clearRenderTargets(&targets, context->clearColor);
+		replayDraws(context, ScissorRect{0, 0, context->window.width - 1, context->window.height - 1});
+	} else {
+		//regions are tile aligned, cleared tiles get their depth and color reset when a draw touches them
+		for(const ScissorRect& region : regions) {
+			for(int ty = region.minY / RENDER_TILE_SIZE; ty <= region.maxY / RENDER_TILE_SIZE; ty++) {
+				for(int tx = region.minX / RENDER_TILE_SIZE; tx <= region.maxX / RENDER_TILE_SIZE; tx++)
+					targets.tileFlags[ty * targets.tilesX + tx] = TILE_CLEARED;
+			}
+		}
+		for(const ScissorRect& region : regions)
+			replayDraws(context, region);
+		cache->renderedTiles = changedTiles;
+	}
+
+	releaseDraws(cache->previous);
+	cache->previous.swap(cache->recording);
+	cache->stateKey = stateKey;
+	cache->valid = true;
+}
@@ -0,0 +1,57 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <vector>
+#include "renderer.h"
+
+//draw recorded by renderObject, replayed in endFrame when it overlaps a region that has to be re-rendered
+struct CachedDraw
+{
+	RenderObject object;
+	mat4x4 modelToWorldTransform;
+	Camera camera;
+	Shader* shader;//!<snapshot taken when the draw was recorded
+	uint64_t key;//!<mesh, transforms, camera and uniforms the draw was recorded with
+	ScissorRect bounds;//!<tile aligned screen bounds of the mesh, minX > maxX when it's off screen
+};
+
+//draws of the frame being recorded and of the frame in the targets. Draw i of a frame is compared with draw i
+//of the one before, tiles under draws that differ(at their old and new place) are cleared and rendered again
+struct FrameCache
+{
+	std::vector<CachedDraw> previous;
+	std::vector<CachedDraw> recording;
+	uint64_t stateKey;//!<render state the targets were rendered with
+	bool valid;//!<targets hold the previous frame
+	bool recordingFrame;//!<false when the frame renders as usual, see flushFrameCache
+	bool replaying;//!<draws go to the rasterizer instead of being recorded
+	ScissorRect replayRect;//!<region being rendered again, band scissors are clipped to it
+	uint32_t renderedTiles;//!<tiles the last frame rendered, 0 when nothing changed
+};
+
+//draws go to the frame cache instead of the rasterizer
+inline bool recordingCachedDraws(const RenderContext* context)
+{
+	return context->frameCache && context->frameCache->recordingFrame && !context->frameCache->replaying;
+}
+
+FrameCache* createFrameCache(RenderContext* context);
+
+void destroyFrameCache(RenderContext* context);
+
+//starts recording draws, returns false when the frame has to be cleared and rendered as usual.
+//Pipelined, deferred, visibility buffer and checkerboard frames aren't cached
+bool beginCachedFrame(RenderContext* context);
+
+//records a draw with a snapshot of its shader, false when it has to be rendered right away instead
+bool recordCachedDraw(RenderContext* context, const RenderObject& object, const mat4x4& modelToWorldTransform,
+	const Camera& camera, const Shader& shader);
+
+//renders what is left of the frame as usual: the targets are cleared and the draws recorded so far rendered,
+//draws after it aren't recorded. The next frame is rendered in full
+void flushFrameCache(RenderContext* context);
+
+//compares the recorded draws with the previous frame's and renders the tiles that changed, called by endFrame
+void renderCachedFrame(RenderContext* context);
+
+#endif
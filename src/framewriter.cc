@@ -0,0 +1,386 @@
+#include "framewriter.h"
+#include "timer.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#define popen _popen
+#define pclose _pclose
+#endif
+
+struct CapturedFrame
+{
+	std::vector<uint32_t> pixels;//!<top row first, tightly packed
+	int width;
+	int height;
+	PixelFormat format;
+	uint64_t frameNumber;
+};
+
+struct FrameWriter
+{
+	FrameWriterConfig config;
+	FILE* stream;//!<null for image sequences
+	int streamWidth;//!<streams take the size of their first frame
+	int streamHeight;
+
+	std::vector<CapturedFrame> ring;
+	std::vector<uint32_t> freeBuffers;
+	std::deque<uint32_t> queue;
+	uint32_t encoding;//!<frames the writer thread took off the queue but hasn't finished
+	uint64_t framesAccepted;
+	std::mutex lock;
+	std::condition_variable frameQueued;
+	std::condition_variable bufferFreed;
+	std::thread thread;
+	bool quit;
+	FrameWriterStats stats;
+};
+
+static bool isStream(FrameOutputFormat format)
+{
+	return format == FRAME_OUTPUT_Y4M || format == FRAME_OUTPUT_RAW_RGB;
+}
+
+static void unpackRGB(const CapturedFrame& frame, std::vector<uint8_t>& out)
+{
+	out.resize(frame.width * frame.height * 3);
+	uint8_t* rgb = out.data();
+	bool abgr = frame.format == PIXEL_FORMAT_ABGR8888;
+	for(uint32_t pixel : frame.pixels) {
+		uint8_t hi = (pixel >> 16) & 0xff;
+		uint8_t lo = pixel & 0xff;
+		rgb[0] = abgr ? lo : hi;
+		rgb[1] = (pixel >> 8) & 0xff;
+		rgb[2] = abgr ? hi : lo;
+		rgb += 3;
+	}
+}
+
+static bool writePPM(FILE* file, const CapturedFrame& frame, const std::vector<uint8_t>& rgb)
+{
+	fprintf(file, "P6\n%d %d\n255\n", frame.width, frame.height);
+	return fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+}
+
+struct CrcTable
+{
+	uint32_t entries[256];
+
+	CrcTable()
+	{
+		for(uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for(int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			entries[i] = c;
+		}
+	}
+};
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+	static const CrcTable table;
+	crc = ~crc;
+	for(size_t i = 0; i < size; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBE32(std::vector<uint8_t>& out, uint32_t value)
+{
+	uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+	out.insert(out.end(), bytes, bytes + 4);
+}
+
+static void putPNGChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+	putBE32(out, (uint32_t)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	putBE32(out, crc32(&out[start], out.size() - start));
+}
+
+//no zlib in the tree, image data goes into stored deflate blocks. Files are as big as the raw frame but
+//writing them is little more than a copy, which is what matters to keep up with the renderer
+void encodePNG(int width, int height, const std::vector<uint8_t>& rgb, std::vector<uint8_t>& out)
+{
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	out.assign(signature, signature + 8);
+
+	std::vector<uint8_t> header;
+	putBE32(header, width);
+	putBE32(header, height);
+	const uint8_t format[5] = {8, 2, 0, 0, 0};//8 bit rgb, no interlacing
+	header.insert(header.end(), format, format + 5);
+	putPNGChunk(out, "IHDR", header);
+
+	//every row is prefixed with filter type 0
+	size_t rowBytes = width * 3;
+	std::vector<uint8_t> scanlines((rowBytes + 1) * height);
+	for(int y = 0; y < height; y++) {
+		scanlines[y * (rowBytes + 1)] = 0;
+		memcpy(&scanlines[y * (rowBytes + 1) + 1], &rgb[y * rowBytes], rowBytes);
+	}
+
+	std::vector<uint8_t> zlib = {0x78, 0x01};
+	size_t offset = 0;
+	do {
+		size_t blockSize = min(scanlines.size() - offset, (size_t)65535);
+		bool last = offset + blockSize == scanlines.size();
+		const uint8_t block[5] = {(uint8_t)last, (uint8_t)blockSize, (uint8_t)(blockSize >> 8),
+			(uint8_t)~blockSize, (uint8_t)(~blockSize >> 8)};
+		zlib.insert(zlib.end(), block, block + 5);
+		zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+		offset += blockSize;
+	} while(offset < scanlines.size());
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for(uint8_t byte : scanlines) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBE32(zlib, b << 16 | a);
+	putPNGChunk(out, "IDAT", zlib);
+	putPNGChunk(out, "IEND", std::vector<uint8_t>());
+}
+
+//full range bt.601 with 2x2 averaged chroma, which is what C420jpeg means to ffmpeg
+static bool writeY4MFrame(FILE* file, const CapturedFrame& frame, const std::vector<uint8_t>& rgb, std::vector<uint8_t>& planes)
+{
+	int w = frame.width;
+	int h = frame.height;
+	int cw = (w + 1) / 2;
+	int ch = (h + 1) / 2;
+	planes.resize(w * h + cw * ch * 2);
+	uint8_t* yPlane = planes.data();
+	uint8_t* uPlane = yPlane + w * h;
+	uint8_t* vPlane = uPlane + cw * ch;
+
+	for(int i = 0; i < w * h; i++) {
+		const uint8_t* p = &rgb[i * 3];
+		yPlane[i] = (uint8_t)(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f);
+	}
+
+	for(int cy = 0; cy < ch; cy++) {
+		for(int cx = 0; cx < cw; cx++) {
+			float r = 0.f, g = 0.f, b = 0.f;
+			int count = 0;
+			for(int y = cy * 2; y < min(cy * 2 + 2, h); y++) {
+				for(int x = cx * 2; x < min(cx * 2 + 2, w); x++) {
+					const uint8_t* p = &rgb[(y * w + x) * 3];
+					r += p[0];
+					g += p[1];
+					b += p[2];
+					count++;
+				}
+			}
+			r /= count;
+			g /= count;
+			b /= count;
+			uPlane[cy * cw + cx] = (uint8_t)(128.f - 0.168736f * r - 0.331264f * g + 0.5f * b + 0.5f);
+			vPlane[cy * cw + cx] = (uint8_t)(128.f + 0.5f * r - 0.418688f * g - 0.081312f * b + 0.5f);
+		}
+	}
+
+	fputs("FRAME\n", file);
+	return fwrite(planes.data(), 1, planes.size(), file) == planes.size();
+}
+
+static bool writeFrame(FrameWriter* writer, const CapturedFrame& frame, std::vector<uint8_t>& rgb, std::vector<uint8_t>& scratch)
+{
+	unpackRGB(frame, rgb);
+	const FrameWriterConfig& config = writer->config;
+	switch(config.format) {
+		case FRAME_OUTPUT_Y4M :
+			if(frame.frameNumber == 0) {
+				fprintf(writer->stream, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n",
+					frame.width, frame.height, config.framesPerSecond ? config.framesPerSecond : 30);
+			}
+			return writeY4MFrame(writer->stream, frame, rgb, scratch);
+		case FRAME_OUTPUT_RAW_RGB :
+			return fwrite(rgb.data(), 1, rgb.size(), writer->stream) == rgb.size();
+		default :
+			break;
+	}
+
+	char path[1024];
+	snprintf(path, sizeof(path), config.path, (int)frame.frameNumber);
+	FILE* file = fopen(path, "wb");
+	if(!file) {
+		printf("Failed to open %s for writing!\n", path);
+		return false;
+	}
+
+	bool written;
+	if(config.format == FRAME_OUTPUT_PNG_SEQUENCE) {
+		encodePNG(frame.width, frame.height, rgb, scratch);
+		written = fwrite(scratch.data(), 1, scratch.size(), file) == scratch.size();
+	}
+	else {
+		written = writePPM(file, frame, rgb);
+	}
+	return fclose(file) == 0 && written;
+}
+
+static void writerThread(FrameWriter* writer)
+{
+	std::vector<uint8_t> rgb;
+	std::vector<uint8_t> scratch;
+	std::unique_lock<std::mutex> lock(writer->lock);
+	for(;;) {
+		writer->frameQueued.wait(lock, [writer]{ return writer->quit || !writer->queue.empty(); });
+		//queued frames still go out on quit
+		if(writer->queue.empty())
+			break;
+
+		uint32_t buffer = writer->queue.front();
+		writer->queue.pop_front();
+		writer->encoding++;
+		lock.unlock();
+
+		bool written = writeFrame(writer, writer->ring[buffer], rgb, scratch);
+
+		lock.lock();
+		writer->encoding--;
+		written ? writer->stats.framesWritten++ : writer->stats.writeErrors++;
+		writer->freeBuffers.push_back(buffer);
+		writer->bufferFreed.notify_one();
+	}
+}
+
+FrameWriter* createFrameWriter(const FrameWriterConfig& config)
+{
+	FILE* stream = nullptr;
+	if(isStream(config.format)) {
+		if(config.pipe) {
+#if defined(_WIN32)
+			stream = popen(config.path, "wb");
+#else
+			stream = popen(config.path, "w");
+#endif
+		}
+		else if(!strcmp(config.path, "-")) {
+#if defined(_WIN32)
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+			stream = stdout;
+		}
+		else {
+			stream = fopen(config.path, "wb");
+		}
+
+		if(!stream) {
+			printf("Failed to open frame output %s!\n", config.path);
+			return nullptr;
+		}
+	}
+
+	FrameWriter* writer = new FrameWriter();
+	writer->config = config;
+	writer->stream = stream;
+	writer->streamWidth = 0;
+	writer->streamHeight = 0;
+	writer->encoding = 0;
+	writer->framesAccepted = 0;
+	writer->quit = false;
+	writer->stats = FrameWriterStats();
+
+	uint32_t depth = config.queueDepth ? config.queueDepth : 4;
+	writer->ring.resize(depth);
+	for(uint32_t i = depth; i > 0; i--)
+		writer->freeBuffers.push_back(i - 1);
+
+	writer->thread = std::thread(writerThread, writer);
+	return writer;
+}
+
+void destroyFrameWriter(FrameWriter* writer)
+{
+	{
+		std::lock_guard<std::mutex> lock(writer->lock);
+		writer->quit = true;
+	}
+	writer->frameQueued.notify_one();
+	writer->thread.join();
+
+	if(writer->stream) {
+		if(writer->config.pipe)
+			pclose(writer->stream);
+		else if(writer->stream == stdout)
+			fflush(stdout);
+		else
+			fclose(writer->stream);
+	}
+	delete writer;
+}
+
+bool submitFrame(FrameWriter* writer, const PixelBuffer& frame)
+{
+	std::unique_lock<std::mutex> lock(writer->lock);
+	FrameWriterStats& stats = writer->stats;
+	stats.framesSubmitted++;
+
+	//a stream can't change size midway
+	if(isStream(writer->config.format)) {
+		if(!writer->streamWidth) {
+			writer->streamWidth = frame.width;
+			writer->streamHeight = frame.height;
+		}
+		if(frame.width != writer->streamWidth || frame.height != writer->streamHeight) {
+			stats.framesDropped++;
+			return false;
+		}
+	}
+
+	if(writer->freeBuffers.empty()) {
+		if(writer->config.dropWhenFull) {
+			stats.framesDropped++;
+			return false;
+		}
+		Timer timer;
+		timer.start();
+		stats.stalls++;
+		writer->bufferFreed.wait(lock, [writer]{ return !writer->freeBuffers.empty(); });
+		stats.stallMs += timer.stopMs();
+	}
+
+	uint32_t buffer = writer->freeBuffers.back();
+	writer->freeBuffers.pop_back();
+	uint64_t frameNumber = writer->framesAccepted++;
+	lock.unlock();
+
+	//the buffer belongs to this thread until it's queued, copy without holding the lock
+	CapturedFrame& captured = writer->ring[buffer];
+	captured.width = frame.width;
+	captured.height = frame.height;
+	captured.format = frame.format;
+	captured.frameNumber = frameNumber;
+	captured.pixels.resize(frame.width * frame.height);
+	for(int row = 0; row < frame.height; row++)
+		memcpy(&captured.pixels[row * frame.width], pixelRow(frame, frame.height - 1 - row), frame.width * sizeof(uint32_t));
+
+	lock.lock();
+	writer->queue.push_back(buffer);
+	stats.maxQueued = max(stats.maxQueued, (uint32_t)writer->queue.size() + writer->encoding);
+	lock.unlock();
+	writer->frameQueued.notify_one();
+	return true;
+}
+
+FrameWriterStats getFrameWriterStats(FrameWriter* writer)
+{
+	std::lock_guard<std::mutex> lock(writer->lock);
+	FrameWriterStats stats = writer->stats;
+	stats.queued = (uint32_t)writer->queue.size() + writer->encoding;
+	return stats;
+}
@@ -0,0 +1,58 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <cstdint>
+#include <vector>
+#include "renderer.h"
+
+enum FrameOutputFormat
+{
+	FRAME_OUTPUT_PPM_SEQUENCE,
+	FRAME_OUTPUT_PNG_SEQUENCE,
+	FRAME_OUTPUT_Y4M,//!<single 4:2:0 YUV4MPEG2 stream
+	FRAME_OUTPUT_RAW_RGB//!<single stream of tightly packed rgb24 frames, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24
+};
+
+struct FrameWriterConfig
+{
+	FrameOutputFormat format;
+	const char* path;//!<printf pattern taking the frame number for sequences("out/frame%05d.png"), a file or "-" for stdout for streams
+	bool pipe;//!<streams only, path is a shell command frames are piped into
+	uint32_t queueDepth;//!<frame buffers in the ring, 0 picks 4
+	bool dropWhenFull;//!<drop frames instead of waiting when the writer falls behind
+	uint32_t framesPerSecond;//!<y4m header, 0 picks 30
+};
+
+struct FrameWriterStats
+{
+	uint64_t framesSubmitted;
+	uint64_t framesWritten;
+	uint64_t framesDropped;
+	uint64_t writeErrors;
+	uint64_t stalls;//!<submissions that had to wait for a free buffer
+	double stallMs;//!<total time spent waiting
+	uint32_t maxQueued;//!<highest number of frames waiting to be written at once
+	uint32_t queued;//!<frames waiting right now
+};
+
+//frames are copied into a ring of buffers and encoded on a background thread so rendering never waits on disk
+struct FrameWriter;
+
+FrameWriter* createFrameWriter(const FrameWriterConfig& config);
+
+//writes out everything still queued before returning
+void destroyFrameWriter(FrameWriter* writer);
+
+//copies frame into a free ring buffer, false if the frame was dropped. Frames are written in submission order,
+//submit from one thread at a time
+bool submitFrame(FrameWriter* writer, const PixelBuffer& frame);
+
+FrameWriterStats getFrameWriterStats(FrameWriter* writer);
+
+//crc of png chunks, crc carries on from a previous call over the data before
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+//png of tightly packed rgb24 rows, top row first
+void encodePNG(int width, int height, const std::vector<uint8_t>& rgb, std::vector<uint8_t>& out);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+//FNV-1a, keys state that gets compared from frame to frame
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t bytes)
+{
+	const uint8_t* in = (const uint8_t*)data;
+	for(size_t i = 0; i < bytes; i++)
+		hash = (hash ^ in[i]) * FNV_PRIME;
+	return hash;
+}
+
+template<typename T>
+inline uint64_t hashValue(uint64_t hash, const T& value)
+{
+	return hashBytes(hash, &value, sizeof(T));
+}
+
+#endif
@@ -0,0 +1,52 @@
+#include "hierarchy.h"
+
+uint32_t addTransformNode(TransformHierarchy* hierarchy, int32_t parent, const Transform& local)
+{
+	uint32_t node = hierarchy->local.size();
+	assert(parent < (int32_t)node);
+
+	hierarchy->local.push_back(local);
+	hierarchy->parent.push_back(parent);
+	hierarchy->localMatrix.push_back(loadIdentity());
+	hierarchy->worldMatrix.push_back(loadIdentity());
+	hierarchy->dirty.push_back(1);
+	hierarchy->worldChanged.push_back(0);
+	return node;
+}
+
+void setLocalTransform(TransformHierarchy* hierarchy, uint32_t node, const Transform& local)
+{
+	hierarchy->local[node] = local;
+	hierarchy->dirty[node] = 1;
+}
+
+void updateTransformHierarchy(TransformHierarchy* hierarchy)
+{
+	uint32_t numNodes = hierarchy->local.size();
+	const Transform* local = hierarchy->local.data();
+	const int32_t* parent = hierarchy->parent.data();
+	mat4x4* localMatrix = hierarchy->localMatrix.data();
+	mat4x4* worldMatrix = hierarchy->worldMatrix.data();
+	uint8_t* dirty = hierarchy->dirty.data();
+	uint8_t* worldChanged = hierarchy->worldChanged.data();
+
+	hierarchy->changedNodes.clear();
+
+	for(uint32_t i = 0; i < numNodes; i++) {
+		if(dirty[i])
+			localMatrix[i] = composeTransform(local[i].scale, local[i].rotate, local[i].translate);
+
+		//parent was already visited, so its flag tells whether it moved during this sweep
+		bool parentChanged = parent[i] != HIERARCHY_NO_PARENT && worldChanged[parent[i]];
+		worldChanged[i] = dirty[i] | parentChanged;
+		dirty[i] = 0;
+		if(!worldChanged[i])
+			continue;
+
+		if(parent[i] == HIERARCHY_NO_PARENT)
+			worldMatrix[i] = localMatrix[i];
+		else
+			worldMatrix[i] = mulAffine(localMatrix[i], worldMatrix[parent[i]]);
+		hierarchy->changedNodes.push_back(i);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <vector>
+#include "renderer.h"
+
+static const int32_t HIERARCHY_NO_PARENT = -1;
+
+//parent/child transforms stored as flat arrays, parents always precede their children
+//so a single linear sweep updates the whole tree
+struct TransformHierarchy
+{
+	std::vector<Transform> local;
+	std::vector<int32_t> parent;
+	std::vector<mat4x4> localMatrix;
+	std::vector<mat4x4> worldMatrix;
+	std::vector<uint8_t> dirty;//!<local transform changed since the last update
+	std::vector<uint8_t> worldChanged;//!<world matrix was recomputed by the last update
+	std::vector<uint32_t> changedNodes;
+};
+
+uint32_t addTransformNode(TransformHierarchy* hierarchy, int32_t parent, const Transform& local);
+
+void setLocalTransform(TransformHierarchy* hierarchy, uint32_t node, const Transform& local);
+
+//recomputes world matrices of dirty nodes and everything below them, fills changedNodes
+void updateTransformHierarchy(TransformHierarchy* hierarchy);
+
+inline const mat4x4& getWorldTransform(const TransformHierarchy& hierarchy, uint32_t node)
+{
+	return hierarchy.worldMatrix[node];
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include "input.h"
+#ifdef SOFTY_WITH_SDL
 #include <SDL2/SDL.h>
+#endif
 #include <bitset>
+#include <atomic>
 
 //actual key states
 static std::bitset<BTN_COUNT> keysState;
@@ -9,6 +12,9 @@ static std::bitset<MBTN_COUNT> mouseState;
 static int mouseWheelVSign = 0;
 static int mouseWheelHSign = 0;
 
+//set by the event pump, cleared by the presenting thread
+static std::atomic<bool> exposed(false);
+
 
 void flushInputStates()
 {
@@ -21,6 +27,8 @@ void pollEvents()
 	mouseWheelHSign = 0;
 	mouseWheelVSign = 0;
 
+	//offscreen only builds have no input, every key stays released
+#ifdef SOFTY_WITH_SDL
 	SDL_Event event;
 	while(SDL_PollEvent(&event)) {
 
@@ -128,10 +136,15 @@ void pollEvents()
 				mouseWheelHSign = event.wheel.x;
 				mouseWheelVSign = event.wheel.y;
 				break;
+			case SDL_WINDOWEVENT :
+				if(event.window.event == SDL_WINDOWEVENT_EXPOSED)
+					exposed = true;
+				break;
 			default :
 				break;
 		}
 	}
+#endif
 }
 
 bool isKeyPressed(KeyCode key)
@@ -154,6 +167,11 @@ bool isMouseBtnPressed(MouseCode code)
 	return mouseState[code];
 }
 
+bool windowExposed()
+{
+	return exposed.exchange(false);
+}
+
 /*There is a strange bug in sdl resulting in large
 * mouse movements at the program startup
 * when we lock mouse to the creen center.
@@ -165,7 +183,9 @@ Vec2 getDeltaMousePosition()
 	Vec2 out = {};
 	int x = 0;
 	int y = 0;    
+#ifdef SOFTY_WITH_SDL
 	SDL_GetRelativeMouseState(&x, &y);
+#endif
 	if(ignoreFirstMouseMove) {
 		x = 0;
 		y = 0;
@@ -178,10 +198,13 @@ Vec2 getDeltaMousePosition()
 
 Vec2 getMousePosition()
 {
-	int x, y;
+	int x = 0;
+	int y = 0;
 	Vec2 position = {};
 
+#ifdef SOFTY_WITH_SDL
 	SDL_GetMouseState(&x, &y);
+#endif
 	position.x = (float)x;
 	position.y = (float)y;
 	
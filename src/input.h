@@ -107,4 +107,7 @@ bool isMouseWheelScrolledDown();
 Vec2 getMousePosition();
 Vec2 getDeltaMousePosition();
 
+//true once after the window was uncovered, its contents have to be presented in full again
+bool windowExposed();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "jobs.h"
+#include "maths.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+struct Job
+{
+	std::function<void()> function;
+	std::atomic<int32_t> pendingDependencies;//!<unfinished dependencies, +1 until the job is submitted
+	std::atomic<int32_t> refs;//!<one for the creator and one for the scheduler
+	std::atomic<bool> finished;
+	std::mutex lock;//!<guards dependents against the job finishing while they're added
+	std::vector<Job*> dependents;
+	bool frameScoped;
+};
+
+//owner pushes and pops at the back, thieves take from the front
+struct JobQueue
+{
+	std::mutex lock;
+	std::deque<Job*> jobs;
+};
+
+struct JobSystem
+{
+	std::vector<std::thread> workers;
+	JobQueue* queues;//!<queue 0 is shared by every thread that isn't a worker
+	uint32_t numQueues;
+
+	std::atomic<int32_t> queuedJobs;
+	std::atomic<int32_t> frameActiveJobs;
+	std::atomic<int32_t> numSleeping;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	bool quit;
+
+	std::mutex poolLock;
+	std::vector<Job*> freeJobs;
+	std::vector<Job*> frameJobs;
+};
+
+static thread_local const JobSystem* workerOwner = nullptr;
+static thread_local uint32_t workerQueue = 0;
+
+static uint32_t currentQueue(const JobSystem* jobs)
+{
+	return workerOwner == jobs ? workerQueue : 0;
+}
+
+static Job* allocJob(JobSystem* jobs, std::function<void()>&& function, bool frameScoped)
+{
+	Job* job = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(jobs->poolLock);
+		if(!jobs->freeJobs.empty()) {
+			job = jobs->freeJobs.back();
+			jobs->freeJobs.pop_back();
+		}
+	}
+	if(!job)
+		job = new Job();
+
+	job->function = std::move(function);
+	job->pendingDependencies = 1;
+	job->refs = 2;
+	job->finished = false;
+	job->frameScoped = frameScoped;
+
+	if(frameScoped) {
+		jobs->frameActiveJobs++;
+		std::lock_guard<std::mutex> guard(jobs->poolLock);
+		jobs->frameJobs.push_back(job);
+	}
+	return job;
+}
+
+static void releaseJob(JobSystem* jobs, Job* job)
+{
+	if(--job->refs > 0)
+		return;
+	job->function = nullptr;
+	std::lock_guard<std::mutex> guard(jobs->poolLock);
+	jobs->freeJobs.push_back(job);
+}
+
+static void enqueueJob(JobSystem* jobs, Job* job)
+{
+	JobQueue& queue = jobs->queues[currentQueue(jobs)];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.jobs.push_back(job);
+	}
+	jobs->queuedJobs++;
+
+	//sleeping workers check queuedJobs under sleepLock so taking it here can't miss one going to sleep
+	if(jobs->numSleeping > 0) {
+		{
+			std::lock_guard<std::mutex> guard(jobs->sleepLock);
+		}
+		jobs->wake.notify_one();
+	}
+}
+
+static void runJob(JobSystem* jobs, Job* job)
+{
+	job->function();
+
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> guard(job->lock);
+		job->finished = true;
+		ready.swap(job->dependents);
+	}
+	for(Job* dependent : ready) {
+		if(--dependent->pendingDependencies == 0)
+			enqueueJob(jobs, dependent);
+	}
+
+	if(job->frameScoped)
+		jobs->frameActiveJobs--;
+	releaseJob(jobs, job);
+}
+
+static bool tryRunJob(JobSystem* jobs)
+{
+	uint32_t own = currentQueue(jobs);
+	Job* job = nullptr;
+	{
+		JobQueue& queue = jobs->queues[own];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if(!queue.jobs.empty()) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}
+	}
+
+	for(uint32_t i = 1; !job && i < jobs->numQueues; i++) {
+		JobQueue& victim = jobs->queues[(own + i) % jobs->numQueues];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if(!victim.jobs.empty()) {
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+		}
+	}
+
+	if(!job)
+		return false;
+	jobs->queuedJobs--;
+	runJob(jobs, job);
+	return true;
+}
+
+static void workerMain(JobSystem* jobs, uint32_t queue)
+{
+	workerOwner = jobs;
+	workerQueue = queue;
+
+	for(;;) {
+		if(tryRunJob(jobs))
+			continue;
+
+		std::unique_lock<std::mutex> guard(jobs->sleepLock);
+		jobs->numSleeping++;
+		jobs->wake.wait(guard, [jobs]() { return jobs->quit || jobs->queuedJobs > 0; });
+		jobs->numSleeping--;
+		if(jobs->quit)
+			return;
+	}
+}
+
+static void pinThread(std::thread& thread, uint32_t cpu)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#elif defined(_WIN32)
+	SetThreadAffinityMask((HANDLE)thread.native_handle(), (DWORD_PTR)1 << cpu);
+#else
+	(void)thread;
+	(void)cpu;
+#endif
+}
+
+JobSystem* createJobSystem(const JobSystemConfig& config)
+{
+	uint32_t numCpus = max(std::thread::hardware_concurrency(), 1u);
+	uint32_t numThreads = config.numThreads ? config.numThreads : numCpus;
+
+	JobSystem* jobs = new JobSystem();
+	jobs->numQueues = numThreads;
+	jobs->queues = new JobQueue[numThreads];
+	jobs->queuedJobs = 0;
+	jobs->frameActiveJobs = 0;
+	jobs->numSleeping = 0;
+	jobs->quit = false;
+
+	for(uint32_t i = 1; i < numThreads; i++) {
+		jobs->workers.emplace_back(workerMain, jobs, i);
+		if(config.pinThreads)
+			pinThread(jobs->workers.back(), (config.firstCpu + i) % numCpus);
+	}
+	return jobs;
+}
+
+void destroyJobSystem(JobSystem* jobs)
+{
+	waitForFrameJobs(jobs);
+	{
+		std::lock_guard<std::mutex> guard(jobs->sleepLock);
+		jobs->quit = true;
+	}
+	jobs->wake.notify_all();
+	for(std::thread& worker : jobs->workers)
+		worker.join();
+
+	for(Job* job : jobs->freeJobs)
+		delete job;
+	delete[] jobs->queues;
+	delete jobs;
+}
+
+uint32_t jobThreadCount(const JobSystem* jobs)
+{
+	return jobs ? jobs->numQueues : 1;
+}
+
+JobHandle createJob(JobSystem* jobs, std::function<void()> function)
+{
+	return allocJob(jobs, std::move(function), true);
+}
+
+void addJobDependency(JobSystem* jobs, JobHandle job, JobHandle dependency)
+{
+	(void)jobs;
+	std::lock_guard<std::mutex> guard(dependency->lock);
+	if(dependency->finished)
+		return;
+	job->pendingDependencies++;
+	dependency->dependents.push_back(job);
+}
+
+void submitJob(JobSystem* jobs, JobHandle job)
+{
+	if(--job->pendingDependencies == 0)
+		enqueueJob(jobs, job);
+}
+
+void waitForJob(JobSystem* jobs, JobHandle job)
+{
+	while(!job->finished) {
+		if(!tryRunJob(jobs))
+			std::this_thread::yield();
+	}
+}
+
+void waitForFrameJobs(JobSystem* jobs)
+{
+	while(jobs->frameActiveJobs > 0) {
+		if(!tryRunJob(jobs))
+			std::this_thread::yield();
+	}
+
+	std::vector<Job*> finished;
+	{
+		std::lock_guard<std::mutex> guard(jobs->poolLock);
+		finished.swap(jobs->frameJobs);
+	}
+	for(Job* job : finished)
+		releaseJob(jobs, job);
+}
+
+void parallelFor(JobSystem* jobs, uint32_t count, uint32_t minChunk, const std::function<void(uint32_t, uint32_t)>& function)
+{
+	if(!count)
+		return;
+
+	//a few chunks per thread so stealing can even out uneven ones
+	uint32_t numThreads = jobThreadCount(jobs);
+	uint32_t chunk = max((count + numThreads * 4 - 1) / (numThreads * 4), max(minChunk, 1u));
+	if(numThreads == 1 || chunk >= count) {
+		function(0, count);
+		return;
+	}
+
+	std::vector<Job*> chunks;
+	for(uint32_t first = chunk; first < count; first += chunk) {
+		uint32_t end = min(first + chunk, count);
+		Job* job = allocJob(jobs, [&function, first, end]() { function(first, end); }, false);
+		chunks.push_back(job);
+		submitJob(jobs, job);
+	}
+
+	//calling thread takes the first chunk itself
+	function(0, chunk);
+	for(Job* job : chunks) {
+		waitForJob(jobs, job);
+		releaseJob(jobs, job);
+	}
+}
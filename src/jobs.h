@@ -0,0 +1,45 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <cstdint>
+#include <functional>
+
+struct JobSystem;
+struct Job;
+
+typedef Job* JobHandle;
+
+struct JobSystemConfig
+{
+	uint32_t numThreads;//!<threads executing jobs including the one that waits on them, 0 uses every hardware thread
+	bool pinThreads;//!<pin worker i to cpu (firstCpu + i) % numCpus, the calling thread is left alone
+	uint32_t firstCpu;
+};
+
+JobSystem* createJobSystem(const JobSystemConfig& config);
+
+//waits for outstanding jobs before joining the workers
+void destroyJobSystem(JobSystem* jobs);
+
+//1 for a null job system, everything then runs inline
+uint32_t jobThreadCount(const JobSystem* jobs);
+
+//the job doesn't run until it's submitted so dependencies can be added in between
+JobHandle createJob(JobSystem* jobs, std::function<void()> function);
+
+//job won't start before dependency has finished
+void addJobDependency(JobSystem* jobs, JobHandle job, JobHandle dependency);
+
+void submitJob(JobSystem* jobs, JobHandle job);
+
+//executes other jobs on the calling thread until job is done
+void waitForJob(JobSystem* jobs, JobHandle job);
+
+//waits for every job created since the previous call, handles returned by createJob are invalid afterwards
+void waitForFrameJobs(JobSystem* jobs);
+
+//splits [0, count) into chunks of at least minChunk indices and calls function(first, end) for each of them in parallel,
+//returns once all chunks are done. Safe to nest
+void parallelFor(JobSystem* jobs, uint32_t count, uint32_t minChunk, const std::function<void(uint32_t, uint32_t)>& function);
+
+#endif
@@ -501,6 +501,17 @@ inline mat4x4 frustum(float left, float right, float bottom, float top, float ne
 	};
 }
 
+//parallel projection, e.g. for directional light shadow maps
+inline mat4x4 orthographicProjection(float left, float right, float bottom, float top, float near, float far)
+{
+	return mat4x4 {
+		2.f/(right - left),           0,                            0,                          0,
+		0,                            2.f/(top - bottom),           0,                          0,
+		0,                            0,                            -2.f/(far - near),          0,
+		-(right+left)/(right-left),   -(top+bottom)/(top-bottom),   -(far+near)/(far-near),     1.f
+	};
+}
+
 inline mat4x4 perspectiveProjection(float FOV, float aspect, float near, float far)
 {
 	float h;
@@ -783,6 +794,56 @@ inline Vec4 lerp(const Vec4& start, const Vec4& end, float amount)
 	};
 }
 
+//axis aligned bounding box
+struct AABB
+{
+	Vec3 min;
+	Vec3 max;
+};
+
+inline Vec3 minVec3(const Vec3& left, const Vec3& right)
+{
+	return Vec3{min(left.x, right.x), min(left.y, right.y), min(left.z, right.z)};
+}
+
+inline Vec3 maxVec3(const Vec3& left, const Vec3& right)
+{
+	return Vec3{max(left.x, right.x), max(left.y, right.y), max(left.z, right.z)};
+}
+
+inline AABB emptyAABB()
+{
+	return AABB {
+		Vec3{ 3.402823e+38f,  3.402823e+38f,  3.402823e+38f},
+		Vec3{-3.402823e+38f, -3.402823e+38f, -3.402823e+38f}
+	};
+}
+
+inline AABB unionAABB(const AABB& left, const AABB& right)
+{
+	return AABB{minVec3(left.min, right.min), maxVec3(left.max, right.max)};
+}
+
+inline Vec3 centerAABB(const AABB& box)
+{
+	return (box.min + box.max) * 0.5f;
+}
+
+//transforms box by an affine matrix(Arvo's method)
+inline AABB transformAABB(const AABB& box, const mat4x4& transform)
+{
+	AABB out = {transform.rows[3].xyz, transform.rows[3].xyz};
+	for(uint8_t i = 0; i < 3; i++) {
+		for(uint8_t j = 0; j < 3; j++) {
+			float a = transform.p[i * 4 + j] * box.min[i];
+			float b = transform.p[i * 4 + j] * box.max[i];
+			out.min[j] += min(a, b);
+			out.max[j] += max(a, b);
+		}
+	}
+	return out;
+}
+
 //For unit quaternions conjugate and inverse are identical 
 //since magnitude of rotation quat is 1. (q^-1 = q*/||q||)
 //for pure rotation quats conjugate quat rotates in the 
@@ -893,9 +954,31 @@ inline mat4x4 quatToRotationMat(const Quat& quat)
 	out.p[4] = 2 * xy - 2 * wz;
 	out.p[6] = 2 * yz + 2 * wx;
 	out.p[8] = 2 * xz + 2 * wy;
-	out.p[9] = 2 * yz - 2 * wz;
+	out.p[9] = 2 * yz - 2 * wx;
 
 	return out;
 }
 
+//same as loadScale(scale) * quatToRotationMat(rotation) * loadTranslation(translate) without the matrix products
+inline mat4x4 composeTransform(const Vec3& scale, const Quat& rotation, const Vec3& translate)
+{
+	mat4x4 out = quatToRotationMat(rotation);
+	out.rows[0] *= scale.x;
+	out.rows[1] *= scale.y;
+	out.rows[2] *= scale.z;
+	out.rows[3] = Vec4{translate.x, translate.y, translate.z, 1.f};
+	return out;
+}
+
+//product of two matrices with {0, 0, 0, 1} last column
+inline mat4x4 mulAffine(const mat4x4& left, const mat4x4& right)
+{
+	mat4x4 out = {};
+	for(uint8_t i = 0; i < 4; i++) {
+		out.rows[i] = right.rows[0] * left.rows[i].x + right.rows[1] * left.rows[i].y + right.rows[2] * left.rows[i].z;
+	}
+	out.rows[3] += right.rows[3];
+	return out;
+}
+
 #endif
\ No newline at end of file
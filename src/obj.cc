@@ -352,4 +352,14 @@ void fillTangent(Mesh* mesh)
 	for(uint32_t i = 0 ; i < mesh->tangents.size(); i++) {
 		printf("Tangent vector %f %f %f\n",mesh->tangents[i].x,mesh->tangents[i].y,mesh->tangents[i].z);
 	}
-}
\ No newline at end of file
+}
+
+AABB computeMeshBounds(const Mesh& mesh)
+{
+	AABB bounds = emptyAABB();
+	for(uint32_t i = 0; i < mesh.vertPos.size(); i++) {
+		bounds.min = minVec3(bounds.min, mesh.vertPos[i]);
+		bounds.max = maxVec3(bounds.max, mesh.vertPos[i]);
+	}
+	return bounds;
+}
@@ -23,6 +23,13 @@ enum MeshFeatureFlags
 	FEATURE_TANGENTS = 1 << 3
 };
 
+//simplified index buffer sharing vertex attributes of the original mesh
+struct MeshLod
+{
+	std::vector<Face> faces;
+	float error;//!<object space deviation from the original surface
+};
+
 struct Mesh
 {
 	std::vector<Face> faces;
@@ -30,6 +37,8 @@ struct Mesh
 	std::vector<Vec3> normals;
 	std::vector<Vec3> texCoord;
 	std::vector<Vec3> tangents;
+	std::vector<MeshLod> lods;//!<coarser levels ordered by increasing error, see buildLodChain
+	AABB bounds;
 	int meshFeatureMask;
 };
 
@@ -39,4 +48,10 @@ void averageNormals(Mesh* mesh);
 
 void fillTangent(Mesh* mesh);
 
+AABB computeMeshBounds(const Mesh& mesh);
+
+//quadric error edge collapse, call after normals and tangents are generated
+//so that uv/normal seams are known. Each level halves the face count of the previous one
+void buildLodChain(Mesh* mesh, uint32_t maxLevels = 8, uint32_t minFaces = 32);
+
 #endif
\ No newline at end of file
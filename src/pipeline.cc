@@ -0,0 +1,239 @@
+#include "pipeline.h"
+#include "rasterizer.h"
+#include "checkerboard.h"
+#include "input.h"
+
+static bool createSlotSurfaces(RenderContext* context, FramePipeline* pipeline)
+{
+	for(FrameSlot& slot : pipeline->slots) {
+		if(!reservePoolMemory(context->targetPool, &slot.surface.pixels, context->window.width * context->window.height * sizeof(uint32_t))) {
+			printf("Failed to allocate frame surface memory\n");
+			return false;
+		}
+		slot.surface.width = context->window.width;
+		slot.surface.height = context->window.height;
+		slot.surface.pitch = context->window.width * sizeof(uint32_t);
+		slot.surface.format = context->surface.format;
+	}
+
+	pipeline->bandHeight = rasterBandHeight(context, pipeline->numBands);
+	return true;
+}
+
+static void releaseDraws(FrameSlot& slot)
+{
+	for(RecordedDraw& draw : slot.draws)
+		delete draw.shader;
+	slot.draws.clear();
+}
+
+static void rasterizeBand(RenderContext* context, FrameSlot& frame, uint32_t band, const ScissorRect& scissor)
+{
+	//bands share the recorded snapshots, per triangle state stays in the band's varying block
+	VaryingBlock varyings;
+	for(uint32_t triangleIdx : frame.bands[band]) {
+		const RecordedTriangle& recorded = frame.triangles[triangleIdx];
+		const RecordedDraw& draw = frame.draws[recorded.draw];
+		varyings.lightIntensity = recorded.lightIntensity;
+		varyings.centerView = recorded.centerView;
+		dispatchShader(context, *draw.shader, [&](const auto& typedShader) {
+			drawShadedTriangle(context, recorded.triangle, typedShader, varyings, frame.msaa, scissor);
+		});
+	}
+}
+
+static void rasterizeFrame(FramePipeline* pipeline, FrameSlot& frame)
+{
+	//bands draw through a context built from the frame's snapshot only, never from the one the application is recording with
+	Checkerboard checkerboard = {};
+	checkerboard.active = frame.checkerboardParity >= 0;
+	checkerboard.parity = frame.checkerboardParity >= 0 ? frame.checkerboardParity : 0;
+	RenderContext target = {};
+	target.window.width = frame.surface.width;
+	target.window.height = frame.surface.height;
+	target.rtargets = frame.targets;
+	target.surface = frame.surface;
+	target.virtualShaders = frame.virtualShaders;
+	target.jobs = pipeline->jobs;
+	target.gbuffer = frame.gbuffer;
+	target.checkerboard = &checkerboard;
+	target.quality = frame.quality;
+	target.frameMsaa = frame.msaa;
+	target.shadingRateImage = frame.shadingRateImage;
+	target.viewportTransform = frame.viewportTransform;
+
+	//depth and msaa targets are only touched by the raster thread while the pipeline is running
+	clearRenderTargets(&target.rtargets, frame.clearColor);
+	parallelFor(target.jobs, pipeline->numBands, 1, [&](uint32_t first, uint32_t end) {
+		for(uint32_t band = first; band < end; band++)
+			rasterizeBand(&target, frame, band, rasterBandRect(&target, band, pipeline->numBands));
+	});
+	if(frame.gbuffer)
+		shadeGBuffer(target.jobs, *frame.gbuffer, frame.deferredFrame, target.rtargets, frame.surface);
+	resolveClearedTiles(target.jobs, &target.rtargets, frame.surface);
+}
+
+static void rasterThreadMain(FramePipeline* pipeline)
+{
+	for(;;) {
+		uint32_t slotIdx = 0;
+		{
+			std::unique_lock<std::mutex> guard(pipeline->lock);
+			pipeline->wakeRaster.wait(guard, [pipeline]() { return pipeline->quit || !pipeline->rasterQueue.empty(); });
+			if(pipeline->rasterQueue.empty())
+				return;
+			slotIdx = pipeline->rasterQueue.front();
+			pipeline->rasterQueue.pop_front();
+		}
+
+		rasterizeFrame(pipeline, pipeline->slots[slotIdx]);
+
+		std::lock_guard<std::mutex> guard(pipeline->lock);
+		pipeline->slots[slotIdx].state = FRAME_RASTERIZED;
+		pipeline->frameDone.notify_all();
+	}
+}
+
+static void presentOldestFrame(RenderContext* context, FramePipeline* pipeline)
+{
+	FrameSlot& frame = pipeline->slots[pipeline->oldestInFlight];
+	{
+		std::unique_lock<std::mutex> guard(pipeline->lock);
+		pipeline->frameDone.wait(guard, [&frame]() { return frame.state == FRAME_RASTERIZED; });
+	}
+
+	presentPixels(context, frame.surface);
+
+	frame.state = FRAME_FREE;
+	pipeline->oldestInFlight = (pipeline->oldestInFlight + 1) % pipeline->slots.size();
+	pipeline->numInFlight--;
+}
+
+FramePipeline* createFramePipeline(RenderContext* context, uint32_t framesInFlight)
+{
+	FramePipeline* pipeline = new FramePipeline();
+	pipeline->framesInFlight = framesInFlight;
+	pipeline->numBands = rasterBandCount(context);
+	pipeline->jobs = context->jobs;
+	pipeline->slots.resize(framesInFlight + 1);
+	for(FrameSlot& slot : pipeline->slots) {
+		slot.surface = {};
+		slot.state = FRAME_FREE;
+		slot.bands.resize(pipeline->numBands);
+	}
+
+	if(!createSlotSurfaces(context, pipeline)) {
+		for(FrameSlot& slot : pipeline->slots)
+			releasePoolMemory(context->targetPool, slot.surface.pixels);
+		delete pipeline;
+		return NULL;
+	}
+
+	pipeline->rasterThread = std::thread(rasterThreadMain, pipeline);
+	return pipeline;
+}
+
+void drainFramePipeline(RenderContext* context)
+{
+	FramePipeline* pipeline = context->pipeline;
+	while(pipeline->numInFlight)
+		presentOldestFrame(context, pipeline);
+}
+
+void destroyFramePipeline(RenderContext* context)
+{
+	FramePipeline* pipeline = context->pipeline;
+	drainFramePipeline(context);
+	{
+		std::lock_guard<std::mutex> guard(pipeline->lock);
+		pipeline->quit = true;
+		pipeline->wakeRaster.notify_all();
+	}
+	pipeline->rasterThread.join();
+
+	for(FrameSlot& slot : pipeline->slots) {
+		releaseDraws(slot);
+		releasePoolMemory(context->targetPool, slot.surface.pixels);
+	}
+	delete pipeline;
+	context->pipeline = NULL;
+}
+
+bool pipelineBeginFrame(RenderContext* context)
+{
+	FramePipeline* pipeline = context->pipeline;
+	FrameSlot& frame = pipeline->slots[pipeline->recording];
+	assert(frame.state == FRAME_FREE);
+
+	if(frame.surface.width != context->window.width || frame.surface.height != context->window.height) {
+		if(!createSlotSurfaces(context, pipeline))
+			return false;
+	}
+
+	releaseDraws(frame);
+	frame.triangles.clear();
+	for(std::vector<uint32_t>& band : frame.bands)
+		band.clear();
+	frame.clearColor = context->clearColor;
+	frame.msaa = msaaEnabled(context);
+	frame.state = FRAME_RECORDING;
+	return true;
+}
+
+bool pipelineRecordDraw(RenderContext* context, const Shader& shader, uint32_t* draw)
+{
+	FrameSlot& frame = context->pipeline->slots[context->pipeline->recording];
+	RecordedDraw recorded = {shader.clone()};
+	if(!recorded.shader)
+		return false;
+	frame.draws.push_back(recorded);
+	*draw = frame.draws.size() - 1;
+	return true;
+}
+
+void pipelineRecordTriangle(RenderContext* context, uint32_t draw, const Triangle& triangle,
+	float lightIntensity, const Vec3& centerView, const mat4x4& VP)
+{
+	FramePipeline* pipeline = context->pipeline;
+	FrameSlot& frame = pipeline->slots[pipeline->recording];
+
+	//bin by screen rows
+	int botY = 0;
+	int topY = 0;
+	if(!triangleScreenRows(context, triangle, VP, &botY, &topY))
+		return;
+	uint32_t firstBand = botY / pipeline->bandHeight;
+	uint32_t lastBand = min((uint32_t)(topY / pipeline->bandHeight), pipeline->numBands - 1);
+
+	uint32_t triangleIdx = frame.triangles.size();
+	frame.triangles.push_back(RecordedTriangle{triangle, centerView, lightIntensity, draw});
+	for(uint32_t band = firstBand; band <= lastBand; band++)
+		frame.bands[band].push_back(triangleIdx);
+}
+
+void pipelineEndFrame(RenderContext* context)
+{
+	FramePipeline* pipeline = context->pipeline;
+	FrameSlot& frame = pipeline->slots[pipeline->recording];
+	frame.targets = context->rtargets;
+	frame.gbuffer = context->gbuffer;
+	if(context->gbuffer)
+		frame.deferredFrame = context->gbuffer->recording;
+	frame.viewportTransform = context->viewportTransform;
+	frame.shadingRateImage = context->shadingRateImage;
+	frame.quality = context->quality;
+	frame.checkerboardParity = checkerboardParity(context);
+	frame.virtualShaders = context->virtualShaders;
+	{
+		std::lock_guard<std::mutex> guard(pipeline->lock);
+		frame.state = FRAME_SUBMITTED;
+		pipeline->rasterQueue.push_back(pipeline->recording);
+		pipeline->wakeRaster.notify_one();
+	}
+	pipeline->numInFlight++;
+	pipeline->recording = (pipeline->recording + 1) % pipeline->slots.size();
+
+	//throttle the application once it gets too far ahead of the rasterizer
+	while(pipeline->numInFlight > pipeline->framesInFlight)
+		presentOldestFrame(context, pipeline);
+}
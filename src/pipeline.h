@@ -0,0 +1,92 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "renderer.h"
+#include "deferred.h"
+
+//draw call recorded in pipelined mode, shader is a snapshot taken when the draw was issued
+struct RecordedDraw
+{
+	Shader* shader;
+};
+
+struct RecordedTriangle
+{
+	Triangle triangle;//!<world space, vertex shader runs on the raster side
+	Vec3 centerView;
+	float lightIntensity;
+	uint32_t draw;
+};
+
+enum FrameSlotState
+{
+	FRAME_FREE,
+	FRAME_RECORDING,
+	FRAME_SUBMITTED,
+	FRAME_RASTERIZED
+};
+
+struct FrameSlot
+{
+	PixelBuffer surface;//!<color target the frame is rasterized into before presentation, memory comes from the context target pool
+	std::vector<RecordedDraw> draws;
+	std::vector<RecordedTriangle> triangles;
+	std::vector<std::vector<uint32_t>> bands;//!<indices of triangles touching each horizontal band
+	Vec4 clearColor;
+	bool msaa;
+	//render state the raster thread draws the frame with, taken when the frame is submitted since the application
+	//keeps changing its context(dynamic resolution, adaptive quality, the next frame's settings) while the frame rasterizes
+	RenderTargets targets;
+	GBuffer* gbuffer;//!<set when the frame was recorded in deferred mode
+	mat4x4 viewportTransform;
+	const uint8_t* shadingRateImage;
+	QualityLevel quality;
+	int checkerboardParity;
+	bool virtualShaders;
+	DeferredFrame deferredFrame;//!<materials the lighting pass uses when the frame was recorded in deferred mode
+	FrameSlotState state;
+};
+
+struct FramePipeline
+{
+	std::vector<FrameSlot> slots;
+	uint32_t framesInFlight;
+	uint32_t recording;//!<slot the application is recording into
+	uint32_t oldestInFlight;
+	uint32_t numInFlight;
+	uint32_t numBands;
+	int bandHeight;
+	JobSystem* jobs;//!<the context's, band jobs of the raster thread run on it
+
+	std::deque<uint32_t> rasterQueue;
+	std::mutex lock;
+	std::condition_variable wakeRaster;
+	std::condition_variable frameDone;
+	std::thread rasterThread;
+	bool quit;
+};
+
+FramePipeline* createFramePipeline(RenderContext* context, uint32_t framesInFlight);
+
+void destroyFramePipeline(RenderContext* context);
+
+//presents every frame in flight, after it returns render targets may be reallocated
+void drainFramePipeline(RenderContext* context);
+
+//false when the frame surfaces couldn't be reallocated for a new window size, the pipeline has to be destroyed then
+bool pipelineBeginFrame(RenderContext* context);
+
+//false when the shader can't be snapshotted(no Shader::clone), nothing is recorded then
+bool pipelineRecordDraw(RenderContext* context, const Shader& shader, uint32_t* draw);
+
+void pipelineRecordTriangle(RenderContext* context, uint32_t draw, const Triangle& triangle,
+	float lightIntensity, const Vec3& centerView, const mat4x4& VP);
+
+void pipelineEndFrame(RenderContext* context);
+
+#endif
@@ -1,23 +1,21 @@
-#include "primitives.h"
+#include "rasterizer.h"
 
 #include <cassert>
+#include <limits>
 #include "clipper.h"
+#include "deferred.h"
+#include "visibility.h"
 
 
-void drawPixel(const SDL_Surface* surface, int x, int y, Vec3 color)
+void drawPixel(const PixelBuffer& surface, int x, int y, Vec3 color)
 {
-	assert(x < surface->w && y < surface->h);
+	assert(x < surface.width && y < surface.height);
 	assert(x >= 0 && y >= 0);
 
-	uint32_t* pixelPtr = (uint32_t*)surface->pixels;
-
-	pixelPtr += surface->w * (surface->h - 1); 
-	
-	pixelPtr += x - surface->w * y;
-	*pixelPtr = SDL_MapRGBA(surface->format, color.R, color.G, color.B, 255.f);
+	pixelRow(surface, y)[x] = packPixel(surface.format, Vec4{color.R, color.G, color.B, 255.f});
 }
 
-void drawLine(const SDL_Surface* surface, int x0, int y0, int x1, int y1, Vec3 color)
+void drawLine(const PixelBuffer& surface, int x0, int y0, int x1, int y1, Vec3 color)
 {
 	bool steep = false;
 	if(std::abs(x1 - x0) < std::abs(y1 - y0)) {
@@ -51,35 +49,19 @@ void drawLine(const SDL_Surface* surface, int x0, int y0, int x1, int y1, Vec3 c
 	}
 }
 
-void drawWireFrame(const SDL_Surface* surface, Vec4 v0, Vec4 v1, Vec4 v2, Vec3 color)
+void drawWireFrame(const RenderContext* context, Vec4 v0, Vec4 v1, Vec4 v2, Vec3 color)
 {
-	v0 = perspectiveDivide(v0) * viewportTransform;
-	v1 = perspectiveDivide(v1) * viewportTransform;
-	v2 = perspectiveDivide(v2) * viewportTransform;
+	const PixelBuffer& surface = context->surface;
+	v0 = perspectiveDivide(v0) * context->viewportTransform;
+	v1 = perspectiveDivide(v1) * context->viewportTransform;
+	v2 = perspectiveDivide(v2) * context->viewportTransform;
 
 	drawLine(surface, v0.x, v0.y, v1.x, v1.y, color);
 	drawLine(surface, v1.x, v1.y, v2.x, v2.y, color);
 	drawLine(surface, v2.x, v2.y, v0.x, v0.y, color);
 }
 
-struct SampleRastInfo
-{
-	float w0StartRow;
-	float w1StartRow;
-	float w2StartRow;
-	int FA01;
-	int FB01;
-	int FA12;
-	int FB12;
-	int FA20;
-	int FB20;
-	int topY;
-	int leftX;
-	int botY;
-	int rightX;
-};
-
-SampleRastInfo prepareSample(RenderContext* context, Vec3 v0, Vec3 v1, Vec3 v2, int sX, int sY)
+SampleRastInfo prepareSample(const ScissorRect& scissor, Vec3 v0, Vec3 v1, Vec3 v2, int sX, int sY)
 {
 	SampleRastInfo info = {};
 	//printf("%d %d\n",sX,sY);
@@ -92,10 +74,10 @@ SampleRastInfo prepareSample(RenderContext* context, Vec3 v0, Vec3 v1, Vec3 v2,
 	int y2 = std::floor(16.f * v2.y + 0.5f);// + sY;
 
 	//compute triangle bounding box
-	int topY   = min((int)((max(max(y0, y1), y2))/16.f), context->window.height - 1);
-	int leftX  = max((int)((min(min(x0, x1), x2))/16.f), 0);
-	int botY   = max((int)((min(min(y0, y1), y2))/16.f), 0);
-	int rightX = min((int)((max(max(x0, x1), x2))/16.f), context->window.width - 1);
+	int topY   = min((int)((max(max(y0, y1), y2))/16.f), scissor.maxY);
+	int leftX  = max((int)((min(min(x0, x1), x2))/16.f), scissor.minX);
+	int botY   = max((int)((min(min(y0, y1), y2))/16.f), scissor.minY);
+	int rightX = min((int)((max(max(x0, x1), x2))/16.f), scissor.maxX);
 	
 	//calculate row and column step in barycentric coordinates
 	int A01 = y0 - y1;
@@ -148,239 +130,265 @@ SampleRastInfo prepareSample(RenderContext* context, Vec3 v0, Vec3 v1, Vec3 v2,
 	return info;
 }
 
-void drawTriangleHalfSpace(RenderContext* context, Vertex v0, Vertex v1, Vertex v2, Shader& shader)
+//first touch of a lazily cleared tile resets its depth and pixels, tiles never cross raster bands so no locking is needed
+void touchTiles(RenderContext* context, int leftX, int botY, int rightX, int topY, int stride)
 {
-	float* zBuffer = context->rtargets.zBuffer;
-	SDL_Surface* surface = context->surface;
-	   
-	//preserve depth of a polygon via keeping its z coordinate in clip-space
-	float z0Inv = 1.f / (float)v0.pos.w;
-	float z1Inv = 1.f / (float)v1.pos.w;
-	float z2Inv = 1.f / (float)v2.pos.w;
-	
-	v0.pos = perspectiveDivide(v0.pos) * viewportTransform;
-	v1.pos = perspectiveDivide(v1.pos) * viewportTransform;
-	v2.pos = perspectiveDivide(v2.pos) * viewportTransform;
-
-	const float triArea = computeArea(v0.pos.xyz, v1.pos.xyz, v2.pos.xyz);
-	if(triArea < 0)
-		return;
-	shader.prepareInterpolants(v0, v1, v2, z0Inv, z1Inv, z2Inv, triArea);
-
-	float Z1Z0Inv = (z1Inv - z0Inv) / triArea;
-	float Z2Z0Inv = (z2Inv - z0Inv) / triArea;
-
-	SampleRastInfo s = prepareSample(context, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, 0, 0);
-
-	bool discardFragment = false;
-	for(int y = s.topY; y > s.botY; y--) {
-
-		int w0 = s.w0StartRow;
-		int w1 = s.w1StartRow;
-		int w2 = s.w2StartRow;
-
-		for(int x = s.leftX; x <= s.rightX; x++) {
-			
-			if(w0>0 && w1>0 && w2>0) {
-				float Z = z0Inv + (w1/256.f) * Z1Z0Inv + (w2/256.f) * Z2Z0Inv;
-				Z = 1.f / Z;
-				if( Z < zBuffer[y * surface->w + x]) {
-					zBuffer[y * surface->w + x] = Z;
-					Vec3 gl_pixelCoord = {w1/256.f, w2/256.f, Z};
-					discardFragment = false;
-					Vec3 finalColor = shader.fragmentShader(gl_pixelCoord, discardFragment);
-					if(!discardFragment)
-						drawPixel(surface, x, y, finalColor);
+	RenderTargets& targets = context->rtargets;
+	const PixelBuffer& surface = context->surface;
+	const Vec4& color = targets.clearColor;
+
+	for(int ty = botY / RENDER_TILE_SIZE; ty <= topY / RENDER_TILE_SIZE; ty++) {
+		for(int tx = leftX / RENDER_TILE_SIZE; tx <= rightX / RENDER_TILE_SIZE; tx++) {
+			uint8_t& flags = targets.tileFlags[ty * targets.tilesX + tx];
+			if(!(flags & TILE_CLEARED))
+				continue;
+			flags &= ~TILE_CLEARED;
+
+			int minX = tx * RENDER_TILE_SIZE;
+			int maxX = min(minX + RENDER_TILE_SIZE, surface.width);
+			int minY = ty * RENDER_TILE_SIZE;
+			int maxY = min(minY + RENDER_TILE_SIZE, surface.height);
+			uint32_t pixel = packPixel(surface.format, color);
+			for(int y = minY; y < maxY; y++) {
+				float* depthRow = targets.zBuffer + y * surface.width * stride;
+				std::fill(depthRow + minX * stride, depthRow + maxX * stride, std::numeric_limits<float>::max());
+				uint32_t* row = pixelRow(surface, y);
+				std::fill(row + minX, row + maxX, pixel);
+				//material 0 leaves the pixel to forward shading
+				if(context->gbuffer) {
+					uint32_t* albedoRow = context->gbuffer->albedo + y * surface.width;
+					std::fill(albedoRow + minX, albedoRow + maxX, 0);
+				}
+				if(context->visibility) {
+					uint32_t* idRow = context->visibility->ids + y * surface.width * stride;
+					std::fill(idRow + minX * stride, idRow + maxX * stride, VISIBILITY_NONE);
 				}
 			}
-			
-			w0 += s.FA12;
-			w1 += s.FA20;
-			w2 += s.FA01;
 		}
-
-		s.w0StartRow -= s.FB12;
-		s.w1StartRow -= s.FB20;
-		s.w2StartRow -= s.FB01;
 	}
 }
 
-//msaa stuff
-enum CoverageMaskFlagBits
+void drawTriangleHalfSpace(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const Shader& shader, VaryingBlock& varyings, const ScissorRect& scissor)
+{
+	drawTriangleHalfSpace<Shader>(context, v0, v1, v2, shader, varyings, scissor, context->viewportTransform);
+}
+
+void drawTriangleHalfSpaceCoarse(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const Shader& shader, VaryingBlock& varyings, const ScissorRect& scissor)
 {
-	COVERAGE_NONE          = 0 << 0,
-	COVERAGE_RIGHT_TOP     = 1 << 0,
-	COVERAGE_LEFT_TOP      = 1 << 1,
-	COVERAGE_LEFT_BOTTOM   = 1 << 2,
-	COVERAGE_RIGHT_BOTTOM  = 1 << 3,
-	COVERAGE_FULL          = 0xf
-};
-
-static const int8_t sampleLocX[4] = {6, -2, -6, 2};
-static const int8_t sampleLocY[4] = {2, 6, -2, -6};
-
-void drawTriangleHalfSpaceMSAA(RenderContext* context, Vertex v0, Vertex v1, Vertex v2, Shader& shader)
+	drawTriangleHalfSpaceCoarse<Shader>(context, v0, v1, v2, shader, varyings, scissor, context->viewportTransform);
+}
+
+void drawTriangleHalfSpaceMSAA(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const Shader& shader, VaryingBlock& varyings, const ScissorRect& scissor)
+{
+	drawTriangleHalfSpaceMSAA<Shader>(context, v0, v1, v2, shader, varyings, scissor, context->viewportTransform);
+}
+
+void drawShadedTriangle(RenderContext* context, const Triangle& triangle, const Shader& shader, VaryingBlock& varyings, bool msaa, const ScissorRect& scissor)
+{
+	drawShadedTriangle<Shader>(context, triangle, shader, varyings, msaa, scissor);
+}
+
+//visibility buffer rasterization, same coverage and depth test as the shading rasterizers but only depth and id get written
+void drawTriangleVisibility(RenderContext* context, Vec4 p0, Vec4 p1, Vec4 p2, uint32_t id, bool msaa, const ScissorRect& scissor)
 {
 	float* zBuffer = context->rtargets.zBuffer;
-	Vec3* cBuffer = context->rtargets.cBuffer;
-
-	SDL_Surface* surface = context->surface;
-	   
-	//preserve depth of a polygon via keeping its z coordinate in clip-space
-	float z0Inv = 1.f / (float)v0.pos.w;
-	float z1Inv = 1.f / (float)v1.pos.w;
-	float z2Inv = 1.f / (float)v2.pos.w;
-	
-	v0.pos = perspectiveDivide(v0.pos) * viewportTransform;
-	v1.pos = perspectiveDivide(v1.pos) * viewportTransform;
-	v2.pos = perspectiveDivide(v2.pos) * viewportTransform;
+	uint32_t* ids = context->visibility->ids;
+	int width = context->surface.width;
 
-	const float triArea = computeArea(v0.pos.xyz, v1.pos.xyz, v2.pos.xyz);
+	float z0Inv = 1.f / p0.w;
+	float z1Inv = 1.f / p1.w;
+	float z2Inv = 1.f / p2.w;
+
+	p0 = perspectiveDivide(p0) * context->viewportTransform;
+	p1 = perspectiveDivide(p1) * context->viewportTransform;
+	p2 = perspectiveDivide(p2) * context->viewportTransform;
+
+	const float triArea = computeArea(p0.xyz, p1.xyz, p2.xyz);
 	if(triArea < 0)
 		return;
-	
-	shader.prepareInterpolants(v0, v1, v2, z0Inv, z1Inv, z2Inv, triArea);
 
 	float Z1Z0Inv = (z1Inv - z0Inv) / triArea;
 	float Z2Z0Inv = (z2Inv - z0Inv) / triArea;
-	
-	bool discardFragment = false;
-	//printf("TRIANGLE COORDS ARE\n V0: %f %f %f\n V1: %f %f %f\n V2: %f %f %f\n",
-	//v0.pos.x,v0.pos.y,v0.pos.z,v1.pos.x,v1.pos.y,v1.pos.z,v2.pos.x,v2.pos.y,v2.pos.z);
-	SampleRastInfo s  = prepareSample(context, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, 8, 8);//8 is the offset to the pixel center
-	SampleRastInfo s1 = prepareSample(context, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[0] + 8, sampleLocY[0] + 8);
-	SampleRastInfo s2 = prepareSample(context, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[1] + 8, sampleLocY[1] + 8);
-	SampleRastInfo s3 = prepareSample(context, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[2] + 8, sampleLocY[2] + 8);
-	SampleRastInfo s4 = prepareSample(context, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[3] + 8, sampleLocY[3] + 8);
-	int stride = 4;
-	assert(s2.topY >= s4.botY);
-	assert(s3.leftX <= s1.rightX);
-	for(int y = s2.topY; y >= s4.botY; y--) {
 
-		int w0 = s.w0StartRow;
-		int w1 = s.w1StartRow;
-		int w2 = s.w2StartRow;
+	if(!msaa) {
+		SampleRastInfo s = prepareSample(scissor, p0.xyz, p1.xyz, p2.xyz, 0, 0);
+		if(s.topY < s.botY || s.leftX > s.rightX)
+			return;
+		touchTiles(context, s.leftX, s.botY, s.rightX, s.topY, 1);
+
+		for(int y = s.topY; y >= s.botY; y--) {
+			int w0 = s.w0StartRow;
+			int w1 = s.w1StartRow;
+			int w2 = s.w2StartRow;
+			for(int x = s.leftX; x <= s.rightX; x++) {
+				if(w0 > 0 && w1 > 0 && w2 > 0) {
+					float Z = 1.f / (z0Inv + (w1/256.f) * Z1Z0Inv + (w2/256.f) * Z2Z0Inv);
+					if(Z < zBuffer[y * width + x]) {
+						zBuffer[y * width + x] = Z;
+						ids[y * width + x] = id;
+					}
+				}
+				w0 += s.FA12;
+				w1 += s.FA20;
+				w2 += s.FA01;
+			}
+			s.w0StartRow -= s.FB12;
+			s.w1StartRow -= s.FB20;
+			s.w2StartRow -= s.FB01;
+		}
+		return;
+	}
 
-		int w0s1 = s1.w0StartRow;
-		int w1s1 = s1.w1StartRow;
-		int w2s1 = s1.w2StartRow;
+	//one pass per sample position, ids and depth are stored per sample
+	SampleRastInfo samples[4];
+	for(int i = 0; i < 4; i++)
+		samples[i] = prepareSample(scissor, p0.xyz, p1.xyz, p2.xyz, sampleLocX[i] + 8, sampleLocY[i] + 8);
+	if(samples[1].topY < samples[3].botY || samples[2].leftX > samples[0].rightX)
+		return;
+	touchTiles(context, samples[2].leftX, samples[3].botY, samples[0].rightX, samples[1].topY, 4);
+
+	for(int i = 0; i < 4; i++) {
+		SampleRastInfo& s = samples[i];
+		for(int y = s.topY; y >= s.botY; y--) {
+			int w0 = s.w0StartRow;
+			int w1 = s.w1StartRow;
+			int w2 = s.w2StartRow;
+			for(int x = s.leftX; x <= s.rightX; x++) {
+				if(w0 > 0 && w1 > 0 && w2 > 0) {
+					float Z = 1.f / (z0Inv + (w1 / 256.f) * Z1Z0Inv + (w2 / 256.f) * Z2Z0Inv);
+					if(Z < zBuffer[(y * width + x) * 4 + i]) {
+						zBuffer[(y * width + x) * 4 + i] = Z;
+						ids[(y * width + x) * 4 + i] = id;
+					}
+				}
+				w0 += s.FA12;
+				w1 += s.FA20;
+				w2 += s.FA01;
+			}
+			s.w0StartRow -= s.FB12;
+			s.w1StartRow -= s.FB20;
+			s.w2StartRow -= s.FB01;
+		}
+	}
+}
 
-		int w0s2 = s2.w0StartRow;
-		int w1s2 = s2.w1StartRow;
-		int w2s2 = s2.w2StartRow;
+//world space counterpart of drawShadedTriangle for the visibility buffer, positions go through VP instead of the vertex shader
+void drawVisibilityTriangle(RenderContext* context, const Triangle& triangle, const mat4x4& VP, uint32_t id, bool msaa, const ScissorRect& scissor)
+{
+	ShadedVertex v1;
+	ShadedVertex v2;
+	ShadedVertex v3;
+	v1.pos = triangle.v1.pos * VP;
+	v2.pos = triangle.v2.pos * VP;
+	v3.pos = triangle.v3.pos * VP;
+
+	if(isInsideViewFrustum(v1.pos) && isInsideViewFrustum(v2.pos) && isInsideViewFrustum(v3.pos)) {
+		drawTriangleVisibility(context, v1.pos, v2.pos, v3.pos, id, msaa, scissor);
+		return;
+	}
 
-		int w0s3 = s3.w0StartRow;
-		int w1s3 = s3.w1StartRow;
-		int w2s3 = s3.w2StartRow;
+	//positions get clipped exactly like drawShadedTriangle clips them, no matter how many varyings the shader has
+	ClippResult result = clipTriangle(v1, v2, v3, 0);
+	for(size_t i = 0; i < result.numTriangles; i++) {
+		const ShadedTriangle& clipped = result.triangles[i];
+		drawTriangleVisibility(context, clipped.v1.pos, clipped.v2.pos, clipped.v3.pos, id, msaa, scissor);
+	}
+}
 
-		int w0s4 = s4.w0StartRow;
-		int w1s4 = s4.w1StartRow;
-		int w2s4 = s4.w2StartRow;
+//shadow map rasterization, plain coverage and depth with no varyings, shader or color. NDC depth is affine in
+//screen space so it's interpolated without perspective correction. Casters are two sided, both windings are drawn
+void drawTriangleDepth(const ShadowMap& map, float* depth, Vec4 p0, Vec4 p1, Vec4 p2, const ScissorRect& scissor)
+{
+	p0 = perspectiveDivide(p0) * map.viewportTransform;
+	p1 = perspectiveDivide(p1) * map.viewportTransform;
+	p2 = perspectiveDivide(p2) * map.viewportTransform;
+
+	float triArea = computeArea(p0.xyz, p1.xyz, p2.xyz);
+	if(triArea < 0) {
+		std::swap(p1, p2);
+		triArea = -triArea;
+	}
+	if(triArea == 0)
+		return;
 
-		for(int x = s3.leftX; x <= s1.rightX; x++) {
-			int coverageMask = COVERAGE_NONE;
+	float Z1Z0 = (p1.z - p0.z) / triArea;
+	float Z2Z0 = (p2.z - p0.z) / triArea;
 
-			//perform depth and coverage test for each subsample
-			if(w0s1 > 0 && w1s1 > 0 && w2s1 > 0) {
-				float zs1 = z0Inv + (w1s1 / 256.f) * Z1Z0Inv + (w2s1 / 256.f) * Z2Z0Inv;
-				zs1 = 1.f / zs1;
-				if(zs1 < zBuffer[(y * surface->w + x) * stride]) {
-					coverageMask |= COVERAGE_RIGHT_TOP;
-					zBuffer[(y * surface->w + x) * stride] = zs1;
-				}
-			}
-			if(w0s2>0 && w1s2>0 && w2s2>0) {
-				float zs2 = z0Inv + (w1s2 / 256.f) * Z1Z0Inv + (w2s2 / 256.f) * Z2Z0Inv;
-				zs2 = 1.f / zs2;
-				if(zs2 < zBuffer[(y * surface->w + x) * stride + 1]) {
-					coverageMask |= COVERAGE_LEFT_TOP;
-					zBuffer[(y * surface->w + x) * stride + 1] = zs2;
-				}
-			}
-			if(w0s3>0 && w1s3>0 && w2s3>0) {
-				float zs3 = z0Inv + (w1s3 / 256.f) * Z1Z0Inv + (w2s3 / 256.f) * Z2Z0Inv;
-				zs3 = 1.f / zs3;
-				if(zs3 < zBuffer[(y * surface->w + x) * stride + 2]) {
-					coverageMask |= COVERAGE_LEFT_BOTTOM;
-					zBuffer[(y * surface->w + x) * stride + 2] = zs3;
-				}
-			}
-			if(w0s4>0 && w1s4>0 && w2s4>0) {
-				float zs4 = z0Inv + (w1s4 / 256.f) * Z1Z0Inv + (w2s4 / 256.f) * Z2Z0Inv;
-				zs4 = 1.f / zs4;
-				if(zs4 < zBuffer[(y * surface->w + x) * stride + 3]) {
-					coverageMask |= COVERAGE_RIGHT_BOTTOM;
-					zBuffer[(y * surface->w + x) * stride + 3] = zs4;
-				}
-			}
+	SampleRastInfo s = prepareSample(scissor, p0.xyz, p1.xyz, p2.xyz, 0, 0);
+	if(s.topY < s.botY || s.leftX > s.rightX)
+		return;
 
-			if(coverageMask) {  
-				float Z = z0Inv + (w1 >> 8) * Z1Z0Inv + (w2 >> 8) * Z2Z0Inv;
-				Z = 1.f / Z;
-				Vec3 gl_pixelCoord = {w1>>8, w2>>8, Z};
-				discardFragment = false;
-				Vec3 pixelColor = shader.fragmentShader(gl_pixelCoord, discardFragment);
-				Vec3 sampleColors[4] = {};
-
-				sampleColors[0] = coverageMask & COVERAGE_RIGHT_TOP ? pixelColor :
-					cBuffer[(y * surface->w + x) * stride];
-				sampleColors[1] = coverageMask & COVERAGE_LEFT_TOP ? pixelColor :
-					cBuffer[(y * surface->w + x) * stride + 1];
-				sampleColors[2] = coverageMask & COVERAGE_LEFT_BOTTOM ? pixelColor :
-					cBuffer[(y * surface->w + x) * stride + 2];
-				sampleColors[3] = coverageMask & COVERAGE_RIGHT_BOTTOM ? pixelColor :
-					cBuffer[(y * surface->w + x) * stride + 3];
-				pixelColor = (sampleColors[0] + sampleColors[1] + sampleColors[2] + sampleColors[3]) / 4;
-
-				cBuffer[(y * surface->w + x) * stride] = sampleColors[0];
-				cBuffer[(y * surface->w + x) * stride + 1] = sampleColors[1];
-				cBuffer[(y * surface->w + x) * stride + 2] = sampleColors[2];
-				cBuffer[(y * surface->w + x) * stride + 3] = sampleColors[3];
-				
-				if(!discardFragment)
-					drawPixel(surface, x, y, pixelColor);
+	//polygon offset, a constant bias plus the steepest depth change per texel
+	float slopeX = std::abs(s.FA20 * Z1Z0 + s.FA01 * Z2Z0) / 256.f;
+	float slopeY = std::abs(s.FB20 * Z1Z0 + s.FB01 * Z2Z0) / 256.f;
+	float Z0 = p0.z + map.depthBias + map.slopeBias * max(slopeX, slopeY);
 
+	for(int y = s.topY; y >= s.botY; y--) {
+		int w0 = s.w0StartRow;
+		int w1 = s.w1StartRow;
+		int w2 = s.w2StartRow;
+		float* row = depth + y * map.size;
+		for(int x = s.leftX; x <= s.rightX; x++) {
+			if(w0 > 0 && w1 > 0 && w2 > 0) {
+				float Z = Z0 + (w1/256.f) * Z1Z0 + (w2/256.f) * Z2Z0;
+				if(Z < row[x])
+					row[x] = Z;
 			}
-			
 			w0 += s.FA12;
 			w1 += s.FA20;
 			w2 += s.FA01;
-
-			w0s1 += s1.FA12;
-			w1s1 += s1.FA20;
-			w2s1 += s1.FA01;
-
-			w0s2 += s2.FA12;
-			w1s2 += s2.FA20;
-			w2s2 += s2.FA01;
-
-			w0s3 += s3.FA12;
-			w1s3 += s3.FA20;
-			w2s3 += s3.FA01;
-
-			w0s4 += s4.FA12;
-			w1s4 += s4.FA20;
-			w2s4 += s4.FA01;
 		}
-
 		s.w0StartRow -= s.FB12;
 		s.w1StartRow -= s.FB20;
 		s.w2StartRow -= s.FB01;
+	}
+}
 
-		s1.w0StartRow -= s1.FB12;
-		s1.w1StartRow -= s1.FB20;
-		s1.w2StartRow -= s1.FB01;
-
-		s2.w0StartRow -= s2.FB12;
-		s2.w1StartRow -= s2.FB20;
-		s2.w2StartRow -= s2.FB01;
-
-		s3.w0StartRow -= s3.FB12;
-		s3.w1StartRow -= s3.FB20;
-		s3.w2StartRow -= s3.FB01;
+//light clip space counterpart of drawVisibilityTriangle for shadow maps
+void drawDepthTriangle(const ShadowMap& map, float* depth, const Vec4& c1, const Vec4& c2, const Vec4& c3, const ScissorRect& scissor)
+{
+	if(isInsideViewFrustum(c1) && isInsideViewFrustum(c2) && isInsideViewFrustum(c3)) {
+		drawTriangleDepth(map, depth, c1, c2, c3, scissor);
+		return;
+	}
 
-		s4.w0StartRow -= s4.FB12;
-		s4.w1StartRow -= s4.FB20;
-		s4.w2StartRow -= s4.FB01;
+	ShadedVertex v1;
+	ShadedVertex v2;
+	ShadedVertex v3;
+	v1.pos = c1;
+	v2.pos = c2;
+	v3.pos = c3;
+	ClippResult result = clipTriangle(v1, v2, v3, 0);
+	for(size_t i = 0; i < result.numTriangles; i++) {
+		const ShadedTriangle& clipped = result.triangles[i];
+		drawTriangleDepth(map, depth, clipped.v1.pos, clipped.v2.pos, clipped.v3.pos, scissor);
 	}
-}
\ No newline at end of file
+}
+
+//conservative range of screen rows a world space triangle covers, false when it's entirely off screen.
+//triangles crossing the camera plane get the whole screen
+bool triangleScreenRows(const RenderContext* context, const Triangle& triangle, const mat4x4& VP, int* botY, int* topY)
+{
+	*botY = 0;
+	*topY = context->window.height - 1;
+
+	Vec4 c1 = triangle.v1.pos * VP;
+	Vec4 c2 = triangle.v2.pos * VP;
+	Vec4 c3 = triangle.v3.pos * VP;
+	if(c1.w <= 0.f || c2.w <= 0.f || c3.w <= 0.f)
+		return true;
+
+	Vec4 s1 = perspectiveDivide(c1) * context->viewportTransform;
+	Vec4 s2 = perspectiveDivide(c2) * context->viewportTransform;
+	Vec4 s3 = perspectiveDivide(c3) * context->viewportTransform;
+	float minX = min(min(s1.x, s2.x), s3.x);
+	float maxX = max(max(s1.x, s2.x), s3.x);
+	float minY = min(min(s1.y, s2.y), s3.y);
+	float maxY = max(max(s1.y, s2.y), s3.y);
+	if(maxX < -1.f || minX > context->window.width || maxY < -1.f || minY > context->window.height)
+		return false;
+
+	*botY = max((int)(minY - 1.f), 0);
+	*topY = min((int)(maxY + 1.f), context->window.height - 1);
+	return true;
+}
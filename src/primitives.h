@@ -3,10 +3,41 @@
 
 #include "renderer.h"
 
-void drawPixel(const SDL_Surface* surface, int x, int y, Vec3 color);
-void drawLine(const SDL_Surface* surface, int x0, int y0, int x1, int y1, Vec3 color);
-void drawWireFrame(const SDL_Surface* surface, Vec4 v0, Vec4 v1, Vec4 v2, Vec3 color);
-void drawTriangleHalfSpace(RenderContext* context, Vertex v0, Vertex v1, Vertex v2, Shader& shader);
-void drawTriangleHalfSpaceMSAA(RenderContext* context, Vertex v0, Vertex v1, Vertex v2, Shader& shader);
+struct SampleRastInfo
+{
+	float w0StartRow;
+	float w1StartRow;
+	float w2StartRow;
+	int FA01;
+	int FB01;
+	int FA12;
+	int FB12;
+	int FA20;
+	int FB20;
+	int topY;
+	int leftX;
+	int botY;
+	int rightX;
+};
+
+//edge functions of a triangle in 28.4 fixed point at the top left corner of its bounding box clamped to scissor,
+//sX/sY offset the sample position in 1/16th of a pixel
+SampleRastInfo prepareSample(const ScissorRect& scissor, Vec3 v0, Vec3 v1, Vec3 v2, int sX, int sY);
+
+void touchTiles(RenderContext* context, int leftX, int botY, int rightX, int topY, int stride);
+
+void drawPixel(const PixelBuffer& surface, int x, int y, Vec3 color);
+void drawLine(const PixelBuffer& surface, int x0, int y0, int x1, int y1, Vec3 color);
+void drawWireFrame(const RenderContext* context, Vec4 v0, Vec4 v1, Vec4 v2, Vec3 color);
+//virtual dispatch versions, rasterizer.h has the ones specialized per shader type
+void drawTriangleHalfSpace(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const Shader& shader, VaryingBlock& varyings, const ScissorRect& scissor);
+void drawTriangleHalfSpaceCoarse(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const Shader& shader, VaryingBlock& varyings, const ScissorRect& scissor);
+void drawTriangleHalfSpaceMSAA(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const Shader& shader, VaryingBlock& varyings, const ScissorRect& scissor);
+void drawShadedTriangle(RenderContext* context, const Triangle& triangle, const Shader& shader, VaryingBlock& varyings, bool msaa, const ScissorRect& scissor);
+void drawTriangleVisibility(RenderContext* context, Vec4 p0, Vec4 p1, Vec4 p2, uint32_t id, bool msaa, const ScissorRect& scissor);
+void drawVisibilityTriangle(RenderContext* context, const Triangle& triangle, const mat4x4& VP, uint32_t id, bool msaa, const ScissorRect& scissor);
+void drawTriangleDepth(const ShadowMap& map, float* depth, Vec4 p0, Vec4 p1, Vec4 p2, const ScissorRect& scissor);
+void drawDepthTriangle(const ShadowMap& map, float* depth, const Vec4& c1, const Vec4& c2, const Vec4& c3, const ScissorRect& scissor);
+bool triangleScreenRows(const RenderContext* context, const Triangle& triangle, const mat4x4& VP, int* botY, int* topY);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "quality.h"
+
+//frames the average gets to pick up a new level before the next decision
+static const uint32_t SETTLE_FRAMES = 8;
+//hysteresis band around the target, going up needs more headroom since the next level costs more
+static const float LOWER_ABOVE_LOAD = 1.05f;
+static const float RAISE_BELOW_LOAD = 0.8f;
+//frames a raised level has to hold before the raise delay starts over
+static const uint32_t HOLD_FRAMES = 120;
+static const uint32_t MAX_RAISE_DELAY = 960;
+
+//parallax layers go first, they're only paid for by bump mapped surfaces, msaa is the most expensive step
+static const QualityLevel DEFAULT_LEVELS[] = {
+	{8, false, false},
+	{16, false, false},
+	{16, true, false},
+	{30, true, false},
+	{30, true, true},
+};
+
+static void changeLevel(RenderContext* context, uint32_t level)
+{
+	AdaptiveQuality* quality = context->adaptiveQuality;
+	QualityChange change = {quality->level, level, context->averageFrameMs};
+	quality->raised = level > quality->level;
+	quality->level = level;
+	quality->framesSinceChange = 0;
+	context->quality = quality->levels[level];
+	if(quality->config.onChange)
+		quality->config.onChange(change, quality->config.user);
+}
+
+AdaptiveQuality* createAdaptiveQuality(RenderContext* context, const AdaptiveQualityConfig& config)
+{
+	AdaptiveQuality* quality = new AdaptiveQuality();
+	quality->config = config;
+	if(config.levels && config.numLevels)
+		quality->levels.assign(config.levels, config.levels + config.numLevels);
+	else
+		quality->levels.assign(std::begin(DEFAULT_LEVELS), std::end(DEFAULT_LEVELS));
+	quality->config.levels = nullptr;
+	quality->config.numLevels = quality->levels.size();
+	quality->level = quality->levels.size() - 1;
+	quality->raiseDelay = SETTLE_FRAMES;
+	context->adaptiveQuality = quality;
+	context->quality = quality->levels[quality->level];
+	return quality;
+}
+
+void destroyAdaptiveQuality(RenderContext* context)
+{
+	delete context->adaptiveQuality;
+	context->adaptiveQuality = nullptr;
+	context->quality = QualityLevel();
+}
+
+void updateAdaptiveQuality(RenderContext* context)
+{
+	AdaptiveQuality* quality = context->adaptiveQuality;
+	if(!context->averageFrameMs || ++quality->framesSinceChange < SETTLE_FRAMES)
+		return;
+
+	float load = context->averageFrameMs / quality->config.targetFrameMs;
+	if(load > LOWER_ABOVE_LOAD && quality->level > 0) {
+		//the level above didn't fit after all, leave it alone for longer next time
+		if(quality->raised)
+			quality->raiseDelay = min(quality->raiseDelay * 2, MAX_RAISE_DELAY);
+		changeLevel(context, quality->level - 1);
+	}
+	else if(load < RAISE_BELOW_LOAD && quality->level + 1 < quality->levels.size() && quality->framesSinceChange >= quality->raiseDelay) {
+		changeLevel(context, quality->level + 1);
+	}
+	else if(quality->raised && quality->framesSinceChange >= HOLD_FRAMES) {
+		quality->raised = false;
+		quality->raiseDelay = SETTLE_FRAMES;
+	}
+}
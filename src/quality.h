@@ -0,0 +1,26 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include <vector>
+#include "renderer.h"
+
+//steps through quality levels by the context's smoothed frame time. Going down happens as soon as a level is too slow,
+//going up waits for headroom and for the raise delay, which doubles whenever a raised level doesn't hold
+struct AdaptiveQuality
+{
+	AdaptiveQualityConfig config;
+	std::vector<QualityLevel> levels;//!<cheapest first
+	uint32_t level;
+	uint32_t framesSinceChange;
+	uint32_t raiseDelay;//!<frames a level is held before trying the one above
+	bool raised;//!<last change went up and the level didn't hold for long yet
+};
+
+AdaptiveQuality* createAdaptiveQuality(RenderContext* context, const AdaptiveQualityConfig& config);
+
+void destroyAdaptiveQuality(RenderContext* context);
+
+//decides on the frame time endFrame measured, draws recorded from the next beginFrame on get the new level
+void updateAdaptiveQuality(RenderContext* context);
+
+#endif
@@ -0,0 +1,600 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <cassert>
+#include <limits>
+#include <typeinfo>
+#include "primitives.h"
+#include "clipper.h"
+#include "deferred.h"
+#include "checkerboard.h"
+
+//Shader stages called through the ShaderT implementation, which lets the compiler inline them into the pixel loops.
+//ShaderT has to be the dynamic type of the shader, plain Shader keeps the virtual calls for everything else
+template<typename ShaderT>
+struct ShaderStages
+{
+	static int varyingCount(const ShaderT& shader)
+	{
+		return shader.ShaderT::varyingCount();
+	}
+
+	static ShadedVertex vertexShader(const ShaderT& shader, const Vertex& in, const VaryingBlock& varyings)
+	{
+		return shader.ShaderT::vertexShader(in, varyings);
+	}
+
+	static Vec3 fragmentShader(const ShaderT& shader, const Fragment& in, const VaryingBlock& varyings, bool& discard)
+	{
+		return shader.ShaderT::fragmentShader(in, varyings, discard);
+	}
+
+	static uint32_t fragmentShaderBatch(const ShaderT& shader, const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out)
+	{
+		return shader.ShaderT::fragmentShaderBatch(in, varyings, out);
+	}
+
+	static void surfaceShader(const ShaderT& shader, const Fragment& in, const VaryingBlock& varyings, SurfaceSample& out, bool& discard)
+	{
+		shader.ShaderT::surfaceShader(in, varyings, out, discard);
+	}
+};
+
+template<>
+struct ShaderStages<Shader>
+{
+	static int varyingCount(const Shader& shader)
+	{
+		return shader.varyingCount();
+	}
+
+	static ShadedVertex vertexShader(const Shader& shader, const Vertex& in, const VaryingBlock& varyings)
+	{
+		return shader.vertexShader(in, varyings);
+	}
+
+	static Vec3 fragmentShader(const Shader& shader, const Fragment& in, const VaryingBlock& varyings, bool& discard)
+	{
+		return shader.fragmentShader(in, varyings, discard);
+	}
+
+	static uint32_t fragmentShaderBatch(const Shader& shader, const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out)
+	{
+		return shader.fragmentShaderBatch(in, varyings, out);
+	}
+
+	static void surfaceShader(const Shader& shader, const Fragment& in, const VaryingBlock& varyings, SurfaceSample& out, bool& discard)
+	{
+		shader.surfaceShader(in, varyings, out, discard);
+	}
+};
+
+//perspective correct interpolation: varyings over w are linear in screen space, so they get stepped along the
+//edge functions like 1/w does and multiplied by the fragment's w at the end
+inline void setupVaryings(VaryingBlock& out, int numVaryings, const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2,
+	float z0Inv, float z1Inv, float z2Inv, float triArea)
+{
+	for(int i = 0; i < numVaryings; i++) {
+		out.base[i] = v0.varyings[i] * z0Inv;
+		out.du[i] = (v1.varyings[i] * z1Inv - out.base[i]) / triArea;
+		out.dv[i] = (v2.varyings[i] * z2Inv - out.base[i]) / triArea;
+	}
+}
+
+//u and v are the second and third edge functions at the fragment, z its view depth
+inline void evaluateVaryings(const VaryingBlock& in, int numVaryings, float u, float v, float z, Fragment& out)
+{
+	out.z = z;
+	for(int i = 0; i < numVaryings; i++)
+		out.varyings[i] = (in.base[i] + u * in.du[i] + v * in.dv[i]) * z;
+}
+
+//msaa stuff
+enum CoverageMaskFlagBits
+{
+	COVERAGE_NONE          = 0 << 0,
+	COVERAGE_RIGHT_TOP     = 1 << 0,
+	COVERAGE_LEFT_TOP      = 1 << 1,
+	COVERAGE_LEFT_BOTTOM   = 1 << 2,
+	COVERAGE_RIGHT_BOTTOM  = 1 << 3,
+	COVERAGE_FULL          = 0xf
+};
+
+static const int8_t sampleLocX[4] = {6, -2, -6, 2};
+static const int8_t sampleLocY[4] = {2, 6, -2, -6};
+
+template<typename ShaderT>
+void drawTriangleHalfSpace(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const ShaderT& shader, VaryingBlock& varyings, const ScissorRect& scissor,
+	const mat4x4& viewportTransform)
+{
+	float* zBuffer = context->rtargets.zBuffer;
+	const PixelBuffer& surface = context->surface;
+	const int numVaryings = ShaderStages<ShaderT>::varyingCount(shader);
+	   
+	//preserve depth of a polygon via keeping its z coordinate in clip-space
+	float z0Inv = 1.f / (float)v0.pos.w;
+	float z1Inv = 1.f / (float)v1.pos.w;
+	float z2Inv = 1.f / (float)v2.pos.w;
+	
+	v0.pos = perspectiveDivide(v0.pos) * viewportTransform;
+	v1.pos = perspectiveDivide(v1.pos) * viewportTransform;
+	v2.pos = perspectiveDivide(v2.pos) * viewportTransform;
+
+	const float triArea = computeArea(v0.pos.xyz, v1.pos.xyz, v2.pos.xyz);
+	if(triArea < 0)
+		return;
+	setupVaryings(varyings, numVaryings, v0, v1, v2, z0Inv, z1Inv, z2Inv, triArea);
+
+	float Z1Z0Inv = (z1Inv - z0Inv) / triArea;
+	float Z2Z0Inv = (z2Inv - z0Inv) / triArea;
+
+	SampleRastInfo s = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, 0, 0);
+	if(s.topY < s.botY || s.leftX > s.rightX)
+		return;
+	touchTiles(context, s.leftX, s.botY, s.rightX, s.topY, 1);
+
+	//deferred draws only leave surface attributes, lighting happens once per pixel at the end of the frame
+	const GBuffer* gbuffer = context->gbuffer;
+	uint32_t materialId = gbuffer ? shader.uniforms.in_materialId : 0;
+	int checkerParity = checkerboardParity(context);
+	for(int y = s.topY; y >= s.botY; y--) {
+
+		//checkerboard frames batch every other pixel, the ones in between only get their depth for the reconstruction
+		int firstX = s.leftX;
+		int stepX = 1;
+		if(checkerParity >= 0) {
+			for(int x = s.leftX + ((s.leftX + y + checkerParity + 1) & 1); x <= s.rightX; x += 2) {
+				int w0 = (int)s.w0StartRow + (x - s.leftX) * s.FA12;
+				int w1 = (int)s.w1StartRow + (x - s.leftX) * s.FA20;
+				int w2 = (int)s.w2StartRow + (x - s.leftX) * s.FA01;
+				if(w0 > 0 && w1 > 0 && w2 > 0) {
+					float Z = 1.f / (z0Inv + (w1/256.f) * Z1Z0Inv + (w2/256.f) * Z2Z0Inv);
+					float& depth = zBuffer[y * surface.width + x];
+					depth = min(depth, Z);
+				}
+			}
+			firstX += (s.leftX + y + checkerParity) & 1;
+			stepX = 2;
+		}
+
+		int w0 = (int)s.w0StartRow + (firstX - s.leftX) * s.FA12;
+		int w1 = (int)s.w1StartRow + (firstX - s.leftX) * s.FA20;
+		int w2 = (int)s.w2StartRow + (firstX - s.leftX) * s.FA01;
+
+		//coverage and depth test a batch of pixels, then shade the ones that passed together
+		for(int batchX = firstX; batchX <= s.rightX; batchX += FRAGMENT_BATCH_WIDTH * stepX) {
+			int numLanes = min(FRAGMENT_BATCH_WIDTH, (s.rightX - batchX) / stepX + 1);
+			FragmentBatch batch;
+			batch.mask = 0;
+			float u[FRAGMENT_BATCH_WIDTH], v[FRAGMENT_BATCH_WIDTH];
+			for(int lane = 0; lane < FRAGMENT_BATCH_WIDTH; lane++) {
+				u[lane] = w1/256.f;
+				v[lane] = w2/256.f;
+				float Z = z0Inv + u[lane] * Z1Z0Inv + v[lane] * Z2Z0Inv;
+				Z = 1.f / Z;
+				batch.z[lane] = Z;
+				if(lane < numLanes && w0>0 && w1>0 && w2>0) {
+					float& depth = zBuffer[y * surface.width + batchX + lane * stepX];
+					if(Z < depth) {
+						depth = Z;
+						batch.mask |= 1u << lane;
+					}
+				}
+
+				w0 += s.FA12 * stepX;
+				w1 += s.FA20 * stepX;
+				w2 += s.FA01 * stepX;
+			}
+			if(!batch.mask)
+				continue;
+
+			//varyings of every lane at once, one varying at a time
+			for(int i = 0; i < numVaryings; i++) {
+				for(int lane = 0; lane < FRAGMENT_BATCH_WIDTH; lane++)
+					batch.varyings[i][lane] = (varyings.base[i] + u[lane] * varyings.du[i] + v[lane] * varyings.dv[i]) * batch.z[lane];
+			}
+
+			if(materialId) {
+				for(int lane = 0; lane < numLanes; lane++) {
+					if(!(batch.mask & 1u << lane))
+						continue;
+					bool discardFragment = false;
+					Fragment fragment;
+					fragmentLane(batch, lane, numVaryings, fragment);
+					SurfaceSample sample = {};
+					ShaderStages<ShaderT>::surfaceShader(shader, fragment, varyings, sample, discardFragment);
+					if(!discardFragment)
+						writeGBuffer(*gbuffer, batchX + lane * stepX, y, sample, materialId);
+				}
+				continue;
+			}
+
+			ColorBatch colors;
+			uint32_t written = ShaderStages<ShaderT>::fragmentShaderBatch(shader, batch, varyings, colors);
+			for(int lane = 0; lane < numLanes; lane++) {
+				if(!(written & 1u << lane))
+					continue;
+				int x = batchX + lane * stepX;
+				drawPixel(surface, x, y, Vec3{colors.r[lane], colors.g[lane], colors.b[lane]});
+				if(gbuffer)
+					gbuffer->albedo[y * surface.width + x] = 0;
+			}
+		}
+
+		s.w0StartRow -= s.FB12;
+		s.w1StartRow -= s.FB20;
+		s.w2StartRow -= s.FB01;
+	}
+}
+
+//side of the screen aligned blocks the coarse rasterizer walks, the largest coarse pixel
+static const int COARSE_BLOCK_SIZE = 4;
+
+//variable rate version of drawTriangleHalfSpace for forward draws. Coverage and depth are tested per pixel a block at
+//a time, then each coarse pixel with covered pixels runs the fragment shader once at its center and all of them get
+//the color. Coarse pixels are aligned to the screen, so triangles sharing an edge agree on them
+template<typename ShaderT>
+void drawTriangleHalfSpaceCoarse(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const ShaderT& shader, VaryingBlock& varyings, const ScissorRect& scissor,
+	const mat4x4& viewportTransform)
+{
+	float* zBuffer = context->rtargets.zBuffer;
+	const PixelBuffer& surface = context->surface;
+	const int numVaryings = ShaderStages<ShaderT>::varyingCount(shader);
+
+	float z0Inv = 1.f / (float)v0.pos.w;
+	float z1Inv = 1.f / (float)v1.pos.w;
+	float z2Inv = 1.f / (float)v2.pos.w;
+
+	v0.pos = perspectiveDivide(v0.pos) * viewportTransform;
+	v1.pos = perspectiveDivide(v1.pos) * viewportTransform;
+	v2.pos = perspectiveDivide(v2.pos) * viewportTransform;
+
+	const float triArea = computeArea(v0.pos.xyz, v1.pos.xyz, v2.pos.xyz);
+	if(triArea < 0)
+		return;
+	setupVaryings(varyings, numVaryings, v0, v1, v2, z0Inv, z1Inv, z2Inv, triArea);
+
+	float Z1Z0Inv = (z1Inv - z0Inv) / triArea;
+	float Z2Z0Inv = (z2Inv - z0Inv) / triArea;
+
+	SampleRastInfo s = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, 0, 0);
+	if(s.topY < s.botY || s.leftX > s.rightX)
+		return;
+	touchTiles(context, s.leftX, s.botY, s.rightX, s.topY, 1);
+
+	const GBuffer* gbuffer = context->gbuffer;
+	const uint8_t* rateImage = context->shadingRateImage;
+	int checkerParity = checkerboardParity(context);
+	const int blockAlign = ~(COARSE_BLOCK_SIZE - 1);
+	for(int blockY = s.topY & blockAlign; blockY >= (s.botY & blockAlign); blockY -= COARSE_BLOCK_SIZE) {
+		int minY = max(blockY, s.botY);
+		int maxY = min(blockY + COARSE_BLOCK_SIZE - 1, s.topY);
+		for(int blockX = s.leftX & blockAlign; blockX <= s.rightX; blockX += COARSE_BLOCK_SIZE) {
+			int minX = max(blockX, s.leftX);
+			int maxX = min(blockX + COARSE_BLOCK_SIZE - 1, s.rightX);
+
+			//bit (y - blockY) * COARSE_BLOCK_SIZE + x - blockX for pixels that passed coverage and depth tests
+			uint32_t covered = 0;
+			int pixelU[COARSE_BLOCK_SIZE * COARSE_BLOCK_SIZE];
+			int pixelV[COARSE_BLOCK_SIZE * COARSE_BLOCK_SIZE];
+			for(int y = minY; y <= maxY; y++) {
+				int w0 = (int)s.w0StartRow + (minX - s.leftX) * s.FA12 - (s.topY - y) * s.FB12;
+				int w1 = (int)s.w1StartRow + (minX - s.leftX) * s.FA20 - (s.topY - y) * s.FB20;
+				int w2 = (int)s.w2StartRow + (minX - s.leftX) * s.FA01 - (s.topY - y) * s.FB01;
+				for(int x = minX; x <= maxX; x++) {
+					if(w0 > 0 && w1 > 0 && w2 > 0) {
+						float Z = 1.f / (z0Inv + (w1/256.f) * Z1Z0Inv + (w2/256.f) * Z2Z0Inv);
+						float& depth = zBuffer[y * surface.width + x];
+						if(Z < depth) {
+							depth = Z;
+							int pixel = (y - blockY) * COARSE_BLOCK_SIZE + x - blockX;
+							covered |= 1u << pixel;
+							pixelU[pixel] = w1;
+							pixelV[pixel] = w2;
+						}
+					}
+					w0 += s.FA12;
+					w1 += s.FA20;
+					w2 += s.FA01;
+				}
+			}
+			//pixels of the other checkerboard parity keep their depth and are left to the reconstruction(masks of 4x4 blocks)
+			if(checkerParity >= 0)
+				covered &= checkerParity ? 0x5a5au : 0xa5a5u;
+			if(!covered)
+				continue;
+
+			int rate = shader.uniforms.in_shadingRate;
+			if(rateImage)
+				rate = max(rate, (int)rateImage[blockY / RENDER_TILE_SIZE * context->rtargets.tilesX + blockX / RENDER_TILE_SIZE]);
+			int size = 1 << min(rate, (int)SHADING_RATE_4X4);
+			for(int coarseY = 0; coarseY < COARSE_BLOCK_SIZE; coarseY += size) {
+				for(int coarseX = 0; coarseX < COARSE_BLOCK_SIZE; coarseX += size) {
+					uint32_t pixels = 0;
+					for(int y = coarseY; y < coarseY + size; y++)
+						pixels |= ((1u << size) - 1) << (y * COARSE_BLOCK_SIZE + coarseX);
+					pixels &= covered;
+					if(!pixels)
+						continue;
+
+					//center of the coarse pixel, kept inside the bounding box
+					float centerX = clamp(blockX + coarseX + (size - 1) * 0.5f, (float)s.leftX, (float)s.rightX);
+					float centerY = clamp(blockY + coarseY + (size - 1) * 0.5f, (float)s.botY, (float)s.topY);
+					float u = (s.w1StartRow + (centerX - s.leftX) * s.FA20 - (s.topY - centerY) * s.FB20) / 256.f;
+					float v = (s.w2StartRow + (centerX - s.leftX) * s.FA01 - (s.topY - centerY) * s.FB01) / 256.f;
+					float zInv = z0Inv + u * Z1Z0Inv + v * Z2Z0Inv;
+					//single pixels and centers extrapolated past the eye shade at their first covered pixel
+					if(size == 1 || zInv <= 0.f) {
+						int pixel = 0;
+						while(!(pixels & 1u << pixel))
+							pixel++;
+						u = pixelU[pixel] / 256.f;
+						v = pixelV[pixel] / 256.f;
+						zInv = z0Inv + u * Z1Z0Inv + v * Z2Z0Inv;
+					}
+
+					Fragment fragment;
+					evaluateVaryings(varyings, numVaryings, u, v, 1.f / zInv, fragment);
+					bool discardFragment = false;
+					Vec3 color = ShaderStages<ShaderT>::fragmentShader(shader, fragment, varyings, discardFragment);
+					if(discardFragment)
+						continue;
+					for(int pixel = 0; pixel < COARSE_BLOCK_SIZE * COARSE_BLOCK_SIZE; pixel++) {
+						if(!(pixels & 1u << pixel))
+							continue;
+						int x = blockX + pixel % COARSE_BLOCK_SIZE;
+						int y = blockY + pixel / COARSE_BLOCK_SIZE;
+						drawPixel(surface, x, y, color);
+						if(gbuffer)
+							gbuffer->albedo[y * surface.width + x] = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+template<typename ShaderT>
+void drawTriangleHalfSpaceMSAA(RenderContext* context, ShadedVertex v0, ShadedVertex v1, ShadedVertex v2, const ShaderT& shader, VaryingBlock& varyings, const ScissorRect& scissor,
+	const mat4x4& viewportTransform)
+{
+	float* zBuffer = context->rtargets.zBuffer;
+	Vec3* cBuffer = context->rtargets.cBuffer;
+	const int numVaryings = ShaderStages<ShaderT>::varyingCount(shader);
+
+	const PixelBuffer& surface = context->surface;
+	   
+	//preserve depth of a polygon via keeping its z coordinate in clip-space
+	float z0Inv = 1.f / (float)v0.pos.w;
+	float z1Inv = 1.f / (float)v1.pos.w;
+	float z2Inv = 1.f / (float)v2.pos.w;
+	
+	v0.pos = perspectiveDivide(v0.pos) * viewportTransform;
+	v1.pos = perspectiveDivide(v1.pos) * viewportTransform;
+	v2.pos = perspectiveDivide(v2.pos) * viewportTransform;
+
+	const float triArea = computeArea(v0.pos.xyz, v1.pos.xyz, v2.pos.xyz);
+	if(triArea < 0)
+		return;
+	
+	setupVaryings(varyings, numVaryings, v0, v1, v2, z0Inv, z1Inv, z2Inv, triArea);
+
+	float Z1Z0Inv = (z1Inv - z0Inv) / triArea;
+	float Z2Z0Inv = (z2Inv - z0Inv) / triArea;
+	
+	bool discardFragment = false;
+	//printf("TRIANGLE COORDS ARE\n V0: %f %f %f\n V1: %f %f %f\n V2: %f %f %f\n",
+	//v0.pos.x,v0.pos.y,v0.pos.z,v1.pos.x,v1.pos.y,v1.pos.z,v2.pos.x,v2.pos.y,v2.pos.z);
+	SampleRastInfo s  = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, 8, 8);//8 is the offset to the pixel center
+	SampleRastInfo s1 = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[0] + 8, sampleLocY[0] + 8);
+	SampleRastInfo s2 = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[1] + 8, sampleLocY[1] + 8);
+	SampleRastInfo s3 = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[2] + 8, sampleLocY[2] + 8);
+	SampleRastInfo s4 = prepareSample(scissor, v0.pos.xyz, v1.pos.xyz, v2.pos.xyz, sampleLocX[3] + 8, sampleLocY[3] + 8);
+	int stride = 4;
+	//triangle doesn't touch the scissor rect
+	if(s2.topY < s4.botY || s3.leftX > s1.rightX)
+		return;
+	assert(s2.topY >= s4.botY);
+	assert(s3.leftX <= s1.rightX);
+	touchTiles(context, s3.leftX, s4.botY, s1.rightX, s2.topY, stride);
+	const float farDepth = std::numeric_limits<float>::max();
+	const Vec3& clearSample = context->rtargets.clearColor.xyz;
+	for(int y = s2.topY; y >= s4.botY; y--) {
+
+		int w0 = s.w0StartRow;
+		int w1 = s.w1StartRow;
+		int w2 = s.w2StartRow;
+
+		int w0s1 = s1.w0StartRow;
+		int w1s1 = s1.w1StartRow;
+		int w2s1 = s1.w2StartRow;
+
+		int w0s2 = s2.w0StartRow;
+		int w1s2 = s2.w1StartRow;
+		int w2s2 = s2.w2StartRow;
+
+		int w0s3 = s3.w0StartRow;
+		int w1s3 = s3.w1StartRow;
+		int w2s3 = s3.w2StartRow;
+
+		int w0s4 = s4.w0StartRow;
+		int w1s4 = s4.w1StartRow;
+		int w2s4 = s4.w2StartRow;
+
+		for(int x = s3.leftX; x <= s1.rightX; x++) {
+			int coverageMask = COVERAGE_NONE;
+
+			//perform depth and coverage test for each subsample
+			if(w0s1 > 0 && w1s1 > 0 && w2s1 > 0) {
+				float zs1 = z0Inv + (w1s1 / 256.f) * Z1Z0Inv + (w2s1 / 256.f) * Z2Z0Inv;
+				zs1 = 1.f / zs1;
+				if(zs1 < zBuffer[(y * surface.width + x) * stride]) {
+					coverageMask |= COVERAGE_RIGHT_TOP;
+					zBuffer[(y * surface.width + x) * stride] = zs1;
+				}
+			}
+			if(w0s2>0 && w1s2>0 && w2s2>0) {
+				float zs2 = z0Inv + (w1s2 / 256.f) * Z1Z0Inv + (w2s2 / 256.f) * Z2Z0Inv;
+				zs2 = 1.f / zs2;
+				if(zs2 < zBuffer[(y * surface.width + x) * stride + 1]) {
+					coverageMask |= COVERAGE_LEFT_TOP;
+					zBuffer[(y * surface.width + x) * stride + 1] = zs2;
+				}
+			}
+			if(w0s3>0 && w1s3>0 && w2s3>0) {
+				float zs3 = z0Inv + (w1s3 / 256.f) * Z1Z0Inv + (w2s3 / 256.f) * Z2Z0Inv;
+				zs3 = 1.f / zs3;
+				if(zs3 < zBuffer[(y * surface.width + x) * stride + 2]) {
+					coverageMask |= COVERAGE_LEFT_BOTTOM;
+					zBuffer[(y * surface.width + x) * stride + 2] = zs3;
+				}
+			}
+			if(w0s4>0 && w1s4>0 && w2s4>0) {
+				float zs4 = z0Inv + (w1s4 / 256.f) * Z1Z0Inv + (w2s4 / 256.f) * Z2Z0Inv;
+				zs4 = 1.f / zs4;
+				if(zs4 < zBuffer[(y * surface.width + x) * stride + 3]) {
+					coverageMask |= COVERAGE_RIGHT_BOTTOM;
+					zBuffer[(y * surface.width + x) * stride + 3] = zs4;
+				}
+			}
+
+			if(coverageMask) {  
+				float Z = z0Inv + (w1 >> 8) * Z1Z0Inv + (w2 >> 8) * Z2Z0Inv;
+				Z = 1.f / Z;
+				Fragment fragment;
+				evaluateVaryings(varyings, numVaryings, (float)(w1 >> 8), (float)(w2 >> 8), Z, fragment);
+				discardFragment = false;
+				Vec3 pixelColor = ShaderStages<ShaderT>::fragmentShader(shader, fragment, varyings, discardFragment);
+				Vec3 sampleColors[4] = {};
+
+				sampleColors[0] = coverageMask & COVERAGE_RIGHT_TOP ? pixelColor :
+					zBuffer[(y * surface.width + x) * stride] == farDepth ? clearSample : cBuffer[(y * surface.width + x) * stride];
+				sampleColors[1] = coverageMask & COVERAGE_LEFT_TOP ? pixelColor :
+					zBuffer[(y * surface.width + x) * stride + 1] == farDepth ? clearSample : cBuffer[(y * surface.width + x) * stride + 1];
+				sampleColors[2] = coverageMask & COVERAGE_LEFT_BOTTOM ? pixelColor :
+					zBuffer[(y * surface.width + x) * stride + 2] == farDepth ? clearSample : cBuffer[(y * surface.width + x) * stride + 2];
+				sampleColors[3] = coverageMask & COVERAGE_RIGHT_BOTTOM ? pixelColor :
+					zBuffer[(y * surface.width + x) * stride + 3] == farDepth ? clearSample : cBuffer[(y * surface.width + x) * stride + 3];
+				pixelColor = (sampleColors[0] + sampleColors[1] + sampleColors[2] + sampleColors[3]) / 4;
+
+				cBuffer[(y * surface.width + x) * stride] = sampleColors[0];
+				cBuffer[(y * surface.width + x) * stride + 1] = sampleColors[1];
+				cBuffer[(y * surface.width + x) * stride + 2] = sampleColors[2];
+				cBuffer[(y * surface.width + x) * stride + 3] = sampleColors[3];
+				
+				if(!discardFragment)
+					drawPixel(surface, x, y, pixelColor);
+
+			}
+			
+			w0 += s.FA12;
+			w1 += s.FA20;
+			w2 += s.FA01;
+
+			w0s1 += s1.FA12;
+			w1s1 += s1.FA20;
+			w2s1 += s1.FA01;
+
+			w0s2 += s2.FA12;
+			w1s2 += s2.FA20;
+			w2s2 += s2.FA01;
+
+			w0s3 += s3.FA12;
+			w1s3 += s3.FA20;
+			w2s3 += s3.FA01;
+
+			w0s4 += s4.FA12;
+			w1s4 += s4.FA20;
+			w2s4 += s4.FA01;
+		}
+
+		s.w0StartRow -= s.FB12;
+		s.w1StartRow -= s.FB20;
+		s.w2StartRow -= s.FB01;
+
+		s1.w0StartRow -= s1.FB12;
+		s1.w1StartRow -= s1.FB20;
+		s1.w2StartRow -= s1.FB01;
+
+		s2.w0StartRow -= s2.FB12;
+		s2.w1StartRow -= s2.FB20;
+		s2.w2StartRow -= s2.FB01;
+
+		s3.w0StartRow -= s3.FB12;
+		s3.w1StartRow -= s3.FB20;
+		s3.w2StartRow -= s3.FB01;
+
+		s4.w0StartRow -= s4.FB12;
+		s4.w1StartRow -= s4.FB20;
+		s4.w2StartRow -= s4.FB01;
+	}
+}
+
+//picks the rasterizer for the draw: msaa and G-buffer writes always go per pixel, other draws shade coarse
+//when they or the rate image ask for it
+template<typename ShaderT>
+void rasterizeShadedTriangle(RenderContext* context, const ShadedVertex& v1, const ShadedVertex& v2, const ShadedVertex& v3,
+	const ShaderT& shader, VaryingBlock& varyings, bool msaa, const ScissorRect& scissor, const mat4x4& viewportTransform)
+{
+	bool deferred = context->gbuffer && shader.uniforms.in_materialId;
+	bool coarse = (shader.uniforms.in_shadingRate != SHADING_RATE_1X1 || context->shadingRateImage) && !deferred;
+	if(msaa)
+		drawTriangleHalfSpaceMSAA<ShaderT>(context, v1, v2, v3, shader, varyings, scissor, viewportTransform);
+	else if(coarse)
+		drawTriangleHalfSpaceCoarse<ShaderT>(context, v1, v2, v3, shader, varyings, scissor, viewportTransform);
+	else
+		drawTriangleHalfSpace<ShaderT>(context, v1, v2, v3, shader, varyings, scissor, viewportTransform);
+}
+
+//runs vertex shader over world space triangle, clips it and rasterizes what is left inside the scissor rect.
+//viewportTransform maps it to the screen, multi-view draws pass the one of their view
+template<typename ShaderT>
+void drawShadedTriangle(RenderContext* context, const Triangle& triangle, const ShaderT& shader, VaryingBlock& varyings, bool msaa, const ScissorRect& scissor,
+	const mat4x4& viewportTransform)
+{
+	ShadedVertex v1 = ShaderStages<ShaderT>::vertexShader(shader, triangle.v1, varyings);
+	ShadedVertex v2 = ShaderStages<ShaderT>::vertexShader(shader, triangle.v2, varyings);
+	ShadedVertex v3 = ShaderStages<ShaderT>::vertexShader(shader, triangle.v3, varyings);
+
+	//if the whole triangle inside the view frustum
+	if( isInsideViewFrustum(v1.pos) &&
+		isInsideViewFrustum(v2.pos) &&
+		isInsideViewFrustum(v3.pos)) {
+		rasterizeShadedTriangle<ShaderT>(context, v1, v2, v3, shader, varyings, msaa, scissor, viewportTransform);
+	} else {//else clip polygon, the clipper interpolates the varyings along with the positions
+		ClippResult result = clipTriangle(v1, v2, v3, ShaderStages<ShaderT>::varyingCount(shader));
+		for(size_t i = 0; i < result.numTriangles; i++) {
+			const ShadedTriangle& clipped = result.triangles[i];
+			rasterizeShadedTriangle<ShaderT>(context, clipped.v1, clipped.v2, clipped.v3, shader, varyings, msaa, scissor, viewportTransform);
+		}
+	}
+}
+
+template<typename ShaderT>
+void drawShadedTriangle(RenderContext* context, const Triangle& triangle, const ShaderT& shader, VaryingBlock& varyings, bool msaa, const ScissorRect& scissor)
+{
+	drawShadedTriangle<ShaderT>(context, triangle, shader, varyings, msaa, scissor, context->viewportTransform);
+}
+
+//calls fn with the shader cast to its dynamic type when it's one of the built-in shaders, so whatever fn rasterizes
+//gets compiled against that type. Subclasses and application shaders stay on the virtual interface
+template<typename Fn>
+void dispatchShader(const RenderContext* context, const Shader& shader, Fn fn)
+{
+	if(!context->virtualShaders) {
+		const std::type_info& type = typeid(shader);
+		if(type == typeid(FlatShader))
+			return fn(static_cast<const FlatShader&>(shader));
+		if(type == typeid(GouraudShader))
+			return fn(static_cast<const GouraudShader&>(shader));
+		if(type == typeid(PhongShader))
+			return fn(static_cast<const PhongShader&>(shader));
+		if(type == typeid(BumpShader))
+			return fn(static_cast<const BumpShader&>(shader));
+		if(type == typeid(DepthShader))
+			return fn(static_cast<const DepthShader&>(shader));
+	}
+	fn(shader);
+}
+
+#endif
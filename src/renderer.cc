@@ -1,13 +1,19 @@
 #include "renderer.h"
-#include "primitives.h"
+#include "rasterizer.h"
 #include "input.h"
 #include "clipper.h"
+#include "pipeline.h"
+#include "framewriter.h"
+#include "deferred.h"
+#include "visibility.h"
+#include "resolution.h"
+#include "quality.h"
+#include "framecache.h"
+#include "checkerboard.h"
+#include "dirtyrects.h"
 #include <stdio.h>
 #include <limits>
-
-mat4x4 viewportTransform = {};
-mat4x4 perspectiveTransform = {};
-Vec4 clearColor = {};
+#include <cstring>
 
 enum SampleCountFlagBits
 {
@@ -16,11 +22,14 @@ enum SampleCountFlagBits
 };
 static int sampleCount = SAMPLE_COUNT_4_BIT;
 
-void setRenderState(const mat4x4& viewport, const mat4x4 perspective, const Vec4& clear)
+//smaller draws aren't worth splitting into binning and band jobs
+static const uint32_t MIN_PARALLEL_FACES = 256;
+
+void setRenderState(RenderContext* context, const mat4x4& viewport, const mat4x4 perspective, const Vec4& clear)
 {
-	viewportTransform  = viewport;
-	perspectiveTransform = perspective;
-	clearColor = clear;
+	context->viewportTransform = viewport;
+	context->perspectiveTransform = perspective;
+	context->clearColor = clear;
 }
 
 bool windowClosed()
@@ -28,17 +37,140 @@ bool windowClosed()
 	return isKeyPressed(BTN_ESCAPE);
 }
 
-static void clearDepthBuffer(float* zBuffer, uint32_t width, uint32_t height)
+void clearRenderTargets(RenderTargets* targets, const Vec4& color)
+{
+	memset(targets->tileFlags, TILE_CLEARED, targets->tilesX * targets->tilesY);
+	targets->clearColor = color;
+}
+
+void resolveClearedTiles(JobSystem* jobs, RenderTargets* targets, const PixelBuffer& surface)
+{
+	uint32_t pixel = packPixel(surface.format, targets->clearColor);
+
+	parallelFor(jobs, targets->tilesY, 1, [&](uint32_t firstTileRow, uint32_t endTileRow) {
+		for(uint32_t ty = firstTileRow; ty < endTileRow; ty++) {
+			int minY = ty * RENDER_TILE_SIZE;
+			int maxY = min(minY + RENDER_TILE_SIZE, surface.height);
+			for(int tx = 0; tx < targets->tilesX; tx++) {
+				uint8_t& flags = targets->tileFlags[ty * targets->tilesX + tx];
+				if((flags & (TILE_CLEARED | TILE_RESOLVED)) != TILE_CLEARED)
+					continue;
+				int minX = tx * RENDER_TILE_SIZE;
+				int maxX = min(minX + RENDER_TILE_SIZE, surface.width);
+				for(int y = minY; y < maxY; y++) {
+					uint32_t* row = pixelRow(surface, y);
+					std::fill(row + minX, row + maxX, pixel);
+				}
+				flags |= TILE_RESOLVED;
+			}
+		}
+	});
+}
+
+bool resizeRenderTargets(RenderContext* context, RenderTargets* targets, uint32_t width, uint32_t height)
+{
+	RenderTargetPool* pool = context->targetPool;
+	targets->width = width;
+	targets->height = height;
+	targets->tilesX = (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	targets->tilesY = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	return reservePoolMemory(pool, (void**)&targets->zBuffer, width * height * sizeof(float) * sampleCount)
+		&& reservePoolMemory(pool, (void**)&targets->cBuffer, width * height * sizeof(Vec3) * sampleCount)//3 as 3 color channels
+		&& reservePoolMemory(pool, (void**)&targets->tileFlags, targets->tilesX * targets->tilesY);
+}
+
+void releaseRenderTargets(RenderContext* context, RenderTargets* targets)
+{
+	releasePoolMemory(context->targetPool, targets->zBuffer);
+	releasePoolMemory(context->targetPool, targets->cBuffer);
+	releasePoolMemory(context->targetPool, targets->tileFlags);
+	*targets = {};
+}
+
+uint32_t rasterBandCount(const RenderContext* context)
+{
+	//a couple of bands per thread lets idle threads steal from the busy parts of the screen
+	uint32_t numThreads = jobThreadCount(context->jobs);
+	return numThreads > 1 ? numThreads * 2 : 1;
+}
+
+int rasterBandHeight(const RenderContext* context, uint32_t numBands)
+{
+	int bandHeight = (context->window.height + numBands - 1) / numBands;
+	return (bandHeight + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+}
+
+//draws replayed by the frame cache only render the region that changed, an empty rect is left when they don't overlap
+static ScissorRect clipToReplayRect(const RenderContext* context, const ScissorRect& rect)
+{
+	if(!context->frameCache || !context->frameCache->replaying)
+		return rect;
+	const ScissorRect& replay = context->frameCache->replayRect;
+	return ScissorRect{max(rect.minX, replay.minX), max(rect.minY, replay.minY), min(rect.maxX, replay.maxX), min(rect.maxY, replay.maxY)};
+}
+
+ScissorRect rasterBandRect(const RenderContext* context, uint32_t band, uint32_t numBands)
+{
+	int bandHeight = rasterBandHeight(context, numBands);
+	ScissorRect rect = {0, (int)band * bandHeight, context->window.width - 1, min((int)(band + 1) * bandHeight, context->window.height) - 1};
+	return clipToReplayRect(context, rect);
+}
+
+//everything but the presentation backend
+static bool initRenderer(RenderContext* context, uint32_t width, uint32_t height, const JobSystemConfig& jobConfig)
 {
-	std::fill(zBuffer, zBuffer + width * height * sampleCount, std::numeric_limits<float>::max());
+	context->window.width = width;
+	context->window.height = height;
+	context->viewportTransform = viewport(width, height);
+
+	context->targetPool = createRenderTargetPool();
+	if(!resizeRenderTargets(context, &context->rtargets, width, height))
+		return false;
+	context->jobs = createJobSystem(jobConfig);
+
+	clearRenderTargets(&context->rtargets, context->clearColor);
+	return true;
 }
 
-static void clearColorBuffer(Vec3* cBuffer, uint32_t width, uint32_t height)
+//what frames end up in, the context surface unless it's an internal dynamic resolution target
+static PixelBuffer& presentSurface(RenderContext* context)
 {
-	std::fill(cBuffer, cBuffer + width * height * sampleCount, clearColor.xyz);
+	return context->dynamicResolution ? context->dynamicResolution->output : context->surface;
 }
 
-bool createSoftwareRenderer(RenderContext* context, const char* title, uint32_t width, uint32_t height)
+#ifdef SOFTY_WITH_SDL
+static bool wrapWindowSurface(RenderContext* context)
+{
+	SDL_Surface* surface = SDL_GetWindowSurface(context->window.window);
+	if(!surface) {
+		printf("Failed to get window surface!\n");
+		return false;
+	}
+
+	PixelBuffer& buffer = presentSurface(context);
+	switch(surface->format->format) {
+		case SDL_PIXELFORMAT_ARGB8888 :
+		case SDL_PIXELFORMAT_RGB888 :
+			buffer.format = PIXEL_FORMAT_ARGB8888;
+			break;
+		case SDL_PIXELFORMAT_ABGR8888 :
+		case SDL_PIXELFORMAT_BGR888 :
+			buffer.format = PIXEL_FORMAT_ABGR8888;
+			break;
+		default :
+			printf("Unsupported window surface format!\n");
+			return false;
+	}
+
+	context->window.surface = surface;
+	buffer.pixels = surface->pixels;
+	buffer.width = surface->w;
+	buffer.height = surface->h;
+	buffer.pitch = surface->pitch;
+	return true;
+}
+
+bool createSoftwareRenderer(RenderContext* context, const char* title, uint32_t width, uint32_t height, const JobSystemConfig& jobConfig)
 {
   	SDL_Init(SDL_INIT_VIDEO);
 
@@ -64,61 +196,245 @@ bool createSoftwareRenderer(RenderContext* context, const char* title, uint32_t
 		return false;
 	}
 
-	SDL_Surface *surface = SDL_GetWindowSurface(window);
-
 	context->window.window = window;
-	context->surface = surface;
-	context->window.width = width;
-	context->window.height = height;
-
-	float* ptr = (float*)malloc(width * height * sizeof(float) * sampleCount);
-	if(!ptr)
+	if(!wrapWindowSurface(context))
 		return false;
 
-	Vec3* cptr = (Vec3*)malloc(width * height * sizeof(Vec3) * sampleCount);//3 as 3 color channels
-	if(!cptr)
+	return initRenderer(context, width, height, jobConfig);
+}
+#endif
+
+bool createOffscreenRenderer(RenderContext* context, uint32_t width, uint32_t height, PixelFormat format,
+	void* pixels, uint32_t pitch, const JobSystemConfig& jobConfig)
+{
+	if(!initRenderer(context, width, height, jobConfig))
 		return false;
 
-	context->rtargets.zBuffer = ptr;
-	context->rtargets.cBuffer = cptr;
+	context->offscreen = true;
+	if(!pixels) {
+		context->ownedPixels = acquirePoolMemory(context->targetPool, width * height * sizeof(uint32_t));
+		if(!context->ownedPixels)
+			return false;
+		pixels = context->ownedPixels;
+		pitch = 0;
+	}
 
-	clearDepthBuffer(context->rtargets.zBuffer, width, height);
-	clearColorBuffer(context->rtargets.cBuffer, width, height);
+	PixelBuffer& buffer = context->surface;
+	buffer.pixels = pixels;
+	buffer.width = width;
+	buffer.height = height;
+	buffer.pitch = pitch ? pitch : width * sizeof(uint32_t);
+	buffer.format = format;
 	return true;
 }
 
+bool setFramesInFlight(RenderContext* context, uint32_t framesInFlight)
+{
+	if(context->pipeline)
+		destroyFramePipeline(context);
+	if(framesInFlight)
+		context->pipeline = createFramePipeline(context, framesInFlight);
+	return framesInFlight == 0 || context->pipeline;
+}
+
+bool setDeferredShading(RenderContext* context, bool enabled)
+{
+	if(enabled && context->visibility)
+		return false;
+	//frames in flight may still write the G-buffer
+	if(context->pipeline)
+		drainFramePipeline(context);
+
+	if(!enabled) {
+		if(context->gbuffer) {
+			releaseGBuffer(context, context->gbuffer);
+			delete context->gbuffer;
+			context->gbuffer = nullptr;
+		}
+		return true;
+	}
+
+	if(!context->gbuffer)
+		context->gbuffer = new GBuffer();
+	return resizeGBuffer(context, context->gbuffer, context->window.width, context->window.height);
+}
+
+bool setVisibilityBuffer(RenderContext* context, bool enabled)
+{
+	if(!enabled) {
+		if(context->visibility) {
+			releaseVisibilityBuffer(context, context->visibility);
+			delete context->visibility;
+			context->visibility = nullptr;
+		}
+		return true;
+	}
+
+	if(context->gbuffer)
+		return false;
+	//pipelined frames clear ids of the tiles they touch
+	if(context->pipeline)
+		drainFramePipeline(context);
+	if(!context->visibility)
+		context->visibility = new VisibilityBuffer();
+	return resizeVisibilityBuffer(context, context->visibility, context->window.width, context->window.height);
+}
+
+bool setDynamicResolution(RenderContext* context, const DynamicResolutionConfig* config)
+{
+	//frames in flight present into the output
+	if(context->pipeline)
+		drainFramePipeline(context);
+	if(context->dynamicResolution)
+		destroyDynamicResolution(context);
+	return !config || createDynamicResolution(context, *config);
+}
+
+bool setAdaptiveQuality(RenderContext* context, const AdaptiveQualityConfig* config)
+{
+	//frames in flight keep the level they were recorded with
+	if(context->adaptiveQuality)
+		destroyAdaptiveQuality(context);
+	return !config || createAdaptiveQuality(context, *config);
+}
+
+bool setFrameCache(RenderContext* context, bool enabled)
+{
+	//the raster thread reads the replay rect through rasterBandRect
+	if(context->pipeline)
+		drainFramePipeline(context);
+	if(context->frameCache)
+		destroyFrameCache(context);
+	return !enabled || createFrameCache(context);
+}
+
+void invalidateFrameCache(RenderContext* context)
+{
+	if(context->frameCache)
+		context->frameCache->valid = false;
+}
+
+bool setCheckerboardRendering(RenderContext* context, bool enabled)
+{
+	//the raster thread reads the parity
+	if(context->pipeline)
+		drainFramePipeline(context);
+	if(context->checkerboard)
+		destroyCheckerboard(context);
+	return !enabled || createCheckerboard(context);
+}
+
+bool setDirtyRectPresentation(RenderContext* context, bool enabled)
+{
+	//the raster thread presents pipelined frames
+	if(context->pipeline)
+		drainFramePipeline(context);
+	if(context->dirtyRects)
+		destroyDirtyRects(context);
+	return !enabled || createDirtyRects(context);
+}
+
+const DirtyRect* lastDirtyRects(const RenderContext* context, uint32_t* numRects)
+{
+	const DirtyRects* dirty = context->dirtyRects;
+	if(!dirty || dirty->full) {
+		*numRects = 0;
+		return nullptr;
+	}
+	*numRects = dirty->rects.size();
+	return dirty->rects.data();
+}
+
+bool msaaEnabled(const RenderContext* context)
+{
+	return context->frameMsaa;
+}
 
 void destroySoftwareRenderer(RenderContext* context)
 {
-  	SDL_DestroyWindow(context->window.window);
-  	SDL_Quit();
+	if(context->pipeline)
+		destroyFramePipeline(context);
+	setDeferredShading(context, false);
+	setVisibilityBuffer(context, false);
+	setDynamicResolution(context, nullptr);
+	setAdaptiveQuality(context, nullptr);
+	setFrameCache(context, false);
+	setCheckerboardRendering(context, false);
+	setDirtyRectPresentation(context, false);
+	destroyJobSystem(context->jobs);
+	releaseRenderTargets(context, &context->rtargets);
+	releasePoolMemory(context->targetPool, context->ownedPixels);
+	destroyRenderTargetPool(context->targetPool);
+#ifdef SOFTY_WITH_SDL
+	if(!context->offscreen) {
+	  	SDL_DestroyWindow(context->window.window);
+	  	SDL_Quit();
+	}
+#endif
 }
 
 void beginFrame(RenderContext* context)
 {
-	//if window has been resized
-	if(context->surface->w != context->window.width || context->surface->h != context->window.height) {
-		context->window.width = context->surface->w;
-		context->window.height = context->surface->h;
-		free(context->rtargets.zBuffer);
-		free(context->rtargets.cBuffer);
-		float* ptr = (float*)malloc(context->window.width * context->window.height * sizeof(float) * sampleCount);
-		Vec3* cptr = (Vec3*)malloc(context->window.width * context->window.height * sizeof(Vec3) * sampleCount);//3 as 3 color channels
-		assert(ptr);
-		assert(cptr);
-		context->rtargets.zBuffer = ptr;
-		context->rtargets.cBuffer = cptr;
-		viewportTransform = viewport(context->window.width, context->window.height);
-	}
-
-	clearDepthBuffer(context->rtargets.zBuffer, context->window.width, context->window.height);
-	clearColorBuffer(context->rtargets.cBuffer, context->window.width, context->window.height);
-	SDL_FillRect(context->surface, NULL, SDL_MapRGBA(context->surface->format,
-		clearColor.R,
-		clearColor.G,
-		clearColor.B,
-		clearColor.A)
-	);
+#ifdef SOFTY_WITH_SDL
+	//window surface gets recreated on resize, the old one stays alive until it's asked for again
+	if(!context->offscreen) {
+		int width = 0;
+		int height = 0;
+		SDL_GetWindowSize(context->window.window, &width, &height);
+		if(width != presentSurface(context).width || height != presentSurface(context).height) {
+			if(context->pipeline)
+				drainFramePipeline(context);
+			bool wrapped = wrapWindowSurface(context);
+			assert(wrapped);
+			(void)wrapped;
+		}
+	}
+#endif
+
+	if(context->dynamicResolution) {
+		bool applied = applyDynamicResolution(context);
+		assert(applied);
+		(void)applied;
+	}
+
+	//if window has been resized or the render size changed
+	if(context->surface.width != context->window.width || context->surface.height != context->window.height) {
+		//frames in flight still use the old targets
+		if(context->pipeline)
+			drainFramePipeline(context);
+		context->window.width = context->surface.width;
+		context->window.height = context->surface.height;
+		bool allocated = resizeRenderTargets(context, &context->rtargets, context->window.width, context->window.height)
+			&& (!context->gbuffer || resizeGBuffer(context, context->gbuffer, context->window.width, context->window.height))
+			&& (!context->visibility || resizeVisibilityBuffer(context, context->visibility, context->window.width, context->window.height));
+		assert(allocated);
+		(void)allocated;
+		context->viewportTransform = viewport(context->window.width, context->window.height);
+	}
+
+	if(context->gbuffer)
+		context->gbuffer->recording.materials.clear();
+
+	//quality level changes made by endFrame take effect from here
+	context->frameMsaa = (context->quality.msaa || isKeyPressed(BTN_G)) && !context->gbuffer;
+
+	if(context->checkerboard)
+		beginCheckerboardFrame(context);
+
+	//cached frames keep the previous frame in the targets until endFrame knows what changed
+	bool cached = context->frameCache && beginCachedFrame(context);
+
+	//in pipelined mode targets are cleared by the raster thread. Without memory for frame surfaces of the new size
+	//rendering goes on without frames in flight
+	if(context->pipeline) {
+		if(pipelineBeginFrame(context))
+			return;
+		printf("Falling back to immediate mode rendering\n");
+		destroyFramePipeline(context);
+	}
+
+	if(!cached)
+		clearRenderTargets(&context->rtargets, context->clearColor);
 }
 
 static Triangle getTriangle(const Mesh& mesh, const Face& face)
@@ -149,83 +465,728 @@ static Triangle getTriangle(const Mesh& mesh, const Face& face)
 	return out;
 }
 
-void renderObject(RenderContext* context, const RenderObject& object, const Camera& camera, Shader& shader)
+mat4x4 computeModelTransform(const Transform& transform)
+{
+	return composeTransform(transform.scale, transform.rotate, transform.translate);
+}
+
+//quality settings reach the shaders with the rest of the draw's uniforms
+static void setQualityUniforms(const RenderContext* context, ShaderUniforms& uniforms)
+{
+	uniforms.in_parallaxLayers = context->quality.parallaxLayers;
+	uniforms.in_specular = context->quality.specular;
+}
+
+//picks the coarsest lod whose error projected on screen stays below the context threshold
+static const std::vector<Face>& selectLodFaces(const RenderContext* context, const Mesh& mesh, const mat4x4& modelToWorld, const Camera& camera)
+{
+	if(mesh.lods.empty() || context->lodErrorThreshold <= 0.f)
+		return mesh.faces;
+
+	float scale = max(max(lengthVec3(modelToWorld.rows[0].xyz), lengthVec3(modelToWorld.rows[1].xyz)), lengthVec3(modelToWorld.rows[2].xyz));
+	Vec3 center = (homogenize(centerAABB(mesh.bounds)) * modelToWorld).xyz;
+	float radius = lengthVec3(mesh.bounds.max - mesh.bounds.min) * 0.5f * scale;
+	float distance = lengthVec3(center - camera.camPos) - radius;
+	if(distance <= 0.f)
+		return mesh.faces;
+
+	//world space units to pixels at the closest point of the bounding sphere
+	float pixelsPerUnit = context->window.height * 0.5f * context->perspectiveTransform.p[5] / distance;
+	const std::vector<Face>* faces = &mesh.faces;
+	for(const MeshLod& lod : mesh.lods) {
+		if(lod.error * scale * pixelsPerUnit > context->lodErrorThreshold)
+			break;
+		faces = &lod.faces;
+	}
+	return *faces;
+}
+
+static ScissorRect fullScreenRect(const RenderContext* context)
+{
+	return clipToReplayRect(context, ScissorRect{0, 0, context->window.width - 1, context->window.height - 1});
+}
+
+bool renderObject(RenderContext* context, const RenderObject& object, const Camera& camera, Shader& shader)
+{
+	return renderObject(context, object, computeModelTransform(object.transform), camera, shader);
+}
+
+//world space triangle of a face with its unit normal and centroid
+static void transformFace(const Mesh& mesh, const Face& face, const mat4x4& modelToWorldTransform, Triangle* out, Vec3* faceNormal, Vec3* centroid)
+{
+	Triangle input = getTriangle(mesh, face);
+	*out = input;
+
+	out->v1.pos = input.v1.pos * modelToWorldTransform;
+	out->v2.pos = input.v2.pos * modelToWorldTransform;
+	out->v3.pos = input.v3.pos * modelToWorldTransform;
+
+	Vec4& v1 = out->v1.pos;
+	Vec4& v2 = out->v2.pos;
+	Vec4& v3 = out->v3.pos;
+
+	Vec3 firstFaceEdge =  v2.xyz - v1.xyz;
+	Vec3 secondFaceEdge = v3.xyz - v1.xyz;
+	*faceNormal = normaliseVec3(cross(firstFaceEdge, secondFaceEdge));
+	*centroid = (v1.xyz + v2.xyz + v3.xyz) * 0.333f;
+}
+
+//flat lighting terms of a face seen from cameraPosition, false for back faces
+static bool faceLighting(const Vec3& faceNormal, const Vec3& centroid, const Vec3& cameraPosition, float* lightIntensity, Vec3* cameraRay)
+{
+	//the triangle is more lid the more it's normal is aligned with the light direction
+	*cameraRay = normaliseVec3(cameraPosition - centroid);
+	*lightIntensity = dotVec3(*cameraRay, faceNormal);
+
+	//backface culling
+	return *lightIntensity >= 0.f;
+}
+
+//world space triangle of a face plus its flat lighting terms, false for back faces
+static bool setupFace(const Mesh& mesh, const Face& face, const mat4x4& modelToWorldTransform, const Camera& camera,
+	Triangle* out, float* lightIntensity, Vec3* cameraRay)
+{
+	Vec3 faceNormal = {};
+	Vec3 centroid = {};
+	transformFace(mesh, face, modelToWorldTransform, out, &faceNormal, &centroid);
+	return faceLighting(faceNormal, centroid, camera.camPos, lightIntensity, cameraRay);
+}
+
+struct BinnedTriangle
+{
+	Triangle triangle;
+	Vec3 centerView;
+	float lightIntensity;
+	int botY;
+	int topY;//!<-1 for culled faces
+};
+
+//vertex setup and binning run over chunks of faces, then each band rasterizes the triangles touching it in face order
+template<typename ShaderT>
+static void renderFacesInBands(RenderContext* context, const RenderObject& object, const std::vector<Face>& faces,
+	const mat4x4& modelToWorldTransform, const Camera& camera, const ShaderT& shader, bool msaa)
+{
+	uint32_t numBands = rasterBandCount(context);
+	mat4x4 VP = shader.uniforms.in_VP;
+	std::vector<BinnedTriangle> binned(faces.size());
+	parallelFor(context->jobs, faces.size(), 64, [&](uint32_t first, uint32_t end) {
+		for(uint32_t i = first; i < end; i++) {
+			BinnedTriangle& out = binned[i];
+			out.topY = -1;
+			if(setupFace(*object.mesh, faces[i], modelToWorldTransform, camera, &out.triangle, &out.lightIntensity, &out.centerView)
+				&& !triangleScreenRows(context, out.triangle, VP, &out.botY, &out.topY))
+				out.topY = -1;
+		}
+	});
+
+	//every band shares the shader, per triangle state stays in the band's varying block
+	parallelFor(context->jobs, numBands, 1, [&](uint32_t first, uint32_t end) {
+		VaryingBlock varyings;
+		for(uint32_t band = first; band < end; band++) {
+			ScissorRect scissor = rasterBandRect(context, band, numBands);
+			if(scissor.minY > scissor.maxY || scissor.minX > scissor.maxX)
+				continue;
+			for(const BinnedTriangle& triangle : binned) {
+				if(triangle.topY < scissor.minY || triangle.botY > scissor.maxY)
+					continue;
+				varyings.lightIntensity = triangle.lightIntensity;
+				varyings.centerView = triangle.centerView;
+				drawShadedTriangle(context, triangle.triangle, shader, varyings, msaa, scissor);
+			}
+		}
+	});
+}
+
+template<typename ShaderT>
+static void renderFaces(RenderContext* context, const RenderObject& object, const std::vector<Face>& faces,
+	const mat4x4& modelToWorldTransform, const Camera& camera, const ShaderT& shader, bool msaa)
+{
+	if(faces.size() >= MIN_PARALLEL_FACES && rasterBandCount(context) > 1) {
+		renderFacesInBands(context, object, faces, modelToWorldTransform, camera, shader, msaa);
+		return;
+	}
+
+	ScissorRect scissor = fullScreenRect(context);
+	Triangle out = {};
+	VaryingBlock varyings;
+	for(uint32_t i = 0; i < faces.size(); i++) {
+		if(setupFace(*object.mesh, faces[i], modelToWorldTransform, camera, &out, &varyings.lightIntensity, &varyings.centerView))
+			drawShadedTriangle(context, out, shader, varyings, msaa, scissor);
+	}//main face loop
+}
+
+//records the faces with a snapshot of the shader and rasterizes their ids in bands, shading waits for endFrame.
+//False for shaders without a snapshot, the buffer is resolved so far then and they have to shade forward
+static bool renderFacesVisibility(RenderContext* context, const Mesh& mesh, const std::vector<Face>& faces,
+	const mat4x4& modelToWorldTransform, const Camera& camera, const Shader& shader, const mat4x4& VP, bool msaa)
+{
+	VisibilityBuffer* visibility = context->visibility;
+	uint32_t numBands = rasterBandCount(context);
+
+	//draws with more faces than an id can address are split
+	for(uint32_t firstFace = 0; firstFace < faces.size(); firstFace += VISIBILITY_MAX_TRIANGLES) {
+		uint32_t numFaces = min((uint32_t)faces.size() - firstFace, VISIBILITY_MAX_TRIANGLES);
+		//out of draw ids, shade what's there and start over
+		if(visibility->draws.size() == VISIBILITY_MAX_DRAWS)
+			resolveVisibilityBuffer(context, msaa);
+
+		uint32_t draw = visibility->draws.size();
+		uint32_t firstTriangle = visibility->triangles.size();
+		VisibilityDraw recorded = {shader.clone(), firstTriangle};
+		//samples still holding ids would be shaded over the forward pixels in front of them
+		if(!recorded.shader) {
+			resolveVisibilityBuffer(context, msaa);
+			return false;
+		}
+		visibility->draws.push_back(recorded);
+		visibility->triangles.resize(firstTriangle + numFaces);
+
+		std::vector<int> botRows(numFaces);
+		std::vector<int> topRows(numFaces);
+		parallelFor(context->jobs, numFaces, 64, [&](uint32_t first, uint32_t end) {
+			for(uint32_t i = first; i < end; i++) {
+				VisibilityTriangle& out = visibility->triangles[firstTriangle + i];
+				topRows[i] = -1;
+				if(setupFace(mesh, faces[firstFace + i], modelToWorldTransform, camera, &out.triangle, &out.lightIntensity, &out.centerView)
+					&& !triangleScreenRows(context, out.triangle, VP, &botRows[i], &topRows[i]))
+					topRows[i] = -1;
+			}
+		});
+
+		parallelFor(context->jobs, numBands, 1, [&](uint32_t first, uint32_t end) {
+			for(uint32_t band = first; band < end; band++) {
+				ScissorRect scissor = rasterBandRect(context, band, numBands);
+				for(uint32_t i = 0; i < numFaces; i++) {
+					if(topRows[i] < scissor.minY || botRows[i] > scissor.maxY)
+						continue;
+					drawVisibilityTriangle(context, visibility->triangles[firstTriangle + i].triangle, VP, packVisibilityId(draw, i), msaa, scissor);
+				}
+			}
+		});
+	}
+	return true;
+}
+
+bool renderObject(RenderContext* context, const RenderObject& object, const mat4x4& modelToWorldTransform, const Camera& camera, Shader& shader)
 {
-	mat4x4 modelToWorldTransform =  loadScale(object.transform.scale) * loadTranslation(object.transform.translate);
-	mat4x4 VP = camera.worldToCameraTransform * perspectiveTransform;
+	//rasterized in endFrame, if at all
+	if(context->frameCache && recordCachedDraw(context, object, modelToWorldTransform, camera, shader))
+		return true;
+
+	const std::vector<Face>& faces = selectLodFaces(context, *object.mesh, modelToWorldTransform, camera);
+	mat4x4 VP = camera.worldToCameraTransform * context->perspectiveTransform;
 	mat4x4 normalTransform = inverse(transpose(modelToWorldTransform));
+	bool msaa = msaaEnabled(context);
 
 	shader.uniforms.in_VP = VP;
 	shader.uniforms.in_normalTransform = normalTransform;
 	shader.uniforms.in_cameraPosition = camera.camPos;
+	shader.uniforms.in_materialId = context->gbuffer ? registerDeferredMaterial(context, shader, inverse(VP), camera.camPos) : 0;
+	setQualityUniforms(context, shader.uniforms);
+	if(context->checkerboard)
+		context->checkerboard->recordingVP = VP;
+
+	Triangle out = {};
+	float lightIntensity = 0.f;
+	Vec3 cameraRay = {};
+
+	if(context->pipeline) {
+		uint32_t recordedDraw = 0;
+		if(!pipelineRecordDraw(context, shader, &recordedDraw))
+			return false;
+		for(uint32_t i = 0; i < faces.size(); i++) {
+			if(setupFace(*object.mesh, faces[i], modelToWorldTransform, camera, &out, &lightIntensity, &cameraRay))
+				pipelineRecordTriangle(context, recordedDraw, out, lightIntensity, cameraRay, VP);
+		}
+		return true;
+	}
 
-	for(uint32_t i = 0; i < object.mesh->faces.size(); i++) {
+	if(context->visibility && renderFacesVisibility(context, *object.mesh, faces, modelToWorldTransform, camera, shader, VP, msaa))
+		return true;
 
-		Triangle input = getTriangle(*object.mesh, object.mesh->faces[i]);
-		Triangle out = input;
+	dispatchShader(context, shader, [&](const auto& typedShader) {
+		renderFaces(context, object, faces, modelToWorldTransform, camera, typedShader, msaa);
+	});
+	return true;
+}
 
-		out.v1.pos = input.v1.pos * modelToWorldTransform;
-		out.v2.pos = input.v2.pos * modelToWorldTransform;
-		out.v3.pos = input.v3.pos * modelToWorldTransform;
+//object space face data shared by all instances
+struct FaceData
+{
+	Triangle triangle;
+	Vec3 normal;
+	Vec3 centroid;
+};
 
-		Vec4& v1 = out.v1.pos;
-		Vec4& v2 = out.v2.pos;
-		Vec4& v3 = out.v3.pos;
+struct InstanceData
+{
+	mat4x4 modelToWorld;
+	mat4x4 normalTransform;
+	Vec3 localCameraPos;
+	float handedness;//!<-1 for mirroring transforms, flips backface test
+	int lod;//!<0 is the full detail mesh, -1 culled instance
+	int topY;
+	int botY;
+};
 
-		Vec3 firstFaceEdge =  v2.xyz - v1.xyz;
-		Vec3 secondFaceEdge = v3.xyz - v1.xyz;
-		Vec3 faceNormal = normaliseVec3(cross(firstFaceEdge, secondFaceEdge));
+static void decodeFaces(const Mesh& mesh, const std::vector<Face>& faces, std::vector<FaceData>& out)
+{
+	out.resize(faces.size());
+	for(uint32_t i = 0; i < faces.size(); i++) {
+		FaceData& data = out[i];
+		data.triangle = getTriangle(mesh, faces[i]);
+		const Vec3& v1 = data.triangle.v1.pos.xyz;
+		const Vec3& v2 = data.triangle.v2.pos.xyz;
+		const Vec3& v3 = data.triangle.v3.pos.xyz;
+		data.normal = cross(v2 - v1, v3 - v1);
+		data.centroid = (v1 + v2 + v3) * 0.333f;
+	}
+}
 
-		Vec3 centroid = (v1.xyz + v2.xyz + v3.xyz) * 0.333f;
-		//the triangle is more lid the more it's normal is aligned with the light direction
+static void prepareInstance(const RenderContext* context, const Mesh& mesh, const AABB& bounds, const Camera& camera,
+	const mat4x4& VP, const Transform& transform, InstanceData& out)
+{
+	out.modelToWorld = computeModelTransform(transform);
+	out.normalTransform = inverse(transpose(out.modelToWorld));
+	out.localCameraPos = (homogenize(camera.camPos) * inverse(out.modelToWorld)).xyz;
+	mat3x3 linear = {};
+	for(uint8_t i = 0; i < 3; i++)
+		linear.rows[i] = out.modelToWorld.rows[i].xyz;
+	out.handedness = dotVec3(linear.firstRow, cross(linear.secondRow, linear.thirdRow)) < 0.f ? -1.f : 1.f;
+
+	//screen rows covered by the instance bounds, used to skip bands it doesn't touch
+	out.botY = 0;
+	out.topY = context->window.height - 1;
+	uint8_t outsideMask = 0x3f;
+	bool behindCamera = false;
+	float minY = std::numeric_limits<float>::max();
+	float maxY = -std::numeric_limits<float>::max();
+	AABB worldBounds = transformAABB(bounds, out.modelToWorld);
+	for(uint8_t i = 0; i < 8; i++) {
+		Vec4 corner = {
+			i & 1 ? worldBounds.max.x : worldBounds.min.x,
+			i & 2 ? worldBounds.max.y : worldBounds.min.y,
+			i & 4 ? worldBounds.max.z : worldBounds.min.z,
+			1.f
+		};
+		corner *= VP;
+		outsideMask &= frustumOutcode(corner);
+		if(corner.w <= 0.f) {
+			behindCamera = true;
+			continue;
+		}
+		float screenY = (perspectiveDivide(corner) * context->viewportTransform).y;
+		minY = min(minY, screenY);
+		maxY = max(maxY, screenY);
+	}
+
+	//all corners are outside of the same frustum plane
+	if(outsideMask) {
+		out.lod = -1;
+		return;
+	}
+
+	if(!behindCamera) {
+		out.botY = max((int)minY - 1, 0);
+		out.topY = min((int)maxY + 1, context->window.height - 1);
+	}
+
+	const std::vector<Face>& faces = selectLodFaces(context, mesh, out.modelToWorld, camera);
+	out.lod = 0;
+	for(uint32_t i = 0; i < mesh.lods.size(); i++) {
+		if(&faces == &mesh.lods[i].faces)
+			out.lod = i + 1;
+	}
+}
+
+template<typename ShaderT>
+static void renderInstanceFaces(RenderContext* context, const std::vector<FaceData>& faces, const InstanceData& instance,
+	const Camera& camera, const ShaderT& shader, const mat4x4& VP, bool msaa, const ScissorRect& scissor)
+{
+	VaryingBlock varyings;
+	for(const FaceData& face : faces) {
+		//backface culling in object space
+		if(dotVec3(instance.localCameraPos - face.centroid, face.normal) * instance.handedness < 0.f)
+			continue;
+
+		Triangle out = face.triangle;
+		out.v1.pos *= instance.modelToWorld;
+		out.v2.pos *= instance.modelToWorld;
+		out.v3.pos *= instance.modelToWorld;
+
+		//skip triangles that are entirely above or below the band
+		int botY = 0;
+		int topY = 0;
+		if(!triangleScreenRows(context, out, VP, &botY, &topY) || topY < scissor.minY || botY > scissor.maxY)
+			continue;
+
+		Vec3 faceNormal = normaliseVec3(cross(out.v2.pos.xyz - out.v1.pos.xyz, out.v3.pos.xyz - out.v1.pos.xyz));
+		Vec3 centroid = (out.v1.pos.xyz + out.v2.pos.xyz + out.v3.pos.xyz) * 0.333f;
 		Vec3 cameraRay = normaliseVec3(camera.camPos - centroid);
-		float lightIntensity = dotVec3(cameraRay, faceNormal);
-
-		//backface culling
-		if(lightIntensity >= 0.f) {
-			////////////////////////////////////////
-			shader.uniforms.in_lightIntensity = lightIntensity;
-			shader.uniforms.in_centerView = cameraRay;
-
-			out.v1.texCoords = input.v1.texCoords;
-			out.v2.texCoords = input.v2.texCoords;
-			out.v3.texCoords = input.v3.texCoords;
-
-			out.v1 = shader.vertexShader(out.v1, 0);
-			out.v2 = shader.vertexShader(out.v2, 1);
-			out.v3 = shader.vertexShader(out.v3, 2);
-
-			//if the whole triangle inside the view frustum
-			if( isInsideViewFrustum(out.v1.pos) &&
-				isInsideViewFrustum(out.v2.pos) &&
-				isInsideViewFrustum(out.v3.pos)) {
-				if(isKeyPressed(BTN_G))
-					drawTriangleHalfSpaceMSAA(context, out.v1, out.v2, out.v3, shader);
-				else
-					drawTriangleHalfSpace(context, out.v1, out.v2, out.v3, shader);
-			} else {//else clip polygon
-				ClippResult result = clipTriangle(out.v1, out.v2, out.v3);
-				for(size_t i = 0; i < result.numTriangles; i++) {
-					Triangle& triangle = result.triangles[i];
-					//Ugliest durtiest hack to keep shader interpolants correct after clipping
-					triangle.v1.pos *= inverse(VP);
-					triangle.v2.pos *= inverse(VP);
-					triangle.v3.pos *= inverse(VP);
-					triangle.v1 = shader.vertexShader(triangle.v1, 0);
-					triangle.v2 = shader.vertexShader(triangle.v2, 1);
-					triangle.v3 = shader.vertexShader(triangle.v3, 2);
-					if(isKeyPressed(BTN_G))
-						drawTriangleHalfSpaceMSAA(context, triangle.v1, triangle.v2, triangle.v3, shader);
-					else
-						drawTriangleHalfSpace(context, triangle.v1, triangle.v2, triangle.v3, shader);
-				}
+		varyings.lightIntensity = max(0.f, dotVec3(cameraRay, faceNormal));
+		varyings.centerView = cameraRay;
+		drawShadedTriangle(context, out, shader, varyings, msaa, scissor);
+	}
+}
+
+static void renderInstancesInBand(RenderContext* context, const std::vector<std::vector<FaceData>>& lodFaces,
+	const std::vector<InstanceData>& instances, const Camera& camera, Shader& shader, bool msaa, const ScissorRect& scissor)
+{
+	mat4x4 VP = camera.worldToCameraTransform * context->perspectiveTransform;
+	shader.uniforms.in_VP = VP;
+	shader.uniforms.in_cameraPosition = camera.camPos;
+
+	for(const InstanceData& instance : instances) {
+		if(instance.lod < 0 || instance.topY < scissor.minY || instance.botY > scissor.maxY)
+			continue;
+
+		shader.uniforms.in_normalTransform = instance.normalTransform;
+		dispatchShader(context, shader, [&](const auto& typedShader) {
+			renderInstanceFaces(context, lodFaces[instance.lod], instance, camera, typedShader, VP, msaa, scissor);
+		});
+	}
+}
+
+void renderObjectInstanced(RenderContext* context, const Mesh& mesh, const Camera& camera, Shader& shader, const Transform* instances, uint32_t numInstances)
+{
+	if(!numInstances)
+		return;
+
+	//recorded frames and visibility buffer draws are already binned and rasterized in parallel, just go through the regular path.
+	//The frame cache tracks instances as separate draws
+	if(context->pipeline || context->visibility || recordingCachedDraws(context)) {
+		RenderObject object = {};
+		object.mesh = const_cast<Mesh*>(&mesh);
+		for(uint32_t i = 0; i < numInstances; i++) {
+			if(!renderObject(context, object, computeModelTransform(instances[i]), camera, shader))
+				return;
+		}
+		return;
+	}
+
+	mat4x4 VP = camera.worldToCameraTransform * context->perspectiveTransform;
+	AABB bounds = mesh.lods.empty() ? computeMeshBounds(mesh) : mesh.bounds;
+	bool msaa = msaaEnabled(context);
+	//set before the band shaders are cloned
+	shader.uniforms.in_materialId = context->gbuffer ? registerDeferredMaterial(context, shader, inverse(VP), camera.camPos) : 0;
+	setQualityUniforms(context, shader.uniforms);
+	if(context->checkerboard)
+		context->checkerboard->recordingVP = VP;
+
+	//per instance setup
+	std::vector<InstanceData> instanceData(numInstances);
+	parallelFor(context->jobs, numInstances, 16, [&](uint32_t first, uint32_t end) {
+		for(uint32_t i = first; i < end; i++)
+			prepareInstance(context, mesh, bounds, camera, VP, instances[i], instanceData[i]);
+	});
+
+	//decode only lod levels somebody is going to draw
+	std::vector<std::vector<FaceData>> lodFaces(mesh.lods.size() + 1);
+	for(const InstanceData& instance : instanceData) {
+		if(instance.lod >= 0 && lodFaces[instance.lod].empty())
+			decodeFaces(mesh, instance.lod ? mesh.lods[instance.lod - 1].faces : mesh.faces, lodFaces[instance.lod]);
+	}
+
+	//every band job owns a horizontal band of the render target so no two threads touch the same pixel.
+	//Instances change the normal transform uniform, so bands still work on their own copy of the shader
+	uint32_t numBands = rasterBandCount(context);
+	std::vector<Shader*> shaders(numBands, &shader);
+	for(uint32_t i = 1; i < numBands; i++) {
+		shaders[i] = shader.clone();
+		if(!shaders[i]) {
+			numBands = i;
+			break;
+		}
+	}
+
+	parallelFor(context->jobs, numBands, 1, [&](uint32_t first, uint32_t end) {
+		for(uint32_t band = first; band < end; band++)
+			renderInstancesInBand(context, lodFaces, instanceData, camera, *shaders[band], msaa, rasterBandRect(context, band, numBands));
+	});
+
+	for(uint32_t i = 1; i < numBands; i++)
+		delete shaders[i];
+}
+
+//maps normalized device coordinates onto rect instead of the whole window
+static mat4x4 viewRectTransform(const ScissorRect& rect)
+{
+	mat4x4 transform = viewport(rect.maxX - rect.minX + 1, rect.maxY - rect.minY + 1);
+	transform.rows[3].x += rect.minX;
+	transform.rows[3].y += rect.minY;
+	return transform;
+}
+
+//world space face shared by every view
+struct MultiViewFace
+{
+	Triangle triangle;
+	Vec3 normal;
+	Vec3 centroid;
+};
+
+//what one view sees of a face
+struct ViewFace
+{
+	Vec3 centerView;
+	float lightIntensity;
+	int botY;
+	int topY;//!<-1 for faces culled in this view
+};
+
+//rows of the view rect a world space triangle covers, false when it's outside of the view frustum
+static bool viewTriangleRows(const Triangle& triangle, const mat4x4& VP, const mat4x4& viewportTransform, const ScissorRect& rect,
+	int* botY, int* topY)
+{
+	const Vec4 clip[3] = {triangle.v1.pos * VP, triangle.v2.pos * VP, triangle.v3.pos * VP};
+	uint8_t outsideMask = 0x3f;
+	bool behindCamera = false;
+	float minY = std::numeric_limits<float>::max();
+	float maxY = -std::numeric_limits<float>::max();
+	for(const Vec4& c : clip) {
+		outsideMask &= frustumOutcode(c);
+		if(c.w <= 0.f) {
+			behindCamera = true;
+			continue;
+		}
+		float screenY = (perspectiveDivide(c) * viewportTransform).y;
+		minY = min(minY, screenY);
+		maxY = max(maxY, screenY);
+	}
+
+	//all vertices are outside of the same frustum plane
+	if(outsideMask)
+		return false;
+
+	*botY = rect.minY;
+	*topY = rect.maxY;
+	if(!behindCamera) {
+		*botY = max((int)(minY - 1.f), rect.minY);
+		*topY = min((int)(maxY + 1.f), rect.maxY);
+	}
+	return *botY <= *topY;
+}
+
+template<typename ShaderT>
+static void renderViewFaces(RenderContext* context, const std::vector<MultiViewFace>& faces, const ViewFace* viewFaces,
+	const ShaderT& shader, bool msaa, const ScissorRect& scissor, const mat4x4& viewportTransform)
+{
+	VaryingBlock varyings;
+	for(uint32_t i = 0; i < faces.size(); i++) {
+		const ViewFace& viewFace = viewFaces[i];
+		if(viewFace.topY < scissor.minY || viewFace.botY > scissor.maxY)
+			continue;
+		varyings.lightIntensity = viewFace.lightIntensity;
+		varyings.centerView = viewFace.centerView;
+		drawShadedTriangle(context, faces[i].triangle, shader, varyings, msaa, scissor, viewportTransform);
+	}
+}
+
+bool renderObjectMultiView(RenderContext* context, const RenderObject& object, const mat4x4& modelToWorldTransform, Shader& shader,
+	const RenderView* views, uint32_t numViews)
+{
+	//recorded frames and visibility buffers rasterize with the context viewport long after this call returns
+	if(context->pipeline || context->visibility)
+		return false;
+	if(!numViews)
+		return true;
+	//every view rasterizes with its own copy of the shader, the first view keeps the caller's shader
+	std::vector<Shader*> shaders(numViews, &shader);
+	for(uint32_t view = 1; view < numViews; view++) {
+		shaders[view] = shader.clone();
+		if(!shaders[view]) {
+			for(uint32_t i = 1; i < view; i++)
+				delete shaders[i];
+			return false;
+		}
+	}
+	//views aren't tracked by the frame cache, the frame renders as usual from here on
+	if(recordingCachedDraws(context))
+		flushFrameCache(context);
+
+	//the most detailed lod any view asks for
+	const std::vector<Face>* faces = &selectLodFaces(context, *object.mesh, modelToWorldTransform, views[0].camera);
+	for(uint32_t view = 1; view < numViews; view++) {
+		const std::vector<Face>& viewLod = selectLodFaces(context, *object.mesh, modelToWorldTransform, views[view].camera);
+		if(viewLod.size() > faces->size())
+			faces = &viewLod;
+	}
+	uint32_t numFaces = faces->size();
+	bool msaa = msaaEnabled(context);
+
+	//every view rasterizes with its own viewport. Deferred lighting reconstructs positions with a single camera per frame,
+	//so these draws always shade forward
+	mat4x4 normalTransform = inverse(transpose(modelToWorldTransform));
+	std::vector<mat4x4> viewportTransforms(numViews);
+	std::vector<mat4x4> VPs(numViews);
+	for(uint32_t view = 0; view < numViews; view++) {
+		shaders[view]->uniforms.in_normalTransform = normalTransform;
+		shaders[view]->uniforms.in_materialId = 0;
+		setQualityUniforms(context, shaders[view]->uniforms);
+		VPs[view] = views[view].camera.worldToCameraTransform * views[view].perspectiveTransform;
+		shaders[view]->uniforms.in_VP = VPs[view];
+		shaders[view]->uniforms.in_cameraPosition = views[view].camera.camPos;
+		viewportTransforms[view] = viewRectTransform(views[view].rect);
+	}
+
+	//vertex fetch and the world transform happen once, clip space binning for all views runs in the same pass
+	std::vector<MultiViewFace> worldFaces(numFaces);
+	std::vector<ViewFace> viewFaces(numFaces * numViews);
+	parallelFor(context->jobs, numFaces, 64, [&](uint32_t first, uint32_t end) {
+		for(uint32_t i = first; i < end; i++) {
+			MultiViewFace& face = worldFaces[i];
+			transformFace(*object.mesh, (*faces)[i], modelToWorldTransform, &face.triangle, &face.normal, &face.centroid);
+			for(uint32_t view = 0; view < numViews; view++) {
+				ViewFace& out = viewFaces[view * numFaces + i];
+				out.topY = -1;
+				if(faceLighting(face.normal, face.centroid, views[view].camera.camPos, &out.lightIntensity, &out.centerView)
+					&& !viewTriangleRows(face.triangle, VPs[view], viewportTransforms[view], views[view].rect, &out.botY, &out.topY))
+					out.topY = -1;
 			}
-		}//backface cull
-	}//main face loop
+		}
+	});
+
+	//bands go through every view overlapping them, so each pixel still has a single owner
+	uint32_t numBands = rasterBandCount(context);
+	parallelFor(context->jobs, numBands, 1, [&](uint32_t first, uint32_t end) {
+		for(uint32_t band = first; band < end; band++) {
+			ScissorRect bandRect = rasterBandRect(context, band, numBands);
+			for(uint32_t view = 0; view < numViews; view++) {
+				const ScissorRect& rect = views[view].rect;
+				ScissorRect scissor = {max(bandRect.minX, rect.minX), max(bandRect.minY, rect.minY),
+					min(bandRect.maxX, rect.maxX), min(bandRect.maxY, rect.maxY)};
+				if(scissor.minX > scissor.maxX || scissor.minY > scissor.maxY)
+					continue;
+				dispatchShader(context, *shaders[view], [&](const auto& typedShader) {
+					renderViewFaces(context, worldFaces, &viewFaces[view * numFaces], typedShader, msaa, scissor, viewportTransforms[view]);
+				});
+			}
+		}
+	});
+
+	for(uint32_t view = 1; view < numViews; view++)
+		delete shaders[view];
+	return true;
 }
 
+bool renderObjectMultiView(RenderContext* context, const RenderObject& object, Shader& shader, const RenderView* views, uint32_t numViews)
+{
+	return renderObjectMultiView(context, object, computeModelTransform(object.transform), shader, views, numViews);
+}
+
+//share of the newest frame in the smoothed frame time
+static const float FRAME_TIME_SMOOTHING = 0.25f;
+
+static void recordFrameTime(RenderContext* context)
+{
+	float frameMs = context->frameTimer.stopMs();
+	context->frameTimer.start();
+	if(!context->frameTimerStarted) {
+		context->frameTimerStarted = true;
+		return;
+	}
+	float& average = context->averageFrameMs;
+	average = average ? average + (frameMs - average) * FRAME_TIME_SMOOTHING : frameMs;
+}
 
 void endFrame(RenderContext* context)
 {
-	SDL_UpdateWindowSurface(context->window.window);
+	if(context->frameCache)
+		renderCachedFrame(context);
+	waitForFrameJobs(context->jobs);
+	recordFrameTime(context);
+	if(context->dynamicResolution)
+		updateDynamicResolution(context);
+	if(context->adaptiveQuality)
+		updateAdaptiveQuality(context);
+	if(context->pipeline) {
+		pipelineEndFrame(context);
+		return;
+	}
+	if(context->gbuffer)
+		shadeGBuffer(context->jobs, *context->gbuffer, context->gbuffer->recording, context->rtargets, context->surface);
+	if(context->visibility)
+		resolveVisibilityBuffer(context, msaaEnabled(context));
+	resolveClearedTiles(context->jobs, &context->rtargets, context->surface);
+	if(context->checkerboard)
+		resolveCheckerboard(context);
+	presentPixels(context, context->surface);
+}
+
+#ifdef SOFTY_WITH_SDL
+static void updateWindow(RenderContext* context)
+{
+	uint32_t numRects = 0;
+	const DirtyRect* dirty = lastDirtyRects(context, &numRects);
+	//the window system may have thrown away what was presented before
+	if(!dirty || windowExposed()) {
+		SDL_UpdateWindowSurface(context->window.window);
+		return;
+	}
+	if(!numRects)
+		return;
+
+	std::vector<SDL_Rect> rects(numRects);
+	for(uint32_t i = 0; i < numRects; i++)
+		rects[i] = SDL_Rect{dirty[i].x, dirty[i].y, dirty[i].width, dirty[i].height};
+	SDL_UpdateWindowSurfaceRects(context->window.window, rects.data(), numRects);
+}
+#endif
+
+void presentPixels(RenderContext* context, const PixelBuffer& frame)
+{
+	const PixelBuffer& target = presentSurface(context);
+	if(frame.width != target.width || frame.height != target.height) {
+		upscaleFrame(context->jobs, frame, target);
+	}
+	else if(frame.pixels != target.pixels) {
+		assert(frame.format == target.format);
+		for(int y = 0; y < target.height; y++)
+			memcpy(pixelRow(target, y), pixelRow(frame, y), target.width * sizeof(uint32_t));
+	}
+
+	if(context->frameWriter)
+		submitFrame(context->frameWriter, target);
+	if(context->dirtyRects)
+		findDirtyRects(context, target);
+
+#ifdef SOFTY_WITH_SDL
+	if(!context->offscreen)
+		updateWindow(context);
+#endif
+}
+
+void readbackColor(RenderContext* context, void* out, uint32_t pitch)
+{
+	if(context->pipeline)
+		drainFramePipeline(context);
+
+	const PixelBuffer& surface = presentSurface(context);
+	pitch = pitch ? pitch : surface.width * sizeof(uint32_t);
+	for(int row = 0; row < surface.height; row++)
+		memcpy((uint8_t*)out + row * pitch, pixelRow(surface, surface.height - 1 - row), surface.width * sizeof(uint32_t));
+}
+
+void readbackDepth(RenderContext* context, float* out)
+{
+	//raster thread owns the depth buffer until every frame is out
+	if(context->pipeline)
+		drainFramePipeline(context);
+
+	const RenderTargets& targets = context->rtargets;
+	//same toggle renderObject uses to pick the depth buffer layout
+	int stride = msaaEnabled(context) ? sampleCount : 1;
+	for(int y = 0; y < targets.height; y++) {
+		const uint8_t* clearRow = &targets.tileFlags[(y / RENDER_TILE_SIZE) * targets.tilesX];
+		const float* depthRow = targets.zBuffer + y * targets.width * stride;
+		float* outRow = out + (targets.height - 1 - y) * targets.width;
+		for(int x = 0; x < targets.width; x++) {
+			float depth = std::numeric_limits<float>::max();
+			if(!(clearRow[x / RENDER_TILE_SIZE] & TILE_CLEARED)) {
+				for(int s = 0; s < stride; s++)
+					depth = min(depth, depthRow[x * stride + s]);
+			}
+			outRow[x] = depth;
+		}
+	}
 }
\ No newline at end of file
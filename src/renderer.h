@@ -1,32 +1,166 @@
 #ifndef SOFTWARE_RENDERER_H
 #define SOFTWARE_RENDERER_H
 
+#ifdef SOFTY_WITH_SDL
 #include <SDL2/SDL.h>
+#endif
 #include <vector>
 #include "obj.h"
 #include "maths.h"
 #include "texture.h"
 #include "camera.h"
+#include "shadowmap.h"
+#include "hash.h"
 #include "shaders.h"
+#include "jobs.h"
+#include "targetpool.h"
+#include "timer.h"
 
 struct Window
 {
-	SDL_Window* window;
+#ifdef SOFTY_WITH_SDL
+	SDL_Window* window;//!<null for offscreen contexts
+	SDL_Surface* surface;
+#endif
+	int width;//!<size frames are rendered at, below the window size with dynamic resolution
+	int height;
+};
+
+enum PixelFormat
+{
+	PIXEL_FORMAT_ARGB8888,//!<0xAARRGGBB words, what window surfaces usually use
+	PIXEL_FORMAT_ABGR8888//!<0xAABBGGRR words, R G B A bytes in memory on little endian machines
+};
+
+//32 bit color buffer the rasterizer resolves into, the first row in memory is the top of the image
+struct PixelBuffer
+{
+	void* pixels;
 	int width;
 	int height;
+	int pitch;//!<bytes between rows
+	PixelFormat format;
+};
+
+inline uint32_t packPixel(PixelFormat format, const Vec4& color)
+{
+	uint32_t r = (uint8_t)color.R;
+	uint32_t g = (uint8_t)color.G;
+	uint32_t b = (uint8_t)color.B;
+	uint32_t a = (uint8_t)color.A;
+	if(format == PIXEL_FORMAT_ABGR8888)
+		return a << 24 | b << 16 | g << 8 | r;
+	return a << 24 | r << 16 | g << 8 | b;
+}
+
+//y goes up like viewport coordinates do
+inline uint32_t* pixelRow(const PixelBuffer& buffer, int y)
+{
+	return (uint32_t*)((uint8_t*)buffer.pixels + (buffer.height - 1 - y) * buffer.pitch);
+}
+
+//world space position of a pixel from its view depth, points on the pixel ray are found through the near and far planes
+inline Vec3 reconstructPosition(const mat4x4& invVP, const mat4x4& invViewport, int x, int y, float depth)
+{
+	Vec4 ndc = Vec4{(float)x, (float)y, 0.f, 1.f} * invViewport;
+	Vec4 nearPoint = Vec4{ndc.x, ndc.y, -1.f, 1.f} * invVP;
+	Vec4 farPoint = Vec4{ndc.x, ndc.y, 1.f, 1.f} * invVP;
+	//unprojected w is the reciprocal of the view depth
+	float nearDepth = 1.f / nearPoint.w;
+	float farDepth = 1.f / farPoint.w;
+	float t = (depth - nearDepth) / (farDepth - nearDepth);
+	return lerp(nearPoint.xyz * nearDepth, farPoint.xyz * farDepth, t);
+}
+
+//render targets are cleared lazily, tiles are initialized when something is drawn to them for the first time
+static const int RENDER_TILE_SIZE = 32;
+
+enum TileFlagBits
+{
+	TILE_CLEARED = 1 << 0,//!<tile contents are stale, it should read as the clear color
+	TILE_RESOLVED = 1 << 1//!<cleared tile whose pixels already hold the clear color, frames the frame cache keeps don't fill it again
 };
 
 struct RenderTargets
 {
 	float* zBuffer;
-	Vec3* cBuffer;
+	Vec3* cBuffer;//!<msaa samples, samples whose depth was never written read as clearColor instead
+	uint8_t* tileFlags;
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	Vec4 clearColor;
+};
+
+//part of a presented frame, in window coordinates(y goes down from the top row)
+struct DirtyRect
+{
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+//inclusive pixel bounds rasterization is clamped to
+struct ScissorRect
+{
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+};
+
+struct FramePipeline;
+struct FrameWriter;
+struct GBuffer;
+struct VisibilityBuffer;
+struct DynamicResolution;
+struct AdaptiveQuality;
+struct FrameCache;
+struct Checkerboard;
+struct DirtyRects;
+
+//settings with a large share of the frame cost, the adaptive quality controller steps between levels of them
+struct QualityLevel
+{
+	int parallaxLayers = 30;//!<height map steps per fragment of BumpShader's parallax occlusion mapping
+	bool specular = true;//!<specular highlights(a pow per fragment) of the lit shaders and the deferred lighting pass
+	bool msaa = false;//!<msaa without holding G
 };
 
 struct RenderContext
 {
 	Window window;
 	RenderTargets rtargets;
-	SDL_Surface* surface;
+	PixelBuffer surface;//!<wraps the window surface or offscreen memory, an internal target with dynamic resolution
+	float lodErrorThreshold;//!<max screen space error of a mesh lod in pixels, 0 always renders full detail
+	bool virtualShaders;//!<rasterize built-in shaders through the virtual interface too, to measure what the specialized rasterizers save
+	FramePipeline* pipeline;//!<set in pipelined mode, see setFramesInFlight
+	JobSystem* jobs;
+	RenderTargetPool* targetPool;//!<backs rtargets and any other targets created for the context
+	bool offscreen;
+	void* ownedPixels;//!<offscreen color memory allocated by the context
+	GBuffer* gbuffer;//!<set in deferred mode, see setDeferredShading
+	VisibilityBuffer* visibility;//!<set in visibility buffer mode, see setVisibilityBuffer
+	DynamicResolution* dynamicResolution;//!<set while the render size follows the frame time, see setDynamicResolution
+	AdaptiveQuality* adaptiveQuality;//!<set while the quality level follows the frame time, see setAdaptiveQuality
+	FrameCache* frameCache;//!<set while unchanged tiles are kept from one frame to the next, see setFrameCache
+	Checkerboard* checkerboard;//!<set in checkerboard mode, see setCheckerboardRendering
+	DirtyRects* dirtyRects;//!<set while only the changed parts of frames are presented, see setDirtyRectPresentation
+	QualityLevel quality;//!<read when draws are recorded, the adaptive quality controller overwrites it
+	bool frameMsaa;//!<sample layout of the frame being rendered, see msaaEnabled
+	//ShadingRate per render tile, rtargets.tilesX per row starting at the bottom. Draws shade at the coarser of
+	//their own rate and their tile's, null leaves it to the draws. Read when triangles get rasterized
+	const uint8_t* shadingRateImage;
+	Timer frameTimer;//!<runs from one endFrame to the next
+	bool frameTimerStarted;
+	float averageFrameMs;//!<smoothed time between endFrame calls, 0 until two frames ended
+	FrameWriter* frameWriter;//!<gets every presented frame when set, destroy it after the renderer so frames still in flight get written
+	//render state, contexts don't share anything so each one can render on its own thread
+	mat4x4 viewportTransform;//!<reset to the window size when the window is resized
+	mat4x4 perspectiveTransform;
+	Vec4 clearColor;
 };
 
 struct Transform
@@ -36,6 +170,14 @@ struct Transform
 	Vec3 translate;
 };
 
+//one camera of a multi-view draw
+struct RenderView
+{
+	Camera camera;
+	mat4x4 perspectiveTransform;
+	ScissorRect rect;//!<part of the context targets the view renders into
+};
+
 struct RenderObject
 {
 	Mesh* mesh;
@@ -45,24 +187,154 @@ struct RenderObject
 	Transform transform;
 };
 
-//render State
-extern mat4x4 viewportTransform;
-extern mat4x4 perspectiveTransform;
-extern Vec4 clearColor;
-
 bool windowClosed();
 
-void setRenderState(const mat4x4& viewport, const mat4x4 perspective, const Vec4& clear);
+void setRenderState(RenderContext* context, const mat4x4& viewport, const mat4x4 perspective, const Vec4& clear);
 
-bool createSoftwareRenderer(RenderContext* context, const char* title, uint32_t width, uint32_t height);
+#ifdef SOFTY_WITH_SDL
+bool createSoftwareRenderer(RenderContext* context, const char* title, uint32_t width, uint32_t height,
+	const JobSystemConfig& jobConfig = JobSystemConfig());
+#endif
+
+//context without a window, renders into pixels(pitch bytes per row, 0 for tightly packed) or into memory it owns when pixels is null
+bool createOffscreenRenderer(RenderContext* context, uint32_t width, uint32_t height, PixelFormat format = PIXEL_FORMAT_ARGB8888,
+	void* pixels = nullptr, uint32_t pitch = 0, const JobSystemConfig& jobConfig = JobSystemConfig());
+
+//enables pipelined mode when framesInFlight > 0: renderObject only records and bins geometry,
+//frames are rasterized on a separate thread and presented framesInFlight frames later. 0 goes back to immediate mode
+bool setFramesInFlight(RenderContext* context, uint32_t framesInFlight);
+
+//deferred mode: draws whose shader has a deferred material only write normal, albedo and material id into a G-buffer
+//and a full screen pass lights every pixel once in endFrame. Other shaders keep shading forward. Always single sampled
+bool setDeferredShading(RenderContext* context, bool enabled);
+
+//visibility buffer mode: draws only write depth and a packed (draw, triangle) id per sample, endFrame then runs
+//each pixel's winning triangles through their shader once. Doesn't combine with deferred mode, pipelined frames and
+//shaders without Shader::clone shade as usual
+bool setVisibilityBuffer(RenderContext* context, bool enabled);
+
+struct DynamicResolutionConfig
+{
+	float targetFrameMs = 16.6f;//!<measured from one endFrame to the next
+	float minScale = 0.5f;//!<render size per axis relative to the window
+	float maxScale = 1.f;
+};
+
+//renders into an internal target whose size is scaled between the config limits to hit the target frame time,
+//presenting upscales it bilinearly into the window surface(or offscreen memory). Null config goes back to native size
+bool setDynamicResolution(RenderContext* context, const DynamicResolutionConfig* config);
+
+//a change of the adaptive quality controller's level
+struct QualityChange
+{
+	uint32_t fromLevel;
+	uint32_t toLevel;
+	float averageFrameMs;//!<smoothed frame time the decision was made on
+};
+
+struct AdaptiveQualityConfig
+{
+	float targetFrameMs = 16.6f;//!<measured from one endFrame to the next
+	const QualityLevel* levels = nullptr;//!<cheapest first, they're copied. Null for the built-in levels
+	uint32_t numLevels = 0;
+	void (*onChange)(const QualityChange& change, void* user) = nullptr;//!<called from endFrame for every level change
+	void* user = nullptr;
+};
+
+//starts at the most expensive level and moves context->quality one level down when the frame time is over the target,
+//one up when it's well under. A level that had to be left right after going up to it is retried later each time.
+//Dynamic resolution reacts to the same frame time, give the two different targets to have one of them go first.
+//Null config stops the controller and goes back to the default QualityLevel
+bool setAdaptiveQuality(RenderContext* context, const AdaptiveQualityConfig* config);
+
+//draws are recorded instead of rasterized and compared with the previous frame's in endFrame, only the tiles under
+//draws that changed(at their old and new place) are cleared and rendered again. A static camera over a mostly static
+//scene then costs a fraction of a frame. Draws are matched in call order and identified by mesh, textures, transforms,
+//camera, shader type, flat color and Shader::hashState, changes the cache can't see(texture contents, a mesh edited in
+//place, members of shaders without hashState) need invalidateFrameCache. Shaders need Shader::clone, pipelined, deferred, visibility buffer and
+//checkerboard frames and multi-view draws render as usual. Call between frames
+bool setFrameCache(RenderContext* context, bool enabled);
+
+//renders the next frame in full
+void invalidateFrameCache(RenderContext* context);
+
+//every frame shades half of the pixels in a checkerboard pattern that flips from frame to frame, all of them are still
+//depth tested. endFrame fills in the other half from the previous frame, reprojected with the camera of the last draw
+//and kept where the depth shows the same surface, and from the neighbors shaded this frame where it doesn't.
+//Forward non-msaa frames only, the others render in full. Frames aren't cached by the frame cache in this mode
+bool setCheckerboardRendering(RenderContext* context, bool enabled);
+
+//presented frames are compared with the previous one in tiles and only the tiles that changed are copied to the window
+//(SDL_UpdateWindowSurfaceRects), nothing is when the frame didn't change. The present cost then follows the changed
+//area rather than the window size, which matters where presenting copies over the network. Offscreen contexts find
+//the rects too, for applications sending frames elsewhere, see lastDirtyRects
+bool setDirtyRectPresentation(RenderContext* context, bool enabled);
+
+//parts of the window the last presented frame changed, null when it changed as a whole(or isn't tracked)
+const DirtyRect* lastDirtyRects(const RenderContext* context, uint32_t* numRects);
+
+//msaa is on while G is held or the quality level asks for it, deferred mode always rasterizes one sample per pixel.
+//It's latched by beginFrame, so every draw and resolve of a frame(and readbacks after it) agree on the sample layout
+bool msaaEnabled(const RenderContext* context);
 
 void destroySoftwareRenderer(RenderContext* context);
 
+//(re)allocates targets from the context pool, memory is only replaced when it's too small for the new size.
+//Zero initialized targets are valid input, so this is also how additional targets(shadow maps, offscreen passes) are created
+bool resizeRenderTargets(RenderContext* context, RenderTargets* targets, uint32_t width, uint32_t height);
+
+//gives target memory back to the context pool
+void releaseRenderTargets(RenderContext* context, RenderTargets* targets);
+
+//only flags every tile as cleared, no pixel is touched
+void clearRenderTargets(RenderTargets* targets, const Vec4& color);
+
+//fills tiles nothing was drawn to with the clear color, unless they were filled since they were last cleared
+void resolveClearedTiles(JobSystem* jobs, RenderTargets* targets, const PixelBuffer& surface);
+
+//copies a finished frame into the context color buffer(if it's not already there), upscaling it when it was rendered
+//at a lower resolution, and shows it on the window if there is one
+void presentPixels(RenderContext* context, const PixelBuffer& frame);
+
+//last frame passed to endFrame, top row first. pitch is in bytes, 0 for tightly packed
+void readbackColor(RenderContext* context, void* out, uint32_t pitch = 0);
+
+//view space depth of the last frame(nearest sample with msaa), top row first like the color.
+//It has the render size, which is smaller than the color with dynamic resolution.
+//Pixels nothing was drawn to read as FLT_MAX
+void readbackDepth(RenderContext* context, float* out);
+
+//the screen is split into horizontal bands so parallel rasterization never touches the same pixel from two threads
+uint32_t rasterBandCount(const RenderContext* context);
+
+//band height is a multiple of RENDER_TILE_SIZE so every tile is owned by a single band
+int rasterBandHeight(const RenderContext* context, uint32_t numBands);
+
+ScissorRect rasterBandRect(const RenderContext* context, uint32_t band, uint32_t numBands);
+
 void processInput(RenderContext* context);
 
 void beginFrame(RenderContext* context);
 
-void renderObject(RenderContext* context, const RenderObject& object, const Camera& camera, Shader& shader);
+mat4x4 computeModelTransform(const Transform& transform);
+
+//false when nothing was drawn, pipelined frames can't record shaders without Shader::clone
+bool renderObject(RenderContext* context, const RenderObject& object, const Camera& camera, Shader& shader);
+
+//same as above but takes an already built model matrix(e.g. cached by TransformHierarchy) instead of object.transform
+bool renderObject(RenderContext* context, const RenderObject& object, const mat4x4& modelToWorldTransform, const Camera& camera, Shader& shader);
+
+//draws mesh once per transform, mesh attributes are decoded once and shared between instances
+void renderObjectInstanced(RenderContext* context, const Mesh& mesh, const Camera& camera, Shader& shader, const Transform* instances, uint32_t numInstances);
+
+//draws object into several views in one pass, faces are fetched and transformed once and binned for every view together.
+//Views render into their rect of the context targets(split screen, cubemap faces side by side), rects shouldn't overlap.
+//Always shades forward, false in pipelined and visibility buffer mode or when views past the first need a Shader::clone
+//the shader lacks, nothing is drawn then
+bool renderObjectMultiView(RenderContext* context, const RenderObject& object, Shader& shader, const RenderView* views, uint32_t numViews);
+
+bool renderObjectMultiView(RenderContext* context, const RenderObject& object, const mat4x4& modelToWorldTransform, Shader& shader,
+	const RenderView* views, uint32_t numViews);
 
 void endFrame(RenderContext* context);
 
@@ -0,0 +1,114 @@
+#include "resolution.h"
+#include <cassert>
+#include <cmath>
+
+//frames the average gets to pick up a new render size before the next decision
+static const uint32_t SETTLE_FRAMES = 8;
+//hysteresis band around the target, asymmetric so the scale doesn't go up right after it went down
+static const float LOWER_ABOVE_LOAD = 1.05f;
+static const float RAISE_BELOW_LOAD = 0.9f;
+//smaller changes aren't worth resizing the targets for
+static const float MIN_SCALE_STEP = 0.02f;
+
+static int scaledSize(int size, float scale)
+{
+	return max((int)(size * scale + 0.5f), 1);
+}
+
+DynamicResolution* createDynamicResolution(RenderContext* context, const DynamicResolutionConfig& config)
+{
+	DynamicResolution* resolution = new DynamicResolution();
+	resolution->config = config;
+	resolution->output = context->surface;
+	resolution->scale = config.maxScale;
+	context->dynamicResolution = resolution;
+	if(!applyDynamicResolution(context)) {
+		destroyDynamicResolution(context);
+		return nullptr;
+	}
+	return resolution;
+}
+
+void destroyDynamicResolution(RenderContext* context)
+{
+	DynamicResolution* resolution = context->dynamicResolution;
+	context->surface = resolution->output;
+	releasePoolMemory(context->targetPool, resolution->pixels);
+	delete resolution;
+	context->dynamicResolution = nullptr;
+}
+
+bool applyDynamicResolution(RenderContext* context)
+{
+	DynamicResolution* resolution = context->dynamicResolution;
+	const PixelBuffer& output = resolution->output;
+	size_t maxPixels = (size_t)scaledSize(output.width, resolution->config.maxScale) * scaledSize(output.height, resolution->config.maxScale);
+	if(!reservePoolMemory(context->targetPool, &resolution->pixels, maxPixels * sizeof(uint32_t))) {
+		printf("Failed to allocate dynamic resolution memory\n");
+		return false;
+	}
+
+	PixelBuffer& surface = context->surface;
+	surface.pixels = resolution->pixels;
+	surface.width = scaledSize(output.width, resolution->scale);
+	surface.height = scaledSize(output.height, resolution->scale);
+	surface.pitch = surface.width * sizeof(uint32_t);
+	surface.format = output.format;
+	return true;
+}
+
+void updateDynamicResolution(RenderContext* context)
+{
+	DynamicResolution* resolution = context->dynamicResolution;
+	if(!context->averageFrameMs || ++resolution->framesSinceChange < SETTLE_FRAMES)
+		return;
+
+	const DynamicResolutionConfig& config = resolution->config;
+	float load = context->averageFrameMs / config.targetFrameMs;
+	if(load <= LOWER_ABOVE_LOAD && load >= RAISE_BELOW_LOAD)
+		return;
+
+	float scale = clamp(resolution->scale / std::sqrt(load), config.minScale, config.maxScale);
+	if(std::abs(scale - resolution->scale) < MIN_SCALE_STEP)
+		return;
+	resolution->scale = scale;
+	resolution->framesSinceChange = 0;
+}
+
+void upscaleFrame(JobSystem* jobs, const PixelBuffer& frame, const PixelBuffer& output)
+{
+	assert(frame.format == output.format);
+
+	//source texels and weight of every output column, pixel centers map onto pixel centers
+	std::vector<int> firstColumn(output.width);
+	std::vector<int> secondColumn(output.width);
+	std::vector<uint32_t> columnWeight(output.width);
+	float stepX = frame.width / (float)output.width;
+	for(int x = 0; x < output.width; x++) {
+		float sourceX = clamp((x + 0.5f) * stepX - 0.5f, 0.f, frame.width - 1.f);
+		firstColumn[x] = (int)sourceX;
+		secondColumn[x] = min(firstColumn[x] + 1, frame.width - 1);
+		columnWeight[x] = (uint32_t)((sourceX - firstColumn[x]) * 256.f + 0.5f);
+	}
+
+	float stepY = frame.height / (float)output.height;
+	parallelFor(jobs, output.height, 16, [&](uint32_t first, uint32_t end) {
+		std::vector<uint32_t> blended(frame.width);
+		for(uint32_t y = first; y < end; y++) {
+			float sourceY = clamp((y + 0.5f) * stepY - 0.5f, 0.f, frame.height - 1.f);
+			int y0 = (int)sourceY;
+			int y1 = min(y0 + 1, frame.height - 1);
+			uint32_t rowWeight = (uint32_t)((sourceY - y0) * 256.f + 0.5f);
+
+			//vertical pass over whole rows first, it's contiguous so it vectorizes
+			const uint32_t* row0 = (const uint32_t*)((const uint8_t*)frame.pixels + y0 * frame.pitch);
+			const uint32_t* row1 = (const uint32_t*)((const uint8_t*)frame.pixels + y1 * frame.pitch);
+			for(int x = 0; x < frame.width; x++)
+				blended[x] = lerpPixel(row0[x], row1[x], rowWeight);
+
+			uint32_t* outRow = (uint32_t*)((uint8_t*)output.pixels + y * output.pitch);
+			for(int x = 0; x < output.width; x++)
+				outRow[x] = lerpPixel(blended[firstColumn[x]], blended[secondColumn[x]], columnWeight[x]);
+		}
+	});
+}
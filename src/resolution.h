@@ -0,0 +1,41 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include "renderer.h"
+
+//frames are rendered into an internal surface and upscaled into output when they're presented.
+//The render size follows the frame time: pixel cost goes with the square of the scale, so the scale moves by the
+//square root of how far the context's smoothed frame time is off the target. Frames within the hysteresis band leave it alone
+struct DynamicResolution
+{
+	DynamicResolutionConfig config;
+	PixelBuffer output;//!<window surface or offscreen memory the context surface wrapped before
+	void* pixels;//!<internal color memory from the context pool, sized for maxScale
+	float scale;//!<render size over output size per axis
+	uint32_t framesSinceChange;
+};
+
+DynamicResolution* createDynamicResolution(RenderContext* context, const DynamicResolutionConfig& config);
+
+//points the context surface back at the output and gives the internal memory back to the pool
+void destroyDynamicResolution(RenderContext* context);
+
+//resizes the context surface for the current scale and output size, beginFrame then resizes the targets to match
+bool applyDynamicResolution(RenderContext* context);
+
+//picks the scale from the frame time endFrame measured, the new scale takes effect on the next beginFrame
+void updateDynamicResolution(RenderContext* context);
+
+//a + (b - a) * weight / 256 for all four channels, red/blue and alpha/green go through one multiply each
+inline uint32_t lerpPixel(uint32_t a, uint32_t b, uint32_t weight)
+{
+	uint32_t inverse = 256 - weight;
+	uint32_t rb = ((a & 0xff00ff) * inverse + (b & 0xff00ff) * weight) >> 8 & 0xff00ff;
+	uint32_t ag = ((a >> 8 & 0xff00ff) * inverse + (b >> 8 & 0xff00ff) * weight) & 0xff00ff00;
+	return rb | ag;
+}
+
+//bilinear filter over packed 8 bit channels, two channels per multiply. Rows are split between jobs
+void upscaleFrame(JobSystem* jobs, const PixelBuffer& frame, const PixelBuffer& output);
+
+#endif
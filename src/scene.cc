@@ -0,0 +1,294 @@
+#include "scene.h"
+#include "input.h"
+#include <algorithm>
+#include <limits>
+
+enum CullResult
+{
+	CULL_OUTSIDE,
+	CULL_INTERSECT,
+	CULL_INSIDE
+};
+
+struct Frustum
+{
+	Vec4 planes[6];
+};
+
+uint32_t addSceneObject(Scene* scene, const RenderObject& object)
+{
+	uint32_t objectId = scene->objects.size();
+	AABB local = computeMeshBounds(*object.mesh);
+
+	scene->objects.push_back(object);
+	scene->localBounds.push_back(local);
+	scene->worldBounds.push_back(transformAABB(local, computeModelTransform(object.transform)));
+	scene->objectLeaf.push_back(-1);
+	scene->needsRebuild = true;
+	return objectId;
+}
+
+void setSceneObjectTransform(Scene* scene, uint32_t objectId, const Transform& transform)
+{
+	assert(objectId < scene->objects.size());
+	scene->objects[objectId].transform = transform;
+	scene->dirtyObjects.push_back(objectId);
+}
+
+static AABB rangeBounds(const Scene* scene, uint32_t first, uint32_t count)
+{
+	AABB bounds = emptyAABB();
+	for(uint32_t i = first; i < first + count; i++)
+		bounds = unionAABB(bounds, scene->worldBounds[scene->order[i]]);
+	return bounds;
+}
+
+static int32_t buildNode(Scene* scene, int32_t parent, uint32_t first, uint32_t count)
+{
+	int32_t nodeIdx = scene->nodes.size();
+	scene->nodes.push_back(BVHNode{rangeBounds(scene, first, count), -1, -1, parent, first, count});
+
+	if(count <= BVH_MAX_LEAF_OBJECTS) {
+		for(uint32_t i = first; i < first + count; i++)
+			scene->objectLeaf[scene->order[i]] = nodeIdx;
+		return nodeIdx;
+	}
+
+	//median split along the longest axis of centroid bounds
+	AABB centroids = emptyAABB();
+	for(uint32_t i = first; i < first + count; i++) {
+		Vec3 center = centerAABB(scene->worldBounds[scene->order[i]]);
+		centroids = unionAABB(centroids, AABB{center, center});
+	}
+	Vec3 extent = centroids.max - centroids.min;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	uint32_t half = count / 2;
+	const std::vector<AABB>& bounds = scene->worldBounds;
+	std::nth_element(scene->order.begin() + first, scene->order.begin() + first + half, scene->order.begin() + first + count,
+		[&bounds, axis](uint32_t a, uint32_t b) {
+			return bounds[a].min[axis] + bounds[a].max[axis] < bounds[b].min[axis] + bounds[b].max[axis];
+		}
+	);
+
+	int32_t left = buildNode(scene, nodeIdx, first, half);
+	int32_t right = buildNode(scene, nodeIdx, first + half, count - half);
+	scene->nodes[nodeIdx].left = left;
+	scene->nodes[nodeIdx].right = right;
+	return nodeIdx;
+}
+
+void buildSceneBVH(Scene* scene)
+{
+	uint32_t numObjects = scene->objects.size();
+	for(uint32_t id : scene->dirtyObjects)
+		scene->worldBounds[id] = transformAABB(scene->localBounds[id], computeModelTransform(scene->objects[id].transform));
+	scene->dirtyObjects.clear();
+
+	scene->nodes.clear();
+	scene->nodes.reserve(numObjects > 0 ? 2 * numObjects - 1 : 0);
+	scene->order.resize(numObjects);
+	for(uint32_t i = 0; i < numObjects; i++)
+		scene->order[i] = i;
+
+	if(numObjects)
+		buildNode(scene, -1, 0, numObjects);
+	scene->needsRebuild = false;
+}
+
+static void refitNode(Scene* scene, BVHNode& node)
+{
+	if(node.left < 0)
+		node.bounds = rangeBounds(scene, node.first, node.count);
+	else
+		node.bounds = unionAABB(scene->nodes[node.left].bounds, scene->nodes[node.right].bounds);
+}
+
+void refitSceneBVH(Scene* scene)
+{
+	if(scene->needsRebuild) {
+		buildSceneBVH(scene);
+		return;
+	}
+	if(scene->dirtyObjects.empty())
+		return;
+
+	for(uint32_t id : scene->dirtyObjects)
+		scene->worldBounds[id] = transformAABB(scene->localBounds[id], computeModelTransform(scene->objects[id].transform));
+
+	//with a lot of moving objects a single bottom-up sweep is cheaper than walking up from each leaf,
+	//children are always stored after their parent so reverse order visits them first
+	if(scene->dirtyObjects.size() * 8 > scene->nodes.size()) {
+		for(size_t i = scene->nodes.size(); i-- > 0;)
+			refitNode(scene, scene->nodes[i]);
+	} else {
+		for(uint32_t id : scene->dirtyObjects) {
+			for(int32_t node = scene->objectLeaf[id]; node >= 0; node = scene->nodes[node].parent)
+				refitNode(scene, scene->nodes[node]);
+		}
+	}
+	scene->dirtyObjects.clear();
+}
+
+void updateOcclusionBuffer(Scene* scene, const RenderContext* context)
+{
+	//depth buffer belongs to the raster thread in pipelined mode
+	if(context->pipeline)
+		return;
+
+	OcclusionBuffer& occlusion = scene->occlusion;
+	occlusion.width = context->window.width;
+	occlusion.height = context->window.height;
+	occlusion.tilesX = (occlusion.width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+	occlusion.tilesY = (occlusion.height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+	occlusion.tileDepth.assign(occlusion.tilesX * occlusion.tilesY, 0.f);
+
+	//same toggle renderObject uses to pick the depth buffer layout
+	int stride = msaaEnabled(context) ? 4 : 1;
+	const float* zBuffer = context->rtargets.zBuffer;
+
+	const RenderTargets& targets = context->rtargets;
+
+	for(int y = 0; y < occlusion.height; y++) {
+		float* tileRow = &occlusion.tileDepth[(y / OCCLUSION_TILE_SIZE) * occlusion.tilesX];
+		const uint8_t* clearRow = &targets.tileFlags[(y / RENDER_TILE_SIZE) * targets.tilesX];
+		const float* depthRow = zBuffer + y * occlusion.width * stride;
+		for(int x = 0; x < occlusion.width; x++) {
+			float& tileDepth = tileRow[x / OCCLUSION_TILE_SIZE];
+			//depth of tiles nothing was drawn to is stale
+			if(clearRow[x / RENDER_TILE_SIZE] & TILE_CLEARED) {
+				tileDepth = std::numeric_limits<float>::max();
+				continue;
+			}
+			for(int s = 0; s < stride; s++)
+				tileDepth = max(tileDepth, depthRow[x * stride + s]);
+		}
+	}
+}
+
+static Frustum extractFrustum(const mat4x4& VP)
+{
+	//row vectors are multiplied by the matrix so clip coordinates are dot products with its columns
+	Vec4 cols[4] = {};
+	for(uint8_t i = 0; i < 4; i++)
+		cols[i] = Vec4{VP.p[i], VP.p[4 + i], VP.p[8 + i], VP.p[12 + i]};
+
+	Frustum out = {};
+	out.planes[0] = cols[3] + cols[0];//left
+	out.planes[1] = cols[3] - cols[0];//right
+	out.planes[2] = cols[3] + cols[1];//bottom
+	out.planes[3] = cols[3] - cols[1];//top
+	out.planes[4] = cols[3] + cols[2];//near
+	out.planes[5] = cols[3] - cols[2];//far
+	return out;
+}
+
+static CullResult testFrustum(const Frustum& frustum, const AABB& box)
+{
+	CullResult result = CULL_INSIDE;
+	for(uint8_t i = 0; i < 6; i++) {
+		const Vec4& plane = frustum.planes[i];
+		Vec3 pVertex = {
+			plane.x >= 0.f ? box.max.x : box.min.x,
+			plane.y >= 0.f ? box.max.y : box.min.y,
+			plane.z >= 0.f ? box.max.z : box.min.z
+		};
+		Vec3 nVertex = {
+			plane.x >= 0.f ? box.min.x : box.max.x,
+			plane.y >= 0.f ? box.min.y : box.max.y,
+			plane.z >= 0.f ? box.min.z : box.max.z
+		};
+		if(dotVec3(plane.xyz, pVertex) + plane.w < 0.f)
+			return CULL_OUTSIDE;
+		if(dotVec3(plane.xyz, nVertex) + plane.w < 0.f)
+			result = CULL_INTERSECT;
+	}
+	return result;
+}
+
+static bool isOccluded(const OcclusionBuffer& occlusion, const mat4x4& VP, const mat4x4& viewportTransform, const AABB& box)
+{
+	if(occlusion.tileDepth.empty())
+		return false;
+
+	float nearestDepth = std::numeric_limits<float>::max();
+	Vec2 screenMin = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+	Vec2 screenMax = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+
+	for(uint8_t i = 0; i < 8; i++) {
+		Vec4 corner = {
+			i & 1 ? box.max.x : box.min.x,
+			i & 2 ? box.max.y : box.min.y,
+			i & 4 ? box.max.z : box.min.z,
+			1.f
+		};
+		corner *= VP;
+		//box crosses the camera plane
+		if(corner.w <= 0.f)
+			return false;
+		nearestDepth = min(nearestDepth, corner.w);
+		Vec4 screen = perspectiveDivide(corner) * viewportTransform;
+		screenMin = Vec2{min(screenMin.x, screen.x), min(screenMin.y, screen.y)};
+		screenMax = Vec2{max(screenMax.x, screen.x), max(screenMax.y, screen.y)};
+	}
+
+	int leftX  = max((int)screenMin.x, 0);
+	int botY   = max((int)screenMin.y, 0);
+	int rightX = min((int)screenMax.x, occlusion.width - 1);
+	int topY   = min((int)screenMax.y, occlusion.height - 1);
+	if(leftX > rightX || botY > topY)
+		return false;
+
+	for(int ty = botY / OCCLUSION_TILE_SIZE; ty <= topY / OCCLUSION_TILE_SIZE; ty++) {
+		for(int tx = leftX / OCCLUSION_TILE_SIZE; tx <= rightX / OCCLUSION_TILE_SIZE; tx++) {
+			if(nearestDepth < occlusion.tileDepth[ty * occlusion.tilesX + tx])
+				return false;
+		}
+	}
+	return true;
+}
+
+void cullScene(Scene* scene, const RenderContext* context, const Camera& camera, bool occlusionCulling, std::vector<uint32_t>* visible)
+{
+	visible->clear();
+	refitSceneBVH(scene);
+	if(scene->nodes.empty())
+		return;
+
+	mat4x4 VP = camera.worldToCameraTransform * context->perspectiveTransform;
+	Frustum frustum = extractFrustum(VP);
+
+	int32_t stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while(stackSize) {
+		const BVHNode& node = scene->nodes[stack[--stackSize]];
+		CullResult result = testFrustum(frustum, node.bounds);
+		if(result == CULL_OUTSIDE)
+			continue;
+		if(occlusionCulling && isOccluded(scene->occlusion, VP, context->viewportTransform, node.bounds))
+			continue;
+
+		//whole subtree is visible, its objects are contiguous in the order array
+		if(result == CULL_INSIDE && !occlusionCulling) {
+			visible->insert(visible->end(), scene->order.begin() + node.first, scene->order.begin() + node.first + node.count);
+			continue;
+		}
+
+		if(node.left < 0) {
+			for(uint32_t i = node.first; i < node.first + node.count; i++) {
+				uint32_t id = scene->order[i];
+				if(result == CULL_INTERSECT && testFrustum(frustum, scene->worldBounds[id]) == CULL_OUTSIDE)
+					continue;
+				if(occlusionCulling && node.count > 1 && isOccluded(scene->occlusion, VP, context->viewportTransform, scene->worldBounds[id]))
+					continue;
+				visible->push_back(id);
+			}
+		} else {
+			assert(stackSize + 2 <= 64);
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = node.left;
+		}
+	}
+}
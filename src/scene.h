@@ -0,0 +1,59 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include "renderer.h"
+
+static const uint32_t BVH_MAX_LEAF_OBJECTS = 4;
+static const int OCCLUSION_TILE_SIZE = 16;
+
+struct BVHNode
+{
+	AABB bounds;
+	int32_t left;//!<-1 for leaf nodes
+	int32_t right;
+	int32_t parent;
+	uint32_t first;//!<first entry in Scene::order covered by this node
+	uint32_t count;
+};
+
+//coarse max-depth grid taken from the last rendered frame
+struct OcclusionBuffer
+{
+	std::vector<float> tileDepth;
+	int tilesX = 0;
+	int tilesY = 0;
+	int width = 0;
+	int height = 0;
+};
+
+struct Scene
+{
+	std::vector<RenderObject> objects;
+	std::vector<AABB> localBounds;
+	std::vector<AABB> worldBounds;
+	std::vector<uint32_t> order;//!<object ids in bvh leaf order, every node covers a contiguous range
+	std::vector<int32_t> objectLeaf;
+	std::vector<uint32_t> dirtyObjects;
+	std::vector<BVHNode> nodes;
+	OcclusionBuffer occlusion;
+	bool needsRebuild = false;
+};
+
+uint32_t addSceneObject(Scene* scene, const RenderObject& object);
+
+void setSceneObjectTransform(Scene* scene, uint32_t objectId, const Transform& transform);
+
+//full top-down rebuild, only needed when objects are added or moved far away from their original spot
+void buildSceneBVH(Scene* scene);
+
+//refits bounds of the nodes above dirty objects
+void refitSceneBVH(Scene* scene);
+
+//downsamples depth of the frame rendered into context, call it before endFrame
+void updateOcclusionBuffer(Scene* scene, const RenderContext* context);
+
+//collects ids of objects that pass frustum(and optionally occlusion) test
+void cullScene(Scene* scene, const RenderContext* context, const Camera& camera, bool occlusionCulling, std::vector<uint32_t>* visible);
+
+#endif
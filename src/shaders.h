@@ -1,25 +1,170 @@
 #ifndef SHADERS_H
 #define SHADERS_H
 
+//size of the coarse pixels of variable rate shading, log2 of their side. Forward draws rasterized without msaa
+//run the fragment shader once per coarse pixel, depth and coverage stay per pixel
+enum ShadingRate
+{
+	SHADING_RATE_1X1 = 0,
+	SHADING_RATE_2X2 = 1,
+	SHADING_RATE_4X4 = 2
+};
+
 struct ShaderUniforms
 {
 	mat4x4 in_VP;
 	mat4x4 in_normalTransform;
 	Vec3   in_cameraPosition;
 	Vec3   in_flatColor;
-	Vec3   in_centerView;//!<view vector from the center of polygon to the camera
-	float  in_lightIntensity;
+	uint32_t in_materialId;//!<set by the renderer in deferred mode, 0 for draws shaded on the forward path
+	int in_parallaxLayers = 30;//!<the renderer copies these from the context QualityLevel
+	bool in_specular = true;
+	uint8_t in_shadingRate = SHADING_RATE_1X1;//!<ShadingRate of the draw, set by the application
+};
+
+//floats a vertex shader can hand over to the fragment stages
+static const int MAX_VARYINGS = 16;
+
+//vertex shader output, the clipper and the rasterizer interpolate the first Shader::varyingCount() varyings
+struct ShadedVertex
+{
+	Vec4 pos;//!<clip space
+	float varyings[MAX_VARYINGS];
+};
+
+//per-triangle state. It lives with whoever rasterizes the triangle, so one shader instance can serve any
+//number of triangles at once: the renderer fills the flat inputs, the rasterizer sets up the interpolation
+struct VaryingBlock
+{
+	Vec3 centerView;//!<view vector from the center of polygon to the camera
+	float lightIntensity;//!<flat lighting term of the face
+	float base[MAX_VARYINGS];//!<varyings over w at the first vertex
+	float du[MAX_VARYINGS];//!<change of varyings over w per unit of the second and third edge functions
+	float dv[MAX_VARYINGS];
+};
+
+//interpolated fragment stage inputs
+struct Fragment
+{
+	float z;//!<view depth
+	float varyings[MAX_VARYINGS];
+};
+
+inline Vec3 varyingVec3(const float* varyings, int first)
+{
+	return Vec3{varyings[first], varyings[first + 1], varyings[first + 2]};
+}
+
+inline void setVaryingVec3(float* varyings, int first, const Vec3& value)
+{
+	varyings[first] = value.x;
+	varyings[first + 1] = value.y;
+	varyings[first + 2] = value.z;
+}
+
+inline Vec4 varyingVec4(const float* varyings, int first)
+{
+	return Vec4{varyings[first], varyings[first + 1], varyings[first + 2], varyings[first + 3]};
+}
+
+inline void setVaryingVec4(float* varyings, int first, const Vec4& value)
+{
+	varyings[first] = value.x;
+	varyings[first + 1] = value.y;
+	varyings[first + 2] = value.z;
+	varyings[first + 3] = value.w;
+}
+
+//lighting parameters the deferred lighting pass shades a G-buffer pixel with
+struct DeferredMaterial
+{
+	Vec3 ambientReflectivity;
+	Vec3 diffuseReflectivity;
+	Vec3 specularReflectivity;
+	int glossinessPower;
+};
+
+//what a fragment leaves in the G-buffer instead of a color
+struct SurfaceSample
+{
+	Vec3 normal;//!<world space, normalised
+	Vec3 albedo;
+};
+
+//fragments per fragmentShaderBatch call, the rasterizer walks triangle rows this many pixels at a time. 4, 8 and 16 all work
+static const int FRAGMENT_BATCH_WIDTH = 8;
+
+//fragments of one triangle row in structure of arrays form, lane i is i pixels right of the first one.
+//Every lane gets interpolated, lanes outside of the mask hold garbage
+struct FragmentBatch
+{
+	float z[FRAGMENT_BATCH_WIDTH];
+	float varyings[MAX_VARYINGS][FRAGMENT_BATCH_WIDTH];
+	uint32_t mask;//!<bit per lane, set for fragments that passed coverage and depth tests
+};
+
+struct ColorBatch
+{
+	float r[FRAGMENT_BATCH_WIDTH];
+	float g[FRAGMENT_BATCH_WIDTH];
+	float b[FRAGMENT_BATCH_WIDTH];
 };
 
+inline void fragmentLane(const FragmentBatch& in, int lane, int numVaryings, Fragment& out)
+{
+	out.z = in.z[lane];
+	for(int i = 0; i < numVaryings; i++)
+		out.varyings[i] = in.varyings[i][lane];
+}
+
+//runs a scalar fragment shader over the active lanes of a batch, returns the lanes that weren't discarded
+template<typename FragmentFn>
+inline uint32_t shadeFragmentLanes(const FragmentBatch& in, int numVaryings, ColorBatch& out, FragmentFn fragment)
+{
+	uint32_t written = 0;
+	for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+		if(!(in.mask & 1u << i))
+			continue;
+		Fragment lane;
+		fragmentLane(in, i, numVaryings, lane);
+		bool discard = false;
+		Vec3 color = fragment(lane, discard);
+		if(discard)
+			continue;
+		out.r[i] = color.R;
+		out.g[i] = color.G;
+		out.b[i] = color.B;
+		written |= 1u << i;
+	}
+	return written;
+}
+
+//shaders only hold uniforms, everything that changes per triangle goes through the VaryingBlock the stages get
 struct Shader
 {
 	ShaderUniforms uniforms;
-	virtual Vertex vertexShader(const Vertex& in, int vn) = 0;
-	virtual Vec3 fragmentShader(const Vec3& pixelCoords, bool& discard) = 0;
-	virtual void prepareInterpolants(
-		const Vertex& v1, const Vertex& v2, const Vertex& v3, 
-		float invZ1, float invZ2, float invZ3,
-		float triArea) = 0;
+	//floats vertexShader writes to ShadedVertex::varyings, nothing past them gets clipped or interpolated
+	virtual int varyingCount() const { return 0; }
+	virtual ShadedVertex vertexShader(const Vertex& in, const VaryingBlock& varyings) const = 0;
+	virtual Vec3 fragmentShader(const Fragment& in, const VaryingBlock& varyings, bool& discard) const = 0;
+	//wide version of fragmentShader the forward rasterizer calls, returns the lanes of in.mask that got a color.
+	//The default goes lane by lane
+	virtual uint32_t fragmentShaderBatch(const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out) const
+	{
+		return shadeFragmentLanes(in, varyingCount(), out, [this, &varyings](const Fragment& fragment, bool& discard) {
+			return fragmentShader(fragment, varyings, discard);
+		});
+	}
+	//shaders that return true are split in deferred mode: surfaceShader fills the G-buffer and
+	//the lighting pass shades every pixel once with the returned material
+	virtual bool deferredMaterial(DeferredMaterial* out) const { return false; }
+	virtual void surfaceShader(const Fragment& in, const VaryingBlock& varyings, SurfaceSample& out, bool& discard) const {}
+	//snapshot of the uniforms for draws that get rasterized after renderObject returns(pipelined frames, visibility buffer)
+	virtual Shader* clone() const { return nullptr; }
+	//folds the shader's own parameters into hash, the frame cache renders a draw again when they change.
+	//Shaders that don't override it need invalidateFrameCache after a parameter change
+	virtual uint64_t hashState(uint64_t hash) const { return hash; }
+	virtual ~Shader() {}
 };
 
 struct DepthShader : Shader
@@ -27,52 +172,70 @@ struct DepthShader : Shader
 	float zNear;
 	float zFar;
 
-	Vertex vertexShader(const Vertex& in, int vn)
+	ShadedVertex vertexShader(const Vertex& in, const VaryingBlock& varyings) const
 	{
-		Vertex gl_Position = {};
+		ShadedVertex gl_Position;
 		gl_Position.pos = in.pos * uniforms.in_VP;
 		return gl_Position;
 	}
 
-	Vec3 fragmentShader(const Vec3& pixelCoords, bool& discard)
+	Vec3 fragmentShader(const Fragment& in, const VaryingBlock& varyings, bool& discard) const
 	{
 		//normalise z values between 0 and 1
-		float z = (pixelCoords.z - zNear) / (zFar - zNear);
+		float z = (in.z - zNear) / (zFar - zNear);
 		Vec3 gl_fragColor = Vec3{z * 255.f, z * 255.f, z * 255.f };
 		return gl_fragColor;
 	}
 
-	  void prepareInterpolants(
-		const Vertex& v1, const Vertex& v2, const Vertex& v3, 
-		float invZ1, float invZ2, float invZ3,
-		float triArea)
-		{
-			
-		}
+	uint32_t fragmentShaderBatch(const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out) const
+	{
+		return shadeFragmentLanes(in, 0, out, [this, &varyings](const Fragment& fragment, bool& discard) {
+			return DepthShader::fragmentShader(fragment, varyings, discard);
+		});
+	}
+
+	Shader* clone() const
+	{
+		return new DepthShader(*this);
+	}
 
+	uint64_t hashState(uint64_t hash) const
+	{
+		hash = hashValue(hash, zNear);
+		return hashValue(hash, zFar);
+	}
 };
 
 struct FlatShader : Shader
 {
-	Vertex vertexShader(const Vertex& in, int vn)
+	ShadedVertex vertexShader(const Vertex& in, const VaryingBlock& varyings) const
 	{
-		Vertex gl_Position = {};
+		ShadedVertex gl_Position;
 		gl_Position.pos = in.pos *uniforms.in_VP;
 		return gl_Position;
 	}
 
-	Vec3 fragmentShader(const Vec3& pixelCoords, bool& discard)
+	Vec3 fragmentShader(const Fragment& in, const VaryingBlock& varyings, bool& discard) const
 	{
-		Vec3 gl_fragColor = uniforms.in_flatColor * uniforms.in_lightIntensity;        
+		Vec3 gl_fragColor = uniforms.in_flatColor * varyings.lightIntensity;
 		return  clamp(gl_fragColor, RGB_BLACK, RGB_WHITE);
 	}
 
-	void prepareInterpolants(
-		const Vertex& v1, const Vertex& v2, const Vertex& v3, 
-		float invZ1, float invZ2, float invZ3,
-		float triArea)
+	uint32_t fragmentShaderBatch(const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out) const
 	{
+		return shadeFragmentLanes(in, 0, out, [this, &varyings](const Fragment& fragment, bool& discard) {
+			return FlatShader::fragmentShader(fragment, varyings, discard);
+		});
+	}
+
+	Shader* clone() const
+	{
+		return new FlatShader(*this);
+	}
 
+	uint64_t hashState(uint64_t hash) const
+	{
+		return hash;
 	}
 };
 
@@ -82,47 +245,58 @@ struct GouraudShader : Shader
 	Vec3 diffuseReflectivity = {1.f, 1.f, 1.f};
 	Vec3 specularReflectivity = {1.f, 1.f, 1.f};
 	int glossinessPower = 32;
-	Vec3 color[3];
-	Vec3 C1C0, C2C0;
 
-	Vertex vertexShader(const Vertex& in, int vn)
+	enum { VARYING_COLOR = 0, NUM_VARYINGS = 3 };
+
+	int varyingCount() const
+	{
+		return NUM_VARYINGS;
+	}
+
+	ShadedVertex vertexShader(const Vertex& in, const VaryingBlock& varyings) const
 	{
-		Vertex gl_Position = {};
+		ShadedVertex gl_Position;
 		gl_Position.pos = in.pos * uniforms.in_VP;
-		gl_Position.normal = normaliseVec3(in.normal * uniforms.in_normalTransform);
-		Vec3 in_viewVector = uniforms.in_centerView;
+		Vec3 normal = normaliseVec3(in.normal * uniforms.in_normalTransform);
+		Vec3 in_viewVector = varyings.centerView;
 
 		//assume that light comes from the same direction where the camera is
 		Vec3 in_lightVector = in_viewVector;
-		Vec3 reflectedVector = 2.f * dotVec3(gl_Position.normal, in_lightVector) * gl_Position.normal - in_lightVector;
+		Vec3 reflectedVector = 2.f * dotVec3(normal, in_lightVector) * normal - in_lightVector;
 		//here we're assuming that light intencity is {1,1,1}
 		Vec3 lightIntencity = ambientReflectivity
-			+ diffuseReflectivity * max(0.f, dotVec3(in_lightVector, gl_Position.normal))
-			+ specularReflectivity * pow(max(0.f, dotVec3(reflectedVector, in_viewVector)), glossinessPower);
+			+ diffuseReflectivity * max(0.f, dotVec3(in_lightVector, normal))
+			+ specularReflectivity * (uniforms.in_specular ? pow(max(0.f, dotVec3(reflectedVector, in_viewVector)), glossinessPower) : 0.f);
 
-		gl_Position.color = clamp(lightIntencity ^ uniforms.in_flatColor, RGB_BLACK, RGB_WHITE);
+		setVaryingVec3(gl_Position.varyings, VARYING_COLOR, clamp(lightIntencity ^ uniforms.in_flatColor, RGB_BLACK, RGB_WHITE));
 		return gl_Position;
 	}
 
-	Vec3 fragmentShader(const Vec3& pixelCoords, bool& discard)
+	Vec3 fragmentShader(const Fragment& in, const VaryingBlock& varyings, bool& discard) const
 	{        
-		Vec3 gl_fragColor = (color[0] + pixelCoords.u * C1C0 + pixelCoords.v * C2C0) * pixelCoords.z; 
+		Vec3 gl_fragColor = varyingVec3(in.varyings, VARYING_COLOR);
 		return  clamp(gl_fragColor, RGB_BLACK, RGB_WHITE);
 	}
 
-	void prepareInterpolants(
-		const Vertex& v1, const Vertex& v2, const Vertex& v3, 
-		float invZ1, float invZ2, float invZ3,
-		float triArea)
+	uint32_t fragmentShaderBatch(const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out) const
 	{
-		color[0] = v1.color * invZ1;
-		color[1] = v2.color * invZ2;
-		color[2] = v3.color * invZ3;
+		return shadeFragmentLanes(in, NUM_VARYINGS, out, [this, &varyings](const Fragment& fragment, bool& discard) {
+			return GouraudShader::fragmentShader(fragment, varyings, discard);
+		});
+	}
 
-		C1C0 = (color[1] - color[0]) / triArea;
-		C2C0 = (color[2] - color[0]) / triArea;
+	Shader* clone() const
+	{
+		return new GouraudShader(*this);
 	}
 
+	uint64_t hashState(uint64_t hash) const
+	{
+		hash = hashValue(hash, ambientReflectivity);
+		hash = hashValue(hash, diffuseReflectivity);
+		hash = hashValue(hash, specularReflectivity);
+		return hashValue(hash, glossinessPower);
+	}
 };
 
 struct PhongShader : Shader
@@ -131,53 +305,128 @@ struct PhongShader : Shader
 	Vec3 diffuseReflectivity = {1.f, 1.f, 1.f};
 	Vec3 specularReflectivity = {1.f, 1.f, 1.f};
 	int glossinessPower = 32;
-	Vec3 normal[3];
-	Vec3 N1N0, N2N0;
+	//light comes from the camera, or from the light casting the shadows when set. Deferred draws aren't shadowed
+	const ShadowMap* shadowMap = nullptr;
+	int shadowPCFRadius = 1;//!<0 for hard shadows, see sampleShadow
+
+	enum { VARYING_NORMAL = 0, NUM_VARYINGS = 3, VARYING_SHADOW = 3, VARYING_LIGHT = 7, NUM_SHADOWED_VARYINGS = 10 };
+
+	int varyingCount() const
+	{
+		return shadowMap && !uniforms.in_materialId ? NUM_SHADOWED_VARYINGS : NUM_VARYINGS;
+	}
 
-	Vertex vertexShader(const Vertex& in, int vn)
+	ShadedVertex vertexShader(const Vertex& in, const VaryingBlock& varyings) const
 	{
-		Vertex gl_Position = {};
+		ShadedVertex gl_Position;
 		gl_Position.pos = in.pos * uniforms.in_VP;
-		gl_Position.normal = normaliseVec3(in.normal * uniforms.in_normalTransform);
+		setVaryingVec3(gl_Position.varyings, VARYING_NORMAL, normaliseVec3(in.normal * uniforms.in_normalTransform));
+		//light clip space position, interpolated perspective correct like any other varying
+		if(shadowMap && !uniforms.in_materialId) {
+			setVaryingVec4(gl_Position.varyings, VARYING_SHADOW, in.pos * shadowMap->lightVP);
+			setVaryingVec3(gl_Position.varyings, VARYING_LIGHT, shadowLightVector(*shadowMap, in.pos.xyz));
+		}
 		return gl_Position;
 	}
 
-	Vec3 fragmentShader(const Vec3& pixelCoords, bool& discard)
+	Vec3 fragmentShader(const Fragment& in, const VaryingBlock& varyings, bool& discard) const
 	{
-		Vec3 gl_normal = normaliseVec3((normal[0] + pixelCoords.u * N1N0 + pixelCoords.v * N2N0) * pixelCoords.z); 
-		Vec3 in_viewVector = uniforms.in_centerView;
-		Vec3 in_lightVector = in_viewVector;
-		Vec3 diffuseContribution = diffuseReflectivity * max(0.f, dotVec3(in_lightVector, gl_normal));
+		Vec3 gl_normal = normaliseVec3(varyingVec3(in.varyings, VARYING_NORMAL));
+		Vec3 in_viewVector = varyings.centerView;
+		Vec3 in_lightVector = shadowMap ? normaliseVec3(varyingVec3(in.varyings, VARYING_LIGHT)) : in_viewVector;
+		float shadow = shadowMap ? sampleShadow(*shadowMap, varyingVec4(in.varyings, VARYING_SHADOW), shadowPCFRadius) : 1.f;
+		Vec3 diffuseContribution = diffuseReflectivity * (max(0.f, dotVec3(in_lightVector, gl_normal)) * shadow);
 		Vec3 reflectedVector = 2.f * dotVec3(gl_normal, in_lightVector) * gl_normal - in_lightVector;
-		Vec3 specularContribution = specularReflectivity * pow(max(0.f, dotVec3(reflectedVector, in_viewVector)), glossinessPower);
+		Vec3 specularContribution = specularReflectivity * (uniforms.in_specular ? pow(max(0.f, dotVec3(reflectedVector, in_viewVector)), glossinessPower) * shadow : 0.f);
 		Vec3 ambientContribution = ambientReflectivity;
 		Vec3 gl_fragColor = (diffuseContribution + specularContribution + ambientContribution) ^ uniforms.in_flatColor;
 		gl_fragColor = clamp(gl_fragColor, RGB_BLACK, RGB_WHITE);
 		return gl_fragColor;
 	}
 	
-	void prepareInterpolants(
-		const Vertex& v1, const Vertex& v2, const Vertex& v3, 
-		float invZ1, float invZ2, float invZ3,
-		float triArea)
+	uint32_t fragmentShaderBatch(const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out) const
+	{
+		//same math as fragmentShader one stage at a time over all lanes, inactive lanes are computed and ignored
+		float nx[FRAGMENT_BATCH_WIDTH], ny[FRAGMENT_BATCH_WIDTH], nz[FRAGMENT_BATCH_WIDTH];
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			Vec3 n = normaliseVec3(Vec3{in.varyings[VARYING_NORMAL][i], in.varyings[VARYING_NORMAL + 1][i], in.varyings[VARYING_NORMAL + 2][i]});
+			nx[i] = n.x;
+			ny[i] = n.y;
+			nz[i] = n.z;
+		}
+
+		const Vec3& in_viewVector = varyings.centerView;
+		Vec3 in_lightVector[FRAGMENT_BATCH_WIDTH];
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			in_lightVector[i] = shadowMap ? normaliseVec3(Vec3{in.varyings[VARYING_LIGHT][i], in.varyings[VARYING_LIGHT + 1][i],
+				in.varyings[VARYING_LIGHT + 2][i]}) : in_viewVector;
+		}
+		float diffuse[FRAGMENT_BATCH_WIDTH], specular[FRAGMENT_BATCH_WIDTH] = {};
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			Vec3 gl_normal = {nx[i], ny[i], nz[i]};
+			diffuse[i] = max(0.f, dotVec3(in_lightVector[i], gl_normal));
+		}
+		if(uniforms.in_specular) {
+			for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+				Vec3 gl_normal = {nx[i], ny[i], nz[i]};
+				Vec3 reflectedVector = 2.f * dotVec3(gl_normal, in_lightVector[i]) * gl_normal - in_lightVector[i];
+				specular[i] = pow(max(0.f, dotVec3(reflectedVector, in_viewVector)), glossinessPower);
+			}
+		}
+
+		if(shadowMap) {
+			for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+				if(!(in.mask & 1u << i))
+					continue;
+				Vec4 lightClip = {in.varyings[VARYING_SHADOW][i], in.varyings[VARYING_SHADOW + 1][i],
+					in.varyings[VARYING_SHADOW + 2][i], in.varyings[VARYING_SHADOW + 3][i]};
+				float shadow = sampleShadow(*shadowMap, lightClip, shadowPCFRadius);
+				diffuse[i] *= shadow;
+				specular[i] *= shadow;
+			}
+		}
+
+		const Vec3& color = uniforms.in_flatColor;
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			out.r[i] = clamp((diffuseReflectivity.x * diffuse[i] + specularReflectivity.x * specular[i] + ambientReflectivity.x) * color.x, 0.f, 255.f);
+			out.g[i] = clamp((diffuseReflectivity.y * diffuse[i] + specularReflectivity.y * specular[i] + ambientReflectivity.y) * color.y, 0.f, 255.f);
+			out.b[i] = clamp((diffuseReflectivity.z * diffuse[i] + specularReflectivity.z * specular[i] + ambientReflectivity.z) * color.z, 0.f, 255.f);
+		}
+		return in.mask;
+	}
+	
+	bool deferredMaterial(DeferredMaterial* out) const
+	{
+		*out = DeferredMaterial{ambientReflectivity, diffuseReflectivity, specularReflectivity, glossinessPower};
+		return true;
+	}
+
+	void surfaceShader(const Fragment& in, const VaryingBlock& varyings, SurfaceSample& out, bool& discard) const
 	{
+		out.normal = normaliseVec3(varyingVec3(in.varyings, VARYING_NORMAL));
+		out.albedo = uniforms.in_flatColor;
+	}
 
-		normal[0] = v1.normal * invZ1;
-		normal[1] = v2.normal * invZ2;
-		normal[2] = v3.normal * invZ3;
+	Shader* clone() const
+	{
+		return new PhongShader(*this);
+	}
 
-		N1N0 = (normal[1] - normal[0]) / triArea;
-		N2N0 = (normal[2] - normal[0]) / triArea;   
+	//a shadow map that gets re-rendered invalidates the frame cache itself
+	uint64_t hashState(uint64_t hash) const
+	{
+		hash = hashValue(hash, ambientReflectivity);
+		hash = hashValue(hash, diffuseReflectivity);
+		hash = hashValue(hash, specularReflectivity);
+		hash = hashValue(hash, glossinessPower);
+		hash = hashValue(hash, shadowMap);
+		return hashValue(hash, shadowPCFRadius);
 	}
 };
 
 //bump mapping(a.k.a normal mapping)
 struct BumpShader : Shader {
 
-	Vec3 lightVector[3];
-	Vec3 viewVector[3];
-	Vec3 uvs[3];
-
 	Texture* sampler2d;
 	Texture* sampler2dN;
 	Texture* sampler2dD;
@@ -185,76 +434,74 @@ struct BumpShader : Shader {
 	Vec3 diffuseReflectivity = {1.f, 1.f, 1.f};
 	Vec3 specularReflectivity = {1.f, 1.f, 1.f};
 	int glossinessPower = 4;
+	//light comes from the camera, or from the light casting the shadows when set. Deferred draws aren't shadowed
+	const ShadowMap* shadowMap = nullptr;
+	int shadowPCFRadius = 1;//!<0 for hard shadows, see sampleShadow
+
+	//forward shading stays in tangent space and may add the light clip space position,
+	//the G-buffer takes world space normals and tangents in the same slots instead
+	enum {
+		VARYING_LIGHT = 0,
+		VARYING_VIEW = 3,
+		VARYING_UV = 6,
+		NUM_FORWARD_VARYINGS = 8,
+		VARYING_SHADOW = 8,
+		NUM_SHADOWED_VARYINGS = 12,
+		VARYING_NORMAL = 8,
+		VARYING_TANGENT = 11,
+		NUM_DEFERRED_VARYINGS = 14
+	};
+
+	int varyingCount() const
+	{
+		if(uniforms.in_materialId)
+			return NUM_DEFERRED_VARYINGS;
+		return shadowMap ? NUM_SHADOWED_VARYINGS : NUM_FORWARD_VARYINGS;
+	}
 
-	Vec3 V1V0,V2V0,L1L0,L2L0,T1T0,T2T0;
-
-	Vertex vertexShader(const Vertex& in, int vn)
+	ShadedVertex vertexShader(const Vertex& in, const VaryingBlock& varyings) const
 	{
-		Vertex gl_Position = {};
+		ShadedVertex gl_Position;
 
-		//we're currently assuming that light comes from the same
-		// spot where the camera is
 		Vec3 view = normaliseVec3(uniforms.in_cameraPosition - in.pos.xyz);
-		Vec3 light = view;
+		bool shadowed = shadowMap && !uniforms.in_materialId;
+		Vec3 light = shadowed ? normaliseVec3(shadowLightVector(*shadowMap, in.pos.xyz)) : view;
 
-		gl_Position.normal = normaliseVec3(in.normal * uniforms.in_normalTransform);
-		gl_Position.tangent = normaliseVec3(in.tangent * uniforms.in_normalTransform);
-		Vec3 bitangent = normaliseVec3(cross(gl_Position.normal, gl_Position.tangent));
+		Vec3 normal = normaliseVec3(in.normal * uniforms.in_normalTransform);
+		Vec3 tangent = normaliseVec3(in.tangent * uniforms.in_normalTransform);
+		Vec3 bitangent = normaliseVec3(cross(normal, tangent));
 
 		//move view and light vectors to tangent space
-		viewVector[vn].x = dotVec3(view, gl_Position.tangent);
-		viewVector[vn].y = dotVec3(view, bitangent);
-		viewVector[vn].z = dotVec3(view, gl_Position.normal);
-
-		lightVector[vn].x = dotVec3(light, gl_Position.tangent);
-		lightVector[vn].y = dotVec3(light, bitangent);
-		lightVector[vn].z = dotVec3(light, gl_Position.normal);
-
-		gl_Position.texCoords = in.texCoords;
+		setVaryingVec3(gl_Position.varyings, VARYING_VIEW, Vec3{dotVec3(view, tangent), dotVec3(view, bitangent), dotVec3(view, normal)});
+		setVaryingVec3(gl_Position.varyings, VARYING_LIGHT, Vec3{dotVec3(light, tangent), dotVec3(light, bitangent), dotVec3(light, normal)});
+
+		gl_Position.varyings[VARYING_UV] = in.texCoords.u;
+		gl_Position.varyings[VARYING_UV + 1] = in.texCoords.v;
+		if(uniforms.in_materialId) {
+			setVaryingVec3(gl_Position.varyings, VARYING_NORMAL, normal);
+			setVaryingVec3(gl_Position.varyings, VARYING_TANGENT, tangent);
+		}
+		else if(shadowed) {
+			setVaryingVec4(gl_Position.varyings, VARYING_SHADOW, in.pos * shadowMap->lightVP);
+		}
 
 		gl_Position.pos = in.pos * uniforms.in_VP;
 
 		return gl_Position;
 	}
 
-
-	void prepareInterpolants(
-		const Vertex& v1, const Vertex& v2, const Vertex& v3, 
-		float invZ1, float invZ2, float invZ3,
-		float triArea)
+	//steps along the view ray through the height map, returns false for fragments that end up outside of the texture
+	bool parallaxMap(const Fragment& in, Vec3& interpUVs, Vec3& interpLight, Vec3& interpView) const
 	{
-		
-		lightVector[0] *= invZ1;
-		lightVector[1] *= invZ2;
-		lightVector[2] *= invZ3;
-
-		L1L0 = (lightVector[1] - lightVector[0]) / triArea;
-		L2L0 = (lightVector[2] - lightVector[0]) / triArea;
-
-		viewVector[0] *= invZ1;
-		viewVector[1] *= invZ2;
-		viewVector[2] *= invZ3;
-
-		V1V0 = (viewVector[1] - viewVector[0]) / triArea;
-		V2V0 = (viewVector[2] - viewVector[0]) / triArea;
-		
-		uvs[0] = v1.texCoords * invZ1;
-		uvs[1] = v2.texCoords * invZ2;
-		uvs[2] = v3.texCoords * invZ3;
-
-		T1T0 = (uvs[1] - uvs[0]) / triArea;
-		T2T0 = (uvs[2] - uvs[0]) / triArea;
+		interpUVs = Vec3{in.varyings[VARYING_UV], in.varyings[VARYING_UV + 1], 0.f};
+		interpLight = normaliseVec3(varyingVec3(in.varyings, VARYING_LIGHT));
+		interpView = normaliseVec3(varyingVec3(in.varyings, VARYING_VIEW));
+		return parallaxOffset(interpUVs, interpView);
 	}
 
-	Vec3 fragmentShader(const Vec3& pixelCoords, bool& discard)
+	bool parallaxOffset(Vec3& interpUVs, const Vec3& interpView) const
 	{
-		Vec3 interpUVs = (uvs[0] + pixelCoords.u * T1T0 + pixelCoords.v * T2T0) * pixelCoords.z; 
-		Vec3 interpLight = (lightVector[0] + pixelCoords.u * L1L0 + pixelCoords.v * L2L0) * pixelCoords.z; 
-		Vec3 interpView = (viewVector[0] + pixelCoords.u * V1V0 + pixelCoords.v * V2V0) * pixelCoords.z; 
-		interpLight = normaliseVec3(interpLight);
-		interpView = normaliseVec3(interpView);
-
-		int numLayers = 30;
+		int numLayers = max(uniforms.in_parallaxLayers, 1);
 		float layerStep = 1.f / (float)numLayers;
 		float currentDiscreteHeight = 0.f;
 		Vec2 uvStep = interpView.xy* 0.2f/(float)(numLayers);
@@ -281,7 +528,13 @@ struct BumpShader : Shader {
 		interpUVs = lerp(prevUVs, interpUVs, weight);
 
 		//discard fragments at texture border
-		if(interpUVs.u > 1 || interpUVs.u < 0 || interpUVs.v > 1 || interpUVs.v < 0) {
+		return !(interpUVs.u > 1 || interpUVs.u < 0 || interpUVs.v > 1 || interpUVs.v < 0);
+	}
+
+	Vec3 fragmentShader(const Fragment& in, const VaryingBlock& varyings, bool& discard) const
+	{
+		Vec3 interpUVs, interpLight, interpView;
+		if(!parallaxMap(in, interpUVs, interpLight, interpView)) {
 			discard = true;
 			return Vec3{};
 		}
@@ -293,15 +546,97 @@ struct BumpShader : Shader {
 		normal = normaliseVec3(normal);
 
 		Vec3 gl_fragColor = {};
-		Vec3 diffuseContribution = diffuseReflectivity * max(0.f, dotVec3(interpLight, normal));
+		float shadow = shadowMap ? sampleShadow(*shadowMap, varyingVec4(in.varyings, VARYING_SHADOW), shadowPCFRadius) : 1.f;
+		Vec3 diffuseContribution = diffuseReflectivity * (max(0.f, dotVec3(interpLight, normal)) * shadow);
 		Vec3 reflectedVector = 2.f * dotVec3(normal, interpLight) * normal - interpLight;
-		Vec3 specularContribution = specularReflectivity * pow(max(0.f, dotVec3(reflectedVector, interpView)), glossinessPower);
+		Vec3 specularContribution = specularReflectivity * (uniforms.in_specular ? pow(max(0.f, dotVec3(reflectedVector, interpView)), glossinessPower) * shadow : 0.f);
 		Vec3 ambientContribution = ambientReflectivity;
 		gl_fragColor = (diffuseContribution + specularContribution + ambientContribution) ^ color;
 		gl_fragColor = clamp(gl_fragColor, RGB_BLACK, RGB_WHITE);
 		return gl_fragColor;
 	}
-	
+
+	uint32_t fragmentShaderBatch(const FragmentBatch& in, const VaryingBlock& varyings, ColorBatch& out) const
+	{
+		//normalisation and lighting run over all lanes, the height map search and texture fetches per active lane
+		Vec3 interpUVs[FRAGMENT_BATCH_WIDTH], interpLight[FRAGMENT_BATCH_WIDTH], interpView[FRAGMENT_BATCH_WIDTH];
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			interpUVs[i] = Vec3{in.varyings[VARYING_UV][i], in.varyings[VARYING_UV + 1][i], 0.f};
+			interpLight[i] = normaliseVec3(Vec3{in.varyings[VARYING_LIGHT][i], in.varyings[VARYING_LIGHT + 1][i], in.varyings[VARYING_LIGHT + 2][i]});
+			interpView[i] = normaliseVec3(Vec3{in.varyings[VARYING_VIEW][i], in.varyings[VARYING_VIEW + 1][i], in.varyings[VARYING_VIEW + 2][i]});
+		}
+
+		uint32_t written = 0;
+		Vec3 color[FRAGMENT_BATCH_WIDTH] = {};
+		Vec3 normal[FRAGMENT_BATCH_WIDTH] = {};
+		float shadow[FRAGMENT_BATCH_WIDTH];
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			shadow[i] = 1.f;
+			if(!(in.mask & 1u << i) || !parallaxOffset(interpUVs[i], interpView[i]))
+				continue;
+			color[i] = sampleTexture3ch(sampler2d, interpUVs[i].xy);
+			normal[i] = normaliseVec3((sampleTexture3ch(sampler2dN, interpUVs[i].xy) - 128.f)/128.f);
+			if(shadowMap) {
+				Vec4 lightClip = {in.varyings[VARYING_SHADOW][i], in.varyings[VARYING_SHADOW + 1][i],
+					in.varyings[VARYING_SHADOW + 2][i], in.varyings[VARYING_SHADOW + 3][i]};
+				shadow[i] = sampleShadow(*shadowMap, lightClip, shadowPCFRadius);
+			}
+			written |= 1u << i;
+		}
+
+		for(int i = 0; i < FRAGMENT_BATCH_WIDTH; i++) {
+			float diffuse = max(0.f, dotVec3(interpLight[i], normal[i])) * shadow[i];
+			Vec3 reflectedVector = 2.f * dotVec3(normal[i], interpLight[i]) * normal[i] - interpLight[i];
+			float specular = uniforms.in_specular ? pow(max(0.f, dotVec3(reflectedVector, interpView[i])), glossinessPower) * shadow[i] : 0.f;
+			out.r[i] = clamp((diffuseReflectivity.x * diffuse + specularReflectivity.x * specular + ambientReflectivity.x) * color[i].x, 0.f, 255.f);
+			out.g[i] = clamp((diffuseReflectivity.y * diffuse + specularReflectivity.y * specular + ambientReflectivity.y) * color[i].y, 0.f, 255.f);
+			out.b[i] = clamp((diffuseReflectivity.z * diffuse + specularReflectivity.z * specular + ambientReflectivity.z) * color[i].z, 0.f, 255.f);
+		}
+		return written;
+	}
+
+	bool deferredMaterial(DeferredMaterial* out) const
+	{
+		*out = DeferredMaterial{ambientReflectivity, diffuseReflectivity, specularReflectivity, glossinessPower};
+		return true;
+	}
+
+	void surfaceShader(const Fragment& in, const VaryingBlock& varyings, SurfaceSample& out, bool& discard) const
+	{
+		Vec3 interpUVs, interpLight, interpView;
+		if(!parallaxMap(in, interpUVs, interpLight, interpView)) {
+			discard = true;
+			return;
+		}
+
+		Vec3 N = normaliseVec3(varyingVec3(in.varyings, VARYING_NORMAL));
+		Vec3 T = varyingVec3(in.varyings, VARYING_TANGENT);
+		T = normaliseVec3(T - N * dotVec3(N, T));
+		Vec3 B = cross(N, T);
+		Vec3 normal = normaliseVec3((sampleTexture3ch(sampler2dN, interpUVs.xy) - 128.f)/128.f);
+
+		out.normal = normaliseVec3(normal.x * T + normal.y * B + normal.z * N);
+		out.albedo = sampleTexture3ch(sampler2d, interpUVs.xy);
+	}
+
+	Shader* clone() const
+	{
+		return new BumpShader(*this);
+	}
+
+	//textures are compared by address, editing their texels needs invalidateFrameCache
+	uint64_t hashState(uint64_t hash) const
+	{
+		hash = hashValue(hash, sampler2d);
+		hash = hashValue(hash, sampler2dN);
+		hash = hashValue(hash, sampler2dD);
+		hash = hashValue(hash, ambientReflectivity);
+		hash = hashValue(hash, diffuseReflectivity);
+		hash = hashValue(hash, specularReflectivity);
+		hash = hashValue(hash, glossinessPower);
+		hash = hashValue(hash, shadowMap);
+		return hashValue(hash, shadowPCFRadius);
+	}
 };
 
-#endif
\ No newline at end of file
+#endif
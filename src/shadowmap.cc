@@ -0,0 +1,177 @@
+#include "shadowmap.h"
+#include "renderer.h"
+#include "primitives.h"
+#include "clipper.h"
+#include "pipeline.h"
+#include "hash.h"
+#include <cstring>
+#include <limits>
+
+//meshes are identified by their buffers, editing one in place needs invalidateShadowMap
+static uint64_t hashCasters(uint64_t hash, const ShadowCaster* casters, uint32_t numCasters)
+{
+	for(uint32_t i = 0; i < numCasters; i++) {
+		const Mesh* mesh = casters[i].mesh;
+		const void* buffers[2] = {mesh->faces.data(), mesh->vertPos.data()};
+		size_t numFaces = mesh->faces.size();
+		hash = hashBytes(hash, buffers, sizeof(buffers));
+		hash = hashBytes(hash, &numFaces, sizeof(numFaces));
+		hash = hashBytes(hash, &casters[i].modelToWorldTransform, sizeof(mat4x4));
+	}
+	return hash;
+}
+
+//light clip space triangle and the map rows it covers
+struct ShadowTriangle
+{
+	Vec4 clip[3];
+	int botY;
+	int topY;
+};
+
+static void binCaster(const ShadowMap& map, const ShadowCaster& caster, std::vector<ShadowTriangle>& out)
+{
+	//only positions are fetched, model and light transforms go through a single matrix
+	const Mesh& mesh = *caster.mesh;
+	mat4x4 toLightClip = caster.modelToWorldTransform * map.lightVP;
+	for(const Face& face : mesh.faces) {
+		ShadowTriangle triangle;
+		uint8_t outsideMask = 0x3f;
+		bool behindLight = false;
+		float minY = std::numeric_limits<float>::max();
+		float maxY = -std::numeric_limits<float>::max();
+		for(uint8_t i = 0; i < 3; i++) {
+			Vec4& c = triangle.clip[i];
+			c = homogenize(mesh.vertPos[face.vIndex[i] - 1]) * toLightClip;
+			outsideMask &= frustumOutcode(c);
+			if(c.w <= 0.f) {
+				behindLight = true;
+				continue;
+			}
+			float y = (perspectiveDivide(c) * map.viewportTransform).y;
+			minY = min(minY, y);
+			maxY = max(maxY, y);
+		}
+		if(outsideMask)
+			continue;
+
+		triangle.botY = 0;
+		triangle.topY = map.size - 1;
+		if(!behindLight) {
+			triangle.botY = max((int)(minY - 1.f), 0);
+			triangle.topY = min((int)(maxY + 1.f), map.size - 1);
+		}
+		if(triangle.botY <= triangle.topY)
+			out.push_back(triangle);
+	}
+}
+
+//every band starts its rows from source(far plane when null) and rasterizes the triangles touching them
+static void rasterizeShadowLayer(RenderContext* context, const ShadowMap& map, float* depth, const float* source,
+	const std::vector<ShadowTriangle>& triangles)
+{
+	uint32_t numBands = rasterBandCount(context);
+	int bandHeight = (map.size + numBands - 1) / numBands;
+	parallelFor(context->jobs, numBands, 1, [&](uint32_t first, uint32_t end) {
+		for(uint32_t band = first; band < end; band++) {
+			ScissorRect scissor = {0, (int)band * bandHeight, map.size - 1, min(((int)band + 1) * bandHeight, map.size) - 1};
+			if(scissor.minY > scissor.maxY)
+				continue;
+
+			size_t rowTexels = (size_t)map.size * (scissor.maxY - scissor.minY + 1);
+			float* rows = depth + (size_t)scissor.minY * map.size;
+			if(source)
+				memcpy(rows, source + (size_t)scissor.minY * map.size, rowTexels * sizeof(float));
+			else
+				std::fill(rows, rows + rowTexels, std::numeric_limits<float>::max());
+
+			for(const ShadowTriangle& triangle : triangles) {
+				if(triangle.topY < scissor.minY || triangle.botY > scissor.maxY)
+					continue;
+				drawDepthTriangle(map, depth, triangle.clip[0], triangle.clip[1], triangle.clip[2], scissor);
+			}
+		}
+	});
+}
+
+bool createShadowMap(RenderContext* context, ShadowMap* map, uint32_t size)
+{
+	*map = ShadowMap();
+	if(!reservePoolMemory(context->targetPool, (void**)&map->staticDepth, (size_t)size * size * sizeof(float))) {
+		printf("Failed to allocate shadow map memory\n");
+		return false;
+	}
+	map->size = size;
+	map->viewportTransform = viewport(size, size);
+	map->depth = map->staticDepth;
+	return true;
+}
+
+void releaseShadowMap(RenderContext* context, ShadowMap* map)
+{
+	releasePoolMemory(context->targetPool, map->staticDepth);
+	releasePoolMemory(context->targetPool, map->dynamicDepth);
+	*map = ShadowMap();
+}
+
+//the center of projection is the point the projection sends to the camera plane(clip w = 0) on the view axis.
+//Perspective lights put it at the light, orthographic ones at infinity behind it
+static Vec4 lightPosition(const mat4x4& lightVP)
+{
+	Vec4 eye = Vec4{0.f, 0.f, 1.f, 0.f} * inverse(lightVP);
+	if(std::abs(eye.w) > 1e-6f * lengthVec3(eye.xyz))
+		return homogenize(eye.xyz * (1.f / eye.w));
+	Vec3 towardsLight = normaliseVec3(eye.xyz) * -1.f;
+	return Vec4{towardsLight.x, towardsLight.y, towardsLight.z, 0.f};
+}
+
+bool updateShadowMap(RenderContext* context, ShadowMap* map, const mat4x4& lightVP,
+	const ShadowCaster* staticCasters, uint32_t numStatic, const ShadowCaster* dynamicCasters, uint32_t numDynamic)
+{
+	//bias is baked into the depth, changing it re-renders like moving the light does
+	uint64_t staticKey = hashBytes(FNV_OFFSET, &lightVP, sizeof(lightVP));
+	staticKey = hashBytes(staticKey, &map->depthBias, sizeof(map->depthBias));
+	staticKey = hashBytes(staticKey, &map->slopeBias, sizeof(map->slopeBias));
+	staticKey = hashCasters(staticKey, staticCasters, numStatic);
+	uint64_t dynamicKey = hashCasters(staticKey, dynamicCasters, numDynamic);
+	bool staticDirty = !map->staticValid || staticKey != map->staticKey;
+	if(!staticDirty && dynamicKey == map->dynamicKey)
+		return false;
+
+	//recorded frames sample the map when they get rasterized
+	if(context->pipeline)
+		drainFramePipeline(context);
+	//shadows move under draws the frame cache would keep
+	invalidateFrameCache(context);
+
+	map->lightVP = lightVP;
+	map->lightPosition = lightPosition(lightVP);
+	std::vector<ShadowTriangle> triangles;
+	if(staticDirty) {
+		for(uint32_t i = 0; i < numStatic; i++)
+			binCaster(*map, staticCasters[i], triangles);
+		rasterizeShadowLayer(context, *map, map->staticDepth, nullptr, triangles);
+		map->staticKey = staticKey;
+		map->staticValid = true;
+	}
+
+	map->depth = map->staticDepth;
+	if(numDynamic) {
+		if(!reservePoolMemory(context->targetPool, (void**)&map->dynamicDepth, (size_t)map->size * map->size * sizeof(float))) {
+			printf("Failed to allocate shadow map memory\n");
+			return true;
+		}
+		triangles.clear();
+		for(uint32_t i = 0; i < numDynamic; i++)
+			binCaster(*map, dynamicCasters[i], triangles);
+		rasterizeShadowLayer(context, *map, map->dynamicDepth, map->staticDepth, triangles);
+		map->depth = map->dynamicDepth;
+	}
+	map->dynamicKey = dynamicKey;
+	return true;
+}
+
+void invalidateShadowMap(ShadowMap* map)
+{
+	map->staticValid = false;
+}
@@ -0,0 +1,82 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include "maths.h"
+#include "obj.h"
+
+struct RenderContext;
+
+//depth of the casters closest to the light in light space NDC, rendered by a depth-only rasterizer.
+//Casters are split in two layers: static ones are cached and only re-rendered when the light or one of them moves,
+//dynamic ones are drawn over a copy of the static layer
+struct ShadowMap
+{
+	float* staticDepth;
+	float* dynamicDepth;//!<null until there are dynamic casters
+	const float* depth;//!<layer shaders sample, one of the two above
+	int size;//!<texels per side
+	mat4x4 lightVP;
+	mat4x4 viewportTransform;
+	Vec4 lightPosition;//!<world space position of the light, w = 0 for an orthographic lightVP where xyz points towards the light
+	float depthBias = 0.0005f;//!<NDC depth casters are pushed away from the light by
+	float slopeBias = 1.5f;//!<extra push per texel of caster depth slope, keeps receivers from shadowing themselves
+	uint64_t staticKey;//!<light and static casters the cached layer was rendered with
+	uint64_t dynamicKey;
+	bool staticValid;
+};
+
+struct ShadowCaster
+{
+	const Mesh* mesh;
+	mat4x4 modelToWorldTransform;
+};
+
+//fraction of the light reaching a point given in light clip space, points outside of the map are lit.
+//pcfRadius 0 does a single depth comparison, otherwise the (2 * pcfRadius + 1)^2 texels around the point are averaged
+inline float sampleShadow(const ShadowMap& map, const Vec4& lightClip, int pcfRadius)
+{
+	if(lightClip.w <= 0.f)
+		return 1.f;
+	Vec4 ndc = perspectiveDivide(lightClip);
+	if(ndc.z > 1.f)
+		return 1.f;
+
+	Vec4 texel = ndc * map.viewportTransform;
+	int x = (int)std::floor(texel.x + 0.5f);
+	int y = (int)std::floor(texel.y + 0.5f);
+	if(x < -pcfRadius || y < -pcfRadius || x >= map.size + pcfRadius || y >= map.size + pcfRadius)
+		return 1.f;
+
+	int lit = 0;
+	for(int ty = y - pcfRadius; ty <= y + pcfRadius; ty++) {
+		const float* row = map.depth + min(max(ty, 0), map.size - 1) * map.size;
+		for(int tx = x - pcfRadius; tx <= x + pcfRadius; tx++)
+			lit += ndc.z <= row[min(max(tx, 0), map.size - 1)];
+	}
+	int taps = (2 * pcfRadius + 1) * (2 * pcfRadius + 1);
+	return lit / (float)taps;
+}
+
+//unnormalised vector from a world space point towards the light casting the map's shadows
+inline Vec3 shadowLightVector(const ShadowMap& map, const Vec3& position)
+{
+	if(map.lightPosition.w == 0.f)
+		return map.lightPosition.xyz;
+	return map.lightPosition.xyz - position;
+}
+
+//allocates the static layer from the context pool, size is in texels per side
+bool createShadowMap(RenderContext* context, ShadowMap* map, uint32_t size);
+
+void releaseShadowMap(RenderContext* context, ShadowMap* map);
+
+//re-renders what changed since the last update: nothing when the light and every caster are where they were,
+//only the dynamic layer when just dynamic casters moved. Returns true when the map got re-rendered.
+//Pipelined frames still sampling the map are finished first
+bool updateShadowMap(RenderContext* context, ShadowMap* map, const mat4x4& lightVP,
+	const ShadowCaster* staticCasters, uint32_t numStatic, const ShadowCaster* dynamicCasters, uint32_t numDynamic);
+
+//casters are only compared by mesh and transform, call this after editing a static caster's vertices
+void invalidateShadowMap(ShadowMap* map);
+
+#endif
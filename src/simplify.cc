@@ -0,0 +1,371 @@
+//mesh simplification stuff
+#include "obj.h"
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+
+//symmetric 4x4 matrix, only upper triangle is stored
+struct Quadric
+{
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+};
+
+struct Collapse
+{
+	float cost;
+	uint32_t from;
+	uint32_t to;
+	uint32_t stamp;
+
+	bool operator<(const Collapse& other) const { return cost > other.cost; }
+};
+
+//attribute indices of one face corner, corners with different tuples at the same position form a seam
+struct Corner
+{
+	int64_t v;
+	int64_t t;
+	int64_t n;
+	int64_t tan;
+
+	bool operator==(const Corner& other) const
+	{
+		return v == other.v && t == other.t && n == other.n && tan == other.tan;
+	}
+};
+
+struct Simplifier
+{
+	std::vector<Face> faces;
+	std::vector<bool> faceAlive;
+	std::vector<uint32_t> weld;//!<position index -> welded vertex
+	std::vector<Vec3> positions;//!<welded vertex positions
+	std::vector<Quadric> quadrics;
+	std::vector<std::vector<uint32_t>> vertexFaces;
+	std::vector<uint32_t> stamps;
+	std::vector<bool> vertexAlive;
+	std::priority_queue<Collapse> queue;
+	uint32_t liveFaces;
+};
+
+static Quadric planeQuadric(const Vec3& n, float d, float weight)
+{
+	return Quadric {
+		weight * n.x * n.x, weight * n.x * n.y, weight * n.x * n.z, weight * n.x * d,
+		weight * n.y * n.y, weight * n.y * n.z, weight * n.y * d,
+		weight * n.z * n.z, weight * n.z * d,
+		weight * d * d
+	};
+}
+
+static void addQuadric(Quadric& out, const Quadric& in)
+{
+	double* dst = &out.a00;
+	const double* src = &in.a00;
+	for(int i = 0; i < 10; i++)
+		dst[i] += src[i];
+}
+
+static double evalQuadric(const Quadric& q, const Vec3& v)
+{
+	double x = v.x, y = v.y, z = v.z;
+	return q.a00 * x * x + 2 * q.a01 * x * y + 2 * q.a02 * x * z + 2 * q.a03 * x
+		+ q.a11 * y * y + 2 * q.a12 * y * z + 2 * q.a13 * y
+		+ q.a22 * z * z + 2 * q.a23 * z
+		+ q.a33;
+}
+
+static inline uint32_t faceVertex(const Simplifier& s, const Face& face, int corner)
+{
+	return s.weld[face.vIndex[corner] - 1];
+}
+
+static inline int findCorner(const Simplifier& s, const Face& face, uint32_t vertex)
+{
+	for(int i = 0; i < 3; i++) {
+		if(faceVertex(s, face, i) == vertex)
+			return i;
+	}
+	return -1;
+}
+
+static inline Corner getCorner(const Face& face, int corner)
+{
+	return Corner{face.vIndex[corner], face.tIndex[corner], face.nIndex[corner], face.tanIndex[corner]};
+}
+
+static inline void setCorner(Face& face, int corner, const Corner& value)
+{
+	face.vIndex[corner] = value.v;
+	face.tIndex[corner] = value.t;
+	face.nIndex[corner] = value.n;
+	face.tanIndex[corner] = value.tan;
+}
+
+static Vec3 faceNormal(const Vec3& v0, const Vec3& v1, const Vec3& v2)
+{
+	return cross(v1 - v0, v2 - v0);
+}
+
+//drops dead faces from the adjacency list and returns live neighbours of the vertex
+static void gatherNeighbours(Simplifier& s, uint32_t vertex, std::vector<uint32_t>& out)
+{
+	out.clear();
+	std::vector<uint32_t>& adjacent = s.vertexFaces[vertex];
+	size_t live = 0;
+	for(size_t i = 0; i < adjacent.size(); i++) {
+		const Face& face = s.faces[adjacent[i]];
+		if(!s.faceAlive[adjacent[i]] || findCorner(s, face, vertex) < 0)
+			continue;
+		adjacent[live++] = adjacent[i];
+		for(int c = 0; c < 3; c++) {
+			uint32_t other = faceVertex(s, face, c);
+			if(other != vertex && std::find(out.begin(), out.end(), other) == out.end())
+				out.push_back(other);
+		}
+	}
+	adjacent.resize(live);
+}
+
+static uint32_t countEdgeFaces(const Simplifier& s, uint32_t from, uint32_t to)
+{
+	uint32_t count = 0;
+	for(uint32_t faceIdx : s.vertexFaces[from]) {
+		if(s.faceAlive[faceIdx] && findCorner(s, s.faces[faceIdx], to) >= 0)
+			count++;
+	}
+	return count;
+}
+
+static bool isBorderVertex(Simplifier& s, uint32_t vertex, std::vector<uint32_t>& scratch)
+{
+	gatherNeighbours(s, vertex, scratch);
+	for(uint32_t other : scratch) {
+		if(countEdgeFaces(s, vertex, other) == 1)
+			return true;
+	}
+	return false;
+}
+
+static void pushCollapse(Simplifier& s, uint32_t from, uint32_t to)
+{
+	Quadric q = s.quadrics[from];
+	addQuadric(q, s.quadrics[to]);
+	float cost = (float)max(0.0, evalQuadric(q, s.positions[to]));
+	s.queue.push(Collapse{cost, from, to, s.stamps[from] + s.stamps[to]});
+}
+
+static void pushVertexCollapses(Simplifier& s, uint32_t vertex, std::vector<uint32_t>& scratch)
+{
+	gatherNeighbours(s, vertex, scratch);
+	for(uint32_t other : scratch) {
+		pushCollapse(s, vertex, other);
+		pushCollapse(s, other, vertex);
+	}
+}
+
+//moves every face of "from" onto "to" keeping attributes of the matching side of the seam
+static bool tryCollapse(Simplifier& s, uint32_t from, uint32_t to, std::vector<uint32_t>& scratch)
+{
+	std::vector<uint32_t> edgeFaces;
+	std::vector<uint32_t> movedFaces;
+	for(uint32_t faceIdx : s.vertexFaces[from]) {
+		if(!s.faceAlive[faceIdx] || findCorner(s, s.faces[faceIdx], from) < 0)
+			continue;
+		if(findCorner(s, s.faces[faceIdx], to) >= 0)
+			edgeFaces.push_back(faceIdx);
+		else
+			movedFaces.push_back(faceIdx);
+	}
+	if(edgeFaces.empty() || edgeFaces.size() > 2)
+		return false;
+
+	//border vertices may only slide along the border
+	if(edgeFaces.size() == 2 && isBorderVertex(s, from, scratch))
+		return false;
+
+	//link condition, vertices shared by both one-rings must be the ones opposite to the collapsed edge
+	std::vector<uint32_t> fromRing;
+	gatherNeighbours(s, from, fromRing);
+	gatherNeighbours(s, to, scratch);
+	uint32_t shared = 0;
+	for(uint32_t vertex : fromRing) {
+		if(std::find(scratch.begin(), scratch.end(), vertex) != scratch.end())
+			shared++;
+	}
+	if(shared != edgeFaces.size())
+		return false;
+
+	std::vector<Corner> replacements(movedFaces.size());
+	for(size_t i = 0; i < movedFaces.size(); i++) {
+		const Face& face = s.faces[movedFaces[i]];
+		int corner = findCorner(s, face, from);
+		Corner fromCorner = getCorner(face, corner);
+
+		//pick attributes of "to" from the edge face lying on the same side of a seam
+		bool matched = false;
+		for(uint32_t edgeFace : edgeFaces) {
+			const Face& other = s.faces[edgeFace];
+			if(getCorner(other, findCorner(s, other, from)) == fromCorner) {
+				replacements[i] = getCorner(other, findCorner(s, other, to));
+				matched = true;
+				break;
+			}
+		}
+		if(!matched)
+			return false;
+
+		//reject collapses that flip faces
+		Vec3 p[3] = {};
+		for(int c = 0; c < 3; c++)
+			p[c] = s.positions[faceVertex(s, face, c)];
+		Vec3 before = faceNormal(p[0], p[1], p[2]);
+		p[corner] = s.positions[to];
+		Vec3 after = faceNormal(p[0], p[1], p[2]);
+		if(dotVec3(before, after) <= 0.f)
+			return false;
+	}
+
+	for(uint32_t faceIdx : edgeFaces) {
+		s.faceAlive[faceIdx] = false;
+		s.liveFaces--;
+	}
+
+	for(size_t i = 0; i < movedFaces.size(); i++) {
+		Face& face = s.faces[movedFaces[i]];
+		setCorner(face, findCorner(s, face, from), replacements[i]);
+		s.vertexFaces[to].push_back(movedFaces[i]);
+	}
+
+	addQuadric(s.quadrics[to], s.quadrics[from]);
+	s.vertexAlive[from] = false;
+	s.vertexFaces[from].clear();
+	s.stamps[to]++;
+	return true;
+}
+
+static void initSimplifier(Simplifier& s, const Mesh& mesh)
+{
+	s.faces = mesh.faces;
+	s.faceAlive.assign(s.faces.size(), true);
+	s.liveFaces = s.faces.size();
+
+	//weld positions so that split vertices are treated as seams instead of holes
+	std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+	s.weld.resize(mesh.vertPos.size());
+	for(uint32_t i = 0; i < mesh.vertPos.size(); i++) {
+		const Vec3& pos = mesh.vertPos[i];
+		uint32_t bits[3];
+		memcpy(bits, pos.data, sizeof(bits));
+		uint64_t hash = (uint64_t)bits[0] * 73856093u ^ (uint64_t)bits[1] * 19349663u ^ (uint64_t)bits[2] * 83492791u;
+
+		std::vector<uint32_t>& bucket = buckets[hash];
+		s.weld[i] = s.positions.size();
+		for(uint32_t welded : bucket) {
+			if(s.positions[welded] == pos) {
+				s.weld[i] = welded;
+				break;
+			}
+		}
+		if(s.weld[i] == s.positions.size()) {
+			bucket.push_back(s.positions.size());
+			s.positions.push_back(pos);
+		}
+	}
+
+	uint32_t numVertices = s.positions.size();
+	s.quadrics.assign(numVertices, Quadric{});
+	s.vertexFaces.assign(numVertices, std::vector<uint32_t>());
+	s.stamps.assign(numVertices, 0);
+	s.vertexAlive.assign(numVertices, true);
+
+	for(uint32_t i = 0; i < s.faces.size(); i++) {
+		const Face& face = s.faces[i];
+		Vec3 normal = faceNormal(s.positions[faceVertex(s, face, 0)],
+			s.positions[faceVertex(s, face, 1)], s.positions[faceVertex(s, face, 2)]);
+		normaliseVec3InPlace(normal);
+		Quadric q = planeQuadric(normal, -dotVec3(normal, s.positions[faceVertex(s, face, 0)]), 1.f);
+		for(int c = 0; c < 3; c++) {
+			addQuadric(s.quadrics[faceVertex(s, face, c)], q);
+			s.vertexFaces[faceVertex(s, face, c)].push_back(i);
+		}
+	}
+
+	//border edges get a heavy plane perpendicular to the face to keep the outline in place
+	std::vector<uint32_t> scratch;
+	for(uint32_t i = 0; i < s.faces.size(); i++) {
+		const Face& face = s.faces[i];
+		Vec3 p[3] = {};
+		for(int c = 0; c < 3; c++)
+			p[c] = s.positions[faceVertex(s, face, c)];
+		Vec3 normal = normaliseVec3(faceNormal(p[0], p[1], p[2]));
+
+		for(int c = 0; c < 3; c++) {
+			uint32_t v0 = faceVertex(s, face, c);
+			uint32_t v1 = faceVertex(s, face, (c + 1) % 3);
+			if(countEdgeFaces(s, v0, v1) != 1)
+				continue;
+			Vec3 edgeNormal = normaliseVec3(cross(p[(c + 1) % 3] - p[c], normal));
+			Quadric q = planeQuadric(edgeNormal, -dotVec3(edgeNormal, p[c]), 10.f);
+			addQuadric(s.quadrics[v0], q);
+			addQuadric(s.quadrics[v1], q);
+		}
+	}
+
+	for(uint32_t i = 0; i < numVertices; i++)
+		pushVertexCollapses(s, i, scratch);
+}
+
+static void snapshotLod(const Simplifier& s, MeshLod& lod)
+{
+	lod.faces.clear();
+	lod.faces.reserve(s.liveFaces);
+	for(uint32_t i = 0; i < s.faces.size(); i++) {
+		if(s.faceAlive[i])
+			lod.faces.push_back(s.faces[i]);
+	}
+}
+
+void buildLodChain(Mesh* mesh, uint32_t maxLevels, uint32_t minFaces)
+{
+	mesh->lods.clear();
+	mesh->bounds = computeMeshBounds(*mesh);
+	if(mesh->faces.size() <= minFaces)
+		return;
+
+	Simplifier s = {};
+	initSimplifier(s, *mesh);
+
+	std::vector<uint32_t> scratch;
+	float maxCost = 0.f;
+	uint32_t targetFaces = s.liveFaces / 2;
+
+	while(mesh->lods.size() < maxLevels && targetFaces >= minFaces && !s.queue.empty()) {
+		while(s.liveFaces > targetFaces && !s.queue.empty()) {
+			Collapse collapse = s.queue.top();
+			s.queue.pop();
+			if(!s.vertexAlive[collapse.from] || !s.vertexAlive[collapse.to])
+				continue;
+			if(collapse.stamp != s.stamps[collapse.from] + s.stamps[collapse.to])
+				continue;
+			if(!tryCollapse(s, collapse.from, collapse.to, scratch))
+				continue;
+			maxCost = max(maxCost, collapse.cost);
+			pushVertexCollapses(s, collapse.to, scratch);
+		}
+
+		//the rest of the edges are locked by seams or borders
+		if(s.liveFaces > targetFaces + targetFaces / 4)
+			break;
+
+		MeshLod lod = {};
+		snapshotLod(s, lod);
+		lod.error = sqrtf(maxCost);
+		mesh->lods.push_back(lod);
+		targetFaces = s.liveFaces / 2;
+	}
+}
@@ -7,5 +7,18 @@
 #include "input.h"
 #include "renderer.h"
 #include "camera.h"
+#include "scene.h"
+#include "hierarchy.h"
+#include "pipeline.h"
+#include "jobs.h"
+#include "framewriter.h"
+#include "deferred.h"
+#include "visibility.h"
+#include "shadowmap.h"
+#include "resolution.h"
+#include "quality.h"
+#include "framecache.h"
+#include "checkerboard.h"
+#include "dirtyrects.h"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "targetpool.h"
+#include <cassert>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static void* allocAligned(size_t bytes, size_t alignment)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(bytes, alignment);
+#else
+	void* memory = nullptr;
+	if(posix_memalign(&memory, alignment, bytes))
+		return nullptr;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if(alignment == TARGET_HUGE_PAGE_SIZE)
+		madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+	return memory;
+#endif
+}
+
+static void freeAligned(void* memory)
+{
+#if defined(_WIN32)
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+RenderTargetPool* createRenderTargetPool()
+{
+	RenderTargetPool* pool = new RenderTargetPool();
+	pool->reservedBytes = 0;
+	return pool;
+}
+
+void destroyRenderTargetPool(RenderTargetPool* pool)
+{
+	for(PoolBlock& block : pool->blocks) {
+		assert(!block.inUse && "render targets should be released before the pool");
+		freeAligned(block.memory);
+	}
+	delete pool;
+}
+
+void* acquirePoolMemory(RenderTargetPool* pool, size_t bytes)
+{
+	PoolBlock* best = nullptr;
+	for(PoolBlock& block : pool->blocks) {
+		if(!block.inUse && block.capacity >= bytes && (!best || block.capacity < best->capacity))
+			best = &block;
+	}
+	if(best) {
+		best->inUse = true;
+		return best->memory;
+	}
+
+	//a quarter of headroom keeps interactive resizing from reallocating every frame
+	size_t alignment = bytes >= TARGET_HUGE_PAGE_SIZE ? TARGET_HUGE_PAGE_SIZE : TARGET_ALIGNMENT;
+	size_t capacity = alignUp(bytes + bytes / 4, alignment);
+	void* memory = allocAligned(capacity, alignment);
+	if(!memory)
+		return nullptr;
+
+	pool->blocks.push_back(PoolBlock{memory, capacity, true});
+	pool->reservedBytes += capacity;
+	return memory;
+}
+
+void releasePoolMemory(RenderTargetPool* pool, void* memory)
+{
+	if(!memory)
+		return;
+	for(PoolBlock& block : pool->blocks) {
+		if(block.memory == memory) {
+			block.inUse = false;
+			return;
+		}
+	}
+	assert(!"memory doesn't belong to the pool");
+}
+
+bool reservePoolMemory(RenderTargetPool* pool, void** memory, size_t bytes)
+{
+	if(*memory && poolMemoryCapacity(pool, *memory) >= bytes)
+		return true;
+	releasePoolMemory(pool, *memory);
+	*memory = acquirePoolMemory(pool, bytes);
+	return *memory != nullptr;
+}
+
+size_t poolMemoryCapacity(const RenderTargetPool* pool, const void* memory)
+{
+	for(const PoolBlock& block : pool->blocks) {
+		if(block.memory == memory)
+			return block.capacity;
+	}
+	return 0;
+}
+
+void trimRenderTargetPool(RenderTargetPool* pool)
+{
+	size_t kept = 0;
+	for(size_t i = 0; i < pool->blocks.size(); i++) {
+		PoolBlock& block = pool->blocks[i];
+		if(block.inUse) {
+			pool->blocks[kept++] = block;
+			continue;
+		}
+		pool->reservedBytes -= block.capacity;
+		freeAligned(block.memory);
+	}
+	pool->blocks.resize(kept);
+}
@@ -0,0 +1,44 @@
+#ifndef TARGET_POOL_H
+#define TARGET_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+//buffers are 64 byte aligned, big ones are aligned to huge pages and advised to use them where supported
+static const size_t TARGET_ALIGNMENT = 64;
+static const size_t TARGET_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+struct PoolBlock
+{
+	void* memory;
+	size_t capacity;
+	bool inUse;
+};
+
+//memory for render targets of a context, released blocks stay around and get reused by later requests.
+//Not thread safe, targets are expected to be (re)allocated between frames
+struct RenderTargetPool
+{
+	std::vector<PoolBlock> blocks;
+	size_t reservedBytes;
+};
+
+RenderTargetPool* createRenderTargetPool();
+
+void destroyRenderTargetPool(RenderTargetPool* pool);
+
+//smallest free block that fits, new blocks get some headroom so growing a bit doesn't reallocate
+void* acquirePoolMemory(RenderTargetPool* pool, size_t bytes);
+
+void releasePoolMemory(RenderTargetPool* pool, void* memory);
+
+//keeps *memory when it's big enough already, otherwise swaps it for a block that fits(*memory may be null)
+bool reservePoolMemory(RenderTargetPool* pool, void** memory, size_t bytes);
+
+//0 for memory that doesn't come from the pool
+size_t poolMemoryCapacity(const RenderTargetPool* pool, const void* memory);
+
+//frees every block that isn't in use
+void trimRenderTargetPool(RenderTargetPool* pool);
+
+#endif
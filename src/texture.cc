@@ -1,15 +1,15 @@
 #include "texture.h"
+#include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-bool loadTexture(const char* path, Texture* out, bool flipImage)
+static bool decodeTexture(const char* path, Texture* out)
 {
 	int twidth;
 	int theight;
 	int numChannels;
 
-	stbi_set_flip_vertically_on_load(flipImage);
 	uint8_t* data = stbi_load(path, &twidth, &theight, &numChannels, 0);
 	
 	if(!data) {
@@ -25,6 +25,29 @@ bool loadTexture(const char* path, Texture* out, bool flipImage)
 	return true; 
 }
 
+bool loadTexture(const char* path, Texture* out, bool flipImage)
+{
+	stbi_set_flip_vertically_on_load(flipImage);
+	return decodeTexture(path, out);
+}
+
+bool loadTextures(JobSystem* jobs, const char* const* paths, Texture* out, uint32_t count, bool flipImage)
+{
+	//the flip flag is global in stb_image so it's set once before the decoding starts
+	stbi_set_flip_vertically_on_load(flipImage);
+	std::vector<char> loaded(count, 0);
+	parallelFor(jobs, count, 1, [&](uint32_t first, uint32_t end) {
+		for(uint32_t i = first; i < end; i++)
+			loaded[i] = decodeTexture(paths[i], &out[i]);
+	});
+
+	for(uint32_t i = 0; i < count; i++) {
+		if(!loaded[i])
+			return false;
+	}
+	return true;
+}
+
 Vec3 sampleTexture3ch(Texture* sampler, Vec2 uvs)
 {
 	if(uvs.u > 1 || uvs.u < 0 || uvs.v > 1 || uvs.v < 0)
@@ -2,6 +2,7 @@
 #define TEXTURE_H
 
 #include "maths.h"
+#include "jobs.h"
 #include <cstdint>
 #include <stddef.h>
 
@@ -15,6 +16,8 @@ struct Texture
 };
 
 bool loadTexture(const char* path, Texture* out, bool flipImage = false);
+//decodes count images in parallel, fails if any of them fails
+bool loadTextures(JobSystem* jobs, const char* const* paths, Texture* out, uint32_t count, bool flipImage = false);
 void unloadTexture(void* handle);
 Vec3 sampleTexture3ch(Texture* sampler, Vec2 uvs);
 uint8_t sampleTexture1ch(Texture* sampler, Vec2 uvs);
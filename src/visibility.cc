@@ -0,0 +1,228 @@
+#include "visibility.h"
+#include "rasterizer.h"
+#include <limits>
+
+bool resizeVisibilityBuffer(RenderContext* context, VisibilityBuffer* visibility, uint32_t width, uint32_t height)
+{
+	visibility->width = width;
+	visibility->height = height;
+	//room for msaa samples like the zBuffer has
+	return reservePoolMemory(context->targetPool, (void**)&visibility->ids, width * height * sizeof(uint32_t) * 4);
+}
+
+void releaseVisibilityBuffer(RenderContext* context, VisibilityBuffer* visibility)
+{
+	for(VisibilityDraw& draw : visibility->draws)
+		delete draw.shader;
+	visibility->draws.clear();
+	visibility->triangles.clear();
+	releasePoolMemory(context->targetPool, visibility->ids);
+	visibility->ids = nullptr;
+}
+
+//triangle the resolve pass last set a shader up for, consecutive pixels mostly hit the same one
+struct ResolveState
+{
+	uint32_t id;
+	const Shader* shader;
+	int numVaryings;
+	VaryingBlock varyings;
+	ShadedTriangle subTriangles[MAX_CLIPPED_TRIANGLE_COUNT];//!<vertex shader output, more than one when the triangle needed clipping
+	Vec3 screen[MAX_CLIPPED_TRIANGLE_COUNT][3];
+	uint32_t numSubTriangles;
+	int prepared;//!<sub triangle the varyings are set up for
+	float z0Inv;
+	float Z1Z0Inv;
+	float Z2Z0Inv;
+};
+
+static void setupResolveTriangle(const RenderContext* context, const VisibilityBuffer& visibility, ResolveState& state, uint32_t id)
+{
+	const VisibilityDraw& draw = visibility.draws[id >> VISIBILITY_TRIANGLE_BITS];
+	const VisibilityTriangle& triangle = visibility.triangles[draw.firstTriangle + (id & (VISIBILITY_MAX_TRIANGLES - 1))];
+	const Shader* shader = draw.shader;
+
+	state.id = id;
+	state.shader = shader;
+	state.numVaryings = shader->varyingCount();
+	state.prepared = -1;
+	state.varyings.lightIntensity = triangle.lightIntensity;
+	state.varyings.centerView = triangle.centerView;
+
+	//same vertex stage and clipping drawShadedTriangle runs
+	ShadedTriangle shaded = {
+		shader->vertexShader(triangle.triangle.v1, state.varyings),
+		shader->vertexShader(triangle.triangle.v2, state.varyings),
+		shader->vertexShader(triangle.triangle.v3, state.varyings)
+	};
+	if(isInsideViewFrustum(shaded.v1.pos) && isInsideViewFrustum(shaded.v2.pos) && isInsideViewFrustum(shaded.v3.pos)) {
+		state.numSubTriangles = 1;
+		state.subTriangles[0] = shaded;
+	}
+	else {
+		ClippResult result = clipTriangle(shaded.v1, shaded.v2, shaded.v3, state.numVaryings);
+		state.numSubTriangles = result.numTriangles;
+		for(size_t i = 0; i < result.numTriangles; i++)
+			state.subTriangles[i] = result.triangles[i];
+	}
+
+	for(uint32_t i = 0; i < state.numSubTriangles; i++) {
+		const ShadedTriangle& sub = state.subTriangles[i];
+		state.screen[i][0] = (perspectiveDivide(sub.v1.pos) * context->viewportTransform).xyz;
+		state.screen[i][1] = (perspectiveDivide(sub.v2.pos) * context->viewportTransform).xyz;
+		state.screen[i][2] = (perspectiveDivide(sub.v3.pos) * context->viewportTransform).xyz;
+	}
+}
+
+//edge functions of a sub triangle at one sample, false when the sample isn't covered
+static bool sampleEdges(const ResolveState& state, uint32_t sub, int x, int y, int offset, int* w1, int* w2)
+{
+	ScissorRect pixel = {x, y, x, y};
+	SampleRastInfo s = prepareSample(pixel, state.screen[sub][0], state.screen[sub][1], state.screen[sub][2], offset, offset);
+	if(s.leftX != x || s.rightX != x || s.topY != y || s.botY != y)
+		return false;
+	*w1 = s.w1StartRow;
+	*w2 = s.w2StartRow;
+	return (int)s.w0StartRow > 0 && *w1 > 0 && *w2 > 0;
+}
+
+static void prepareSubTriangle(ResolveState& state, uint32_t sub)
+{
+	if(state.prepared == (int)sub)
+		return;
+	state.prepared = sub;
+
+	const ShadedTriangle& triangle = state.subTriangles[sub];
+	float z0Inv = 1.f / triangle.v1.pos.w;
+	float z1Inv = 1.f / triangle.v2.pos.w;
+	float z2Inv = 1.f / triangle.v3.pos.w;
+	float triArea = computeArea(state.screen[sub][0], state.screen[sub][1], state.screen[sub][2]);
+	setupVaryings(state.varyings, state.numVaryings, triangle.v1, triangle.v2, triangle.v3, z0Inv, z1Inv, z2Inv, triArea);
+
+	state.z0Inv = z0Inv;
+	state.Z1Z0Inv = (z1Inv - z0Inv) / triArea;
+	state.Z2Z0Inv = (z2Inv - z0Inv) / triArea;
+}
+
+//runs the fragment shader of the triangle state is set up for, msaa shades at the pixel center like drawTriangleHalfSpaceMSAA
+static bool shadePixel(ResolveState& state, int x, int y, bool msaa, Vec3* color)
+{
+	int offset = msaa ? 8 : 0;
+	int w1 = 0;
+	int w2 = 0;
+	uint32_t sub = 0;
+	if(state.numSubTriangles > 1) {
+		for(sub = 0; sub < state.numSubTriangles; sub++) {
+			if(sampleEdges(state, sub, x, y, offset, &w1, &w2))
+				break;
+		}
+		//pixel center of an msaa edge pixel may be outside of every piece
+		if(sub == state.numSubTriangles)
+			sub = 0;
+	}
+	sampleEdges(state, sub, x, y, offset, &w1, &w2);
+	prepareSubTriangle(state, sub);
+
+	Fragment fragment;
+	if(msaa) {
+		float Z = 1.f / (state.z0Inv + (w1 >> 8) * state.Z1Z0Inv + (w2 >> 8) * state.Z2Z0Inv);
+		evaluateVaryings(state.varyings, state.numVaryings, (float)(w1 >> 8), (float)(w2 >> 8), Z, fragment);
+	}
+	else {
+		float Z = 1.f / (state.z0Inv + (w1 / 256.f) * state.Z1Z0Inv + (w2 / 256.f) * state.Z2Z0Inv);
+		evaluateVaryings(state.varyings, state.numVaryings, w1 / 256.f, w2 / 256.f, Z, fragment);
+	}
+
+	bool discard = false;
+	*color = state.shader->fragmentShader(fragment, state.varyings, discard);
+	return !discard;
+}
+
+static void resolvePixelMSAA(RenderContext* context, const VisibilityBuffer& visibility, ResolveState& state, int x, int y)
+{
+	RenderTargets& targets = context->rtargets;
+	uint32_t base = (y * visibility.width + x) * 4;
+	const uint32_t* ids = visibility.ids + base;
+	if(ids[0] == VISIBILITY_NONE && ids[1] == VISIBILITY_NONE && ids[2] == VISIBILITY_NONE && ids[3] == VISIBILITY_NONE)
+		return;
+
+	//every distinct triangle is shaded once no matter how many samples it covers
+	Vec3 sampleColors[4] = {};
+	bool shaded[4] = {};
+	for(int s = 0; s < 4; s++) {
+		int same = 0;
+		while(same < s && ids[same] != ids[s])
+			same++;
+		if(same < s) {
+			sampleColors[s] = sampleColors[same];
+			shaded[s] = shaded[same];
+			continue;
+		}
+		if(ids[s] == VISIBILITY_NONE)
+			continue;
+		if(ids[s] != state.id)
+			setupResolveTriangle(context, visibility, state, ids[s]);
+		shaded[s] = shadePixel(state, x, y, true, &sampleColors[s]);
+	}
+
+	//samples without a new triangle keep what was resolved before or the clear color
+	for(int s = 0; s < 4; s++) {
+		if(!shaded[s])
+			sampleColors[s] = targets.zBuffer[base + s] == std::numeric_limits<float>::max() ? targets.clearColor.xyz : targets.cBuffer[base + s];
+		targets.cBuffer[base + s] = sampleColors[s];
+	}
+	drawPixel(context->surface, x, y, (sampleColors[0] + sampleColors[1] + sampleColors[2] + sampleColors[3]) / 4);
+}
+
+void resolveVisibilityBuffer(RenderContext* context, bool msaa)
+{
+	VisibilityBuffer& visibility = *context->visibility;
+	const RenderTargets& targets = context->rtargets;
+	int stride = msaa ? 4 : 1;
+
+	if(!visibility.draws.empty()) {
+		parallelFor(context->jobs, targets.tilesY, 1, [&](uint32_t firstTileRow, uint32_t endTileRow) {
+			ResolveState state = {};
+			state.id = VISIBILITY_NONE;
+
+			for(uint32_t ty = firstTileRow; ty < endTileRow; ty++) {
+				int minY = ty * RENDER_TILE_SIZE;
+				int maxY = min(minY + RENDER_TILE_SIZE, visibility.height);
+				for(int tx = 0; tx < targets.tilesX; tx++) {
+					if(targets.tileFlags[ty * targets.tilesX + tx] & TILE_CLEARED)
+						continue;
+					int minX = tx * RENDER_TILE_SIZE;
+					int maxX = min(minX + RENDER_TILE_SIZE, visibility.width);
+					for(int y = minY; y < maxY; y++) {
+						for(int x = minX; x < maxX; x++) {
+							if(msaa) {
+								resolvePixelMSAA(context, visibility, state, x, y);
+								continue;
+							}
+							uint32_t id = visibility.ids[y * visibility.width + x];
+							if(id == VISIBILITY_NONE)
+								continue;
+							if(id != state.id)
+								setupResolveTriangle(context, visibility, state, id);
+							Vec3 color = {};
+							//discarded fragments leave whatever the surface had
+							if(shadePixel(state, x, y, false, &color))
+								drawPixel(context->surface, x, y, color);
+						}
+					}
+
+					//resolved samples must not be shaded again if more draws follow in this frame
+					for(int y = minY; y < maxY; y++) {
+						uint32_t* row = visibility.ids + y * visibility.width * stride;
+						std::fill(row + minX * stride, row + maxX * stride, VISIBILITY_NONE);
+					}
+				}
+			}
+		});
+	}
+
+	for(VisibilityDraw& draw : visibility.draws)
+		delete draw.shader;
+	visibility.draws.clear();
+	visibility.triangles.clear();
+}
@@ -0,0 +1,49 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <vector>
+#include "renderer.h"
+
+//ids pack the draw in the top bits and the face of the draw in the rest, all ones marks samples without a visible triangle
+static const uint32_t VISIBILITY_TRIANGLE_BITS = 20;
+static const uint32_t VISIBILITY_MAX_TRIANGLES = 1 << VISIBILITY_TRIANGLE_BITS;
+static const uint32_t VISIBILITY_MAX_DRAWS = (1 << (32 - VISIBILITY_TRIANGLE_BITS)) - 1;
+static const uint32_t VISIBILITY_NONE = 0xffffffff;
+
+inline uint32_t packVisibilityId(uint32_t draw, uint32_t triangle)
+{
+	return draw << VISIBILITY_TRIANGLE_BITS | triangle;
+}
+
+//shader snapshot of a draw, the resolve pass runs it for the triangles of the draw that ended up visible
+struct VisibilityDraw
+{
+	Shader* shader;
+	uint32_t firstTriangle;
+};
+
+struct VisibilityTriangle
+{
+	Triangle triangle;//!<world space
+	Vec3 centerView;
+	float lightIntensity;
+};
+
+struct VisibilityBuffer
+{
+	uint32_t* ids;//!<one per depth sample, same layout as the zBuffer
+	int width;
+	int height;
+	std::vector<VisibilityDraw> draws;
+	std::vector<VisibilityTriangle> triangles;
+};
+
+bool resizeVisibilityBuffer(RenderContext* context, VisibilityBuffer* visibility, uint32_t width, uint32_t height);
+
+void releaseVisibilityBuffer(RenderContext* context, VisibilityBuffer* visibility);
+
+//shades every sample's winning triangle once per pixel into the context surface, then forgets the recorded draws.
+//Also runs mid frame when a frame runs out of draw ids, samples resolved before keep their color
+void resolveVisibilityBuffer(RenderContext* context, bool msaa);
+
+#endif
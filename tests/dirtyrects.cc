@@ -0,0 +1,143 @@
+#include "dirtyrects.h"
+#include <cstdio>
+#include <cstdlib>
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition)
+{
+	if(!condition) {
+		printf("%s failed\n", name);
+		failures++;
+	}
+}
+
+static DirtyRects makeTiles(int width, int height)
+{
+	DirtyRects dirty = {};
+	dirty.width = width;
+	dirty.height = height;
+	dirty.tilesX = (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	dirty.tilesY = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	dirty.dirtyTiles.assign(dirty.tilesX * dirty.tilesY, 0);
+	return dirty;
+}
+
+//tile rows go bottom up like the frame's, rects are top down
+static void setTile(DirtyRects& dirty, int tx, int ty)
+{
+	dirty.dirtyTiles[ty * dirty.tilesX + tx] = 1;
+}
+
+static bool sameRect(const DirtyRect& rect, int x, int y, int width, int height)
+{
+	return rect.x == x && rect.y == y && rect.width == width && rect.height == height;
+}
+
+//rects stay inside the frame, don't overlap and cover exactly the pixels of the dirty tiles
+static bool coversDirtyTiles(const DirtyRects& dirty)
+{
+	std::vector<int> covered(dirty.width * dirty.height, 0);
+	for(const DirtyRect& rect : dirty.rects) {
+		if(rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0
+			|| rect.x + rect.width > dirty.width || rect.y + rect.height > dirty.height)
+			return false;
+		for(int y = rect.y; y < rect.y + rect.height; y++) {
+			for(int x = rect.x; x < rect.x + rect.width; x++)
+				covered[y * dirty.width + x]++;
+		}
+	}
+	for(int y = 0; y < dirty.height; y++) {
+		int ty = (dirty.height - 1 - y) / RENDER_TILE_SIZE;
+		for(int x = 0; x < dirty.width; x++) {
+			int tx = x / RENDER_TILE_SIZE;
+			if(covered[y * dirty.width + x] != dirty.dirtyTiles[ty * dirty.tilesX + tx])
+				return false;
+		}
+	}
+	return true;
+}
+
+//single rect around all dirty tiles, what's left when there are too many rects
+static bool boundsDirtyTiles(const DirtyRects& dirty)
+{
+	int minX = dirty.width;
+	int minY = dirty.height;
+	int maxX = 0;
+	int maxY = 0;
+	for(int ty = 0; ty < dirty.tilesY; ty++) {
+		for(int tx = 0; tx < dirty.tilesX; tx++) {
+			if(!dirty.dirtyTiles[ty * dirty.tilesX + tx])
+				continue;
+			minX = min(minX, tx * RENDER_TILE_SIZE);
+			maxX = max(maxX, min((tx + 1) * RENDER_TILE_SIZE, dirty.width));
+			minY = min(minY, dirty.height - min((ty + 1) * RENDER_TILE_SIZE, dirty.height));
+			maxY = max(maxY, dirty.height - ty * RENDER_TILE_SIZE);
+		}
+	}
+	return sameRect(dirty.rects[0], minX, minY, maxX - minX, maxY - minY);
+}
+
+int main()
+{
+	//100x80 frame: 4x3 tiles, the last column is 4 pixels wide and the top row 16 pixels high
+	DirtyRects single = makeTiles(100, 80);
+	setTile(single, 1, 0);
+	buildRects(&single);
+	expect("single tile", single.rects.size() == 1 && sameRect(single.rects[0], 32, 48, 32, 32));
+
+	DirtyRects corner = makeTiles(100, 80);
+	setTile(corner, 3, 2);
+	buildRects(&corner);
+	expect("clipped corner tile", corner.rects.size() == 1 && sameRect(corner.rects[0], 96, 0, 4, 16));
+
+	DirtyRects column = makeTiles(100, 80);
+	for(int ty = 0; ty < column.tilesY; ty++)
+		setTile(column, 0, ty);
+	buildRects(&column);
+	expect("column of tiles", column.rects.size() == 1 && sameRect(column.rects[0], 0, 0, 32, 80));
+
+	DirtyRects row = makeTiles(100, 80);
+	for(int tx = 0; tx < row.tilesX; tx++)
+		setTile(row, tx, 1);
+	buildRects(&row);
+	expect("row of tiles", row.rects.size() == 1 && sameRect(row.rects[0], 0, 16, 100, 32));
+
+	//runs only merge with the run above when they line up
+	DirtyRects staggered = makeTiles(100, 80);
+	setTile(staggered, 0, 2);
+	setTile(staggered, 1, 2);
+	setTile(staggered, 0, 1);
+	buildRects(&staggered);
+	expect("staggered runs", staggered.rects.size() == 2 && coversDirtyTiles(staggered));
+
+	DirtyRects none = makeTiles(100, 80);
+	buildRects(&none);
+	expect("no dirty tiles", none.rects.empty());
+
+	srand(1);
+	for(int i = 0; i < 200; i++) {
+		DirtyRects random = makeTiles(50 + rand() % 300, 40 + rand() % 200);
+		for(uint8_t& tile : random.dirtyTiles)
+			tile = rand() % 4 == 0;
+		buildRects(&random);
+		char name[64];
+		snprintf(name, sizeof(name), "random tiles %d", i);
+		expect(name, coversDirtyTiles(random) || (random.rects.size() == 1 && boundsDirtyTiles(random)));
+	}
+
+	//too many rects end up as their bounds
+	DirtyRects checker = makeTiles(640, 480);
+	for(int ty = 0; ty < checker.tilesY; ty++) {
+		for(int tx = 1; tx < checker.tilesX - 1; tx++) {
+			if((tx + ty) % 2)
+				setTile(checker, tx, ty);
+		}
+	}
+	buildRects(&checker);
+	expect("merged bounds", checker.rects.size() == 1 && sameRect(checker.rects[0], 32, 0, 576, 480));
+
+	if(failures)
+		printf("%d dirty rect checks failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include "framewriter.h"
+#include <cstdio>
+#include <cstring>
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition)
+{
+	if(!condition) {
+		printf("%s failed\n", name);
+		failures++;
+	}
+}
+
+static uint32_t readBE32(const uint8_t* bytes)
+{
+	return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static void checkCrc()
+{
+	const char* digits = "123456789";
+	expect("crc32 check value", crc32((const uint8_t*)digits, 9) == 0xcbf43926u);
+	expect("crc32 of nothing", crc32((const uint8_t*)digits, 0) == 0);
+	uint32_t head = crc32((const uint8_t*)digits, 4);
+	expect("crc32 carried over", crc32((const uint8_t*)digits + 4, 5, head) == 0xcbf43926u);
+}
+
+//walks the chunks and the stored deflate blocks of an encoded image and compares the scanlines with rgb
+static void checkPNG(int width, int height)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "png %dx%d", width, height);
+
+	std::vector<uint8_t> rgb(width * height * 3);
+	for(size_t i = 0; i < rgb.size(); i++)
+		rgb[i] = (uint8_t)(i * 7 + i / 3);
+	std::vector<uint8_t> png;
+	encodePNG(width, height, rgb, png);
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	if(png.size() < 8 || memcmp(png.data(), signature, 8)) {
+		printf("%s: bad signature\n", name);
+		failures++;
+		return;
+	}
+
+	const char* expectedTypes[] = {"IHDR", "IDAT", "IEND"};
+	std::vector<uint8_t> zlib;
+	size_t offset = 8;
+	for(const char* type : expectedTypes) {
+		if(offset + 12 > png.size()) {
+			printf("%s: truncated before %s\n", name, type);
+			failures++;
+			return;
+		}
+		uint32_t length = readBE32(&png[offset]);
+		const uint8_t* chunk = &png[offset + 4];
+		if(memcmp(chunk, type, 4) || offset + 12 + length > png.size()) {
+			printf("%s: expected a %s chunk\n", name, type);
+			failures++;
+			return;
+		}
+		if(readBE32(chunk + 4 + length) != crc32(chunk, length + 4)) {
+			printf("%s: %s crc mismatch\n", name, type);
+			failures++;
+		}
+
+		const uint8_t* data = chunk + 4;
+		if(!strcmp(type, "IHDR")) {
+			const uint8_t format[5] = {8, 2, 0, 0, 0};
+			expect(name, length == 13 && readBE32(data) == (uint32_t)width && readBE32(data + 4) == (uint32_t)height
+				&& !memcmp(data + 8, format, 5));
+		}
+		if(!strcmp(type, "IDAT"))
+			zlib.assign(data, data + length);
+		offset += 12 + length;
+	}
+	expect(name, offset == png.size());
+
+	//zlib header, stored blocks, adler32 of the scanlines
+	std::vector<uint8_t> scanlines;
+	size_t pos = 2;
+	bool last = false;
+	expect(name, zlib.size() >= 2 && zlib[0] == 0x78 && zlib[1] == 0x01);
+	while(!last && pos + 5 <= zlib.size()) {
+		last = zlib[pos] & 1;
+		uint32_t size = zlib[pos + 1] | zlib[pos + 2] << 8;
+		uint32_t inverse = zlib[pos + 3] | zlib[pos + 4] << 8;
+		expect(name, (zlib[pos] & 6) == 0 && (size ^ inverse) == 0xffff && pos + 5 + size <= zlib.size());
+		if(pos + 5 + size > zlib.size())
+			return;
+		scanlines.insert(scanlines.end(), zlib.begin() + pos + 5, zlib.begin() + pos + 5 + size);
+		pos += 5 + size;
+	}
+	expect(name, last && pos + 4 == zlib.size());
+
+	size_t rowBytes = width * 3;
+	bool rowsMatch = scanlines.size() == (rowBytes + 1) * height;
+	for(int y = 0; rowsMatch && y < height; y++) {
+		const uint8_t* row = &scanlines[y * (rowBytes + 1)];
+		rowsMatch = row[0] == 0 && !memcmp(row + 1, &rgb[y * rowBytes], rowBytes);
+	}
+	expect(name, rowsMatch);
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for(uint8_t byte : scanlines) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	expect(name, pos + 4 <= zlib.size() && readBE32(&zlib[pos]) == (b << 16 | a));
+}
+
+int main()
+{
+	checkCrc();
+	checkPNG(1, 1);
+	checkPNG(3, 2);
+	//scanlines span two stored blocks
+	checkPNG(200, 120);
+	//scanlines fill exactly one block
+	checkPNG(28, 771);
+
+	if(failures)
+		printf("%d frame writer checks failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+#include "jobs.h"
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition)
+{
+	if(!condition) {
+		printf("%s failed\n", name);
+		failures++;
+	}
+}
+
+//every index is handed out exactly once and chunks stay inside [0, count)
+static void checkParallelFor(JobSystem* jobs, uint32_t count, uint32_t minChunk)
+{
+	std::vector<std::atomic<uint32_t>> hits(count);
+	for(std::atomic<uint32_t>& hit : hits)
+		hit = 0;
+	std::atomic<bool> outOfRange(false);
+	parallelFor(jobs, count, minChunk, [&](uint32_t first, uint32_t end) {
+		if(first >= end || end > count)
+			outOfRange = true;
+		for(uint32_t i = first; i < end && i < count; i++)
+			hits[i]++;
+	});
+
+	bool once = true;
+	for(const std::atomic<uint32_t>& hit : hits)
+		once = once && hit == 1;
+	char name[64];
+	snprintf(name, sizeof(name), "parallelFor(%u, %u) range", count, minChunk);
+	expect(name, !outOfRange);
+	snprintf(name, sizeof(name), "parallelFor(%u, %u) coverage", count, minChunk);
+	expect(name, once);
+}
+
+//nested loops share the pool with the outer one
+static void checkNestedParallelFor(JobSystem* jobs)
+{
+	const uint32_t outer = 16;
+	const uint32_t inner = 300;
+	std::atomic<uint32_t> total(0);
+	parallelFor(jobs, outer, 1, [&](uint32_t first, uint32_t end) {
+		for(uint32_t i = first; i < end; i++) {
+			parallelFor(jobs, inner, 8, [&](uint32_t innerFirst, uint32_t innerEnd) {
+				total += innerEnd - innerFirst;
+			});
+		}
+	});
+	expect("nested parallelFor", total == outer * inner);
+}
+
+//jobs of a chain are submitted last to first and still have to run first to last
+static void checkDependencyChain(JobSystem* jobs, uint32_t length)
+{
+	std::mutex lock;
+	std::vector<uint32_t> order;
+	std::vector<JobHandle> chain(length);
+	for(uint32_t i = 0; i < length; i++) {
+		chain[i] = createJob(jobs, [&lock, &order, i]() {
+			std::lock_guard<std::mutex> guard(lock);
+			order.push_back(i);
+		});
+		if(i)
+			addJobDependency(jobs, chain[i], chain[i - 1]);
+	}
+	for(uint32_t i = length; i-- > 0;)
+		submitJob(jobs, chain[i]);
+	waitForJob(jobs, chain[length - 1]);
+
+	bool inOrder = order.size() == length;
+	for(uint32_t i = 0; inOrder && i < length; i++)
+		inOrder = order[i] == i;
+	expect("dependency chain order", inOrder);
+	waitForFrameJobs(jobs);
+}
+
+//jobs are recycled once the frame is waited on, a recycled job must not look finished to the dependencies of the next frame
+static void checkRecycledFrameJobs(JobSystem* jobs)
+{
+	const uint32_t frames = 20;
+	const uint32_t fanOut = 64;
+	for(uint32_t frame = 0; frame < frames; frame++) {
+		std::atomic<uint32_t> ran(0);
+		std::atomic<bool> early(false);
+		JobHandle root = createJob(jobs, [&ran]() { ran++; });
+		std::vector<JobHandle> leaves(fanOut);
+		for(uint32_t i = 0; i < fanOut; i++) {
+			leaves[i] = createJob(jobs, [&ran, &early]() {
+				if(ran == 0)
+					early = true;
+				ran++;
+			});
+			addJobDependency(jobs, leaves[i], root);
+		}
+		JobHandle last = createJob(jobs, [&ran, &early]() {
+			if(ran != fanOut + 1)
+				early = true;
+			ran++;
+		});
+		for(JobHandle leaf : leaves)
+			addJobDependency(jobs, last, leaf);
+
+		submitJob(jobs, last);
+		for(JobHandle leaf : leaves)
+			submitJob(jobs, leaf);
+		submitJob(jobs, root);
+		waitForFrameJobs(jobs);
+
+		char name[64];
+		snprintf(name, sizeof(name), "frame %u jobs ran", frame);
+		expect(name, ran == fanOut + 2);
+		snprintf(name, sizeof(name), "frame %u dependencies", frame);
+		expect(name, !early);
+	}
+}
+
+static void checkJobSystem(JobSystem* jobs)
+{
+	const uint32_t counts[] = {0, 1, 7, 64, 1000, 4097};
+	const uint32_t minChunks[] = {1, 3, 64, 5000};
+	for(uint32_t count : counts) {
+		for(uint32_t minChunk : minChunks)
+			checkParallelFor(jobs, count, minChunk);
+	}
+	checkNestedParallelFor(jobs);
+	checkDependencyChain(jobs, 1);
+	checkDependencyChain(jobs, 100);
+	checkRecycledFrameJobs(jobs);
+}
+
+int main()
+{
+	//a null job system runs everything inline
+	const uint32_t counts[] = {0, 1, 1000};
+	for(uint32_t count : counts)
+		checkParallelFor(nullptr, count, 16);
+
+	const uint32_t threads[] = {1, 2, 8};
+	for(uint32_t numThreads : threads) {
+		JobSystemConfig config = {};
+		config.numThreads = numThreads;
+		JobSystem* jobs = createJobSystem(config);
+		checkJobSystem(jobs);
+		destroyJobSystem(jobs);
+	}
+
+	if(failures)
+		printf("%d job system checks failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#include "maths.h"
+
+static int failures = 0;
+
+static void expectMatrix(const char* name, const mat4x4& got, const mat4x4& expected)
+{
+	for(int i = 0; i < 16; i++) {
+		if(std::abs(got.p[i] - expected.p[i]) > 1e-5f) {
+			printf("%s: element %d is %f, expected %f\n", name, i, got.p[i], expected.p[i]);
+			failures++;
+			return;
+		}
+	}
+}
+
+//rotation by angle degrees around a unit axis(Rodrigues), laid out for row vectors like the rest of maths.h
+static mat4x4 axisAngleMatrix(const Vec3& axis, float angle)
+{
+	float rad = angle * PI / 180.f;
+	float c = cosf(rad);
+	float s = sinf(rad);
+	float t = 1.f - c;
+	float x = axis.x;
+	float y = axis.y;
+	float z = axis.z;
+	return mat4x4 {
+		t * x * x + c,     t * x * y + s * z, t * x * z - s * y, 0,
+		t * x * y - s * z, t * y * y + c,     t * y * z + s * x, 0,
+		t * x * z + s * y, t * y * z - s * x, t * z * z + c,     0,
+		0,                 0,                 0,                 1
+	};
+}
+
+int main()
+{
+	expectMatrix("x axis", quatToRotationMat(quatFromAxisAndAngle(Vec3{1, 0, 0}, 30.f)), rotateX(30.f));
+	expectMatrix("y axis", quatToRotationMat(quatFromAxisAndAngle(Vec3{0, 1, 0}, 30.f)), rotateY(30.f));
+	expectMatrix("z axis", quatToRotationMat(quatFromAxisAndAngle(Vec3{0, 0, 1}, 30.f)), rotateZ(30.f));
+
+	Vec3 axis = normaliseVec3(Vec3{1, 2, 3});
+	Quat rotation = quatFromAxisAndAngle(axis, 70.f);
+	expectMatrix("arbitrary axis", quatToRotationMat(rotation), axisAngleMatrix(axis, 70.f));
+
+	Vec3 scale = {2, 3, 4};
+	Vec3 translate = {5, -6, 7};
+	expectMatrix("compose transform", composeTransform(scale, rotation, translate),
+		loadScale(scale) * axisAngleMatrix(axis, 70.f) * loadTranslation(translate));
+
+	if(failures)
+		printf("%d maths checks failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+#include "resolution.h"
+#include "jobs.h"
+#include <cstdio>
+#include <cstdlib>
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition)
+{
+	if(!condition) {
+		printf("%s failed\n", name);
+		failures++;
+	}
+}
+
+//channel by channel version of lerpPixel
+static uint32_t lerpChannels(uint32_t a, uint32_t b, uint32_t weight)
+{
+	uint32_t out = 0;
+	for(int shift = 0; shift < 32; shift += 8) {
+		uint32_t ca = a >> shift & 0xff;
+		uint32_t cb = b >> shift & 0xff;
+		out |= (ca * (256 - weight) + cb * weight) >> 8 << shift;
+	}
+	return out;
+}
+
+static void checkLerpPixel()
+{
+	expect("lerpPixel weight 0", lerpPixel(0x12345678, 0x9abcdef0, 0) == 0x12345678);
+	expect("lerpPixel weight 256", lerpPixel(0x12345678, 0x9abcdef0, 256) == 0x9abcdef0);
+	expect("lerpPixel white", lerpPixel(0xffffffff, 0xffffffff, 100) == 0xffffffff);
+
+	srand(1);
+	bool matches = true;
+	for(int i = 0; i < 100000 && matches; i++) {
+		uint32_t a = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+		uint32_t b = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+		uint32_t weight = rand() % 257;
+		matches = lerpPixel(a, b, weight) == lerpChannels(a, b, weight);
+	}
+	expect("lerpPixel channels", matches);
+}
+
+static PixelBuffer makeFrame(std::vector<uint32_t>& memory, int width, int height, int padding)
+{
+	int pitch = (width + padding) * sizeof(uint32_t);
+	memory.assign((width + padding) * height, 0);
+	return PixelBuffer{memory.data(), width, height, pitch, PIXEL_FORMAT_ARGB8888};
+}
+
+static uint32_t& pixel(const PixelBuffer& frame, int x, int y)
+{
+	return ((uint32_t*)((uint8_t*)frame.pixels + y * frame.pitch))[x];
+}
+
+//where an output pixel center lands in the frame, same rounding of the weight as upscaleFrame
+static void sourceTexels(int out, int outputSize, int frameSize, int* first, int* second, uint32_t* weight)
+{
+	float source = clamp((out + 0.5f) * (frameSize / (float)outputSize) - 0.5f, 0.f, frameSize - 1.f);
+	*first = (int)source;
+	*second = min(*first + 1, frameSize - 1);
+	*weight = (uint32_t)((source - *first) * 256.f + 0.5f);
+}
+
+static bool matchesBilinear(const PixelBuffer& frame, const PixelBuffer& output)
+{
+	for(int y = 0; y < output.height; y++) {
+		int y0, y1;
+		uint32_t rowWeight;
+		sourceTexels(y, output.height, frame.height, &y0, &y1, &rowWeight);
+		for(int x = 0; x < output.width; x++) {
+			int x0, x1;
+			uint32_t columnWeight;
+			sourceTexels(x, output.width, frame.width, &x0, &x1, &columnWeight);
+			uint32_t left = lerpChannels(pixel(frame, x0, y0), pixel(frame, x0, y1), rowWeight);
+			uint32_t right = lerpChannels(pixel(frame, x1, y0), pixel(frame, x1, y1), rowWeight);
+			if(pixel(output, x, y) != lerpChannels(left, right, columnWeight))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void checkUpscale(JobSystem* jobs, int frameWidth, int frameHeight, int outputWidth, int outputHeight)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "upscale %dx%d to %dx%d", frameWidth, frameHeight, outputWidth, outputHeight);
+
+	std::vector<uint32_t> frameMemory;
+	std::vector<uint32_t> outputMemory;
+	PixelBuffer frame = makeFrame(frameMemory, frameWidth, frameHeight, 3);
+	PixelBuffer output = makeFrame(outputMemory, outputWidth, outputHeight, 5);
+	for(int y = 0; y < frameHeight; y++) {
+		for(int x = 0; x < frameWidth; x++)
+			pixel(frame, x, y) = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+	}
+	upscaleFrame(jobs, frame, output);
+	expect(name, matchesBilinear(frame, output));
+
+	//padding past the row stays untouched
+	bool padding = true;
+	for(int y = 0; y < outputHeight; y++) {
+		for(int x = outputWidth; x < outputWidth + 5; x++)
+			padding = padding && pixel(output, x, y) == 0;
+	}
+	expect(name, padding);
+}
+
+int main()
+{
+	checkLerpPixel();
+
+	JobSystemConfig config = {};
+	config.numThreads = 4;
+	JobSystem* jobs = createJobSystem(config);
+
+	//same size copies the frame
+	std::vector<uint32_t> frameMemory;
+	std::vector<uint32_t> outputMemory;
+	PixelBuffer frame = makeFrame(frameMemory, 37, 23, 0);
+	PixelBuffer output = makeFrame(outputMemory, 37, 23, 0);
+	for(size_t i = 0; i < frameMemory.size(); i++)
+		frameMemory[i] = (uint32_t)(i * 2654435761u);
+	upscaleFrame(jobs, frame, output);
+	expect("upscale to the same size", frameMemory == outputMemory);
+
+	//a flat frame stays flat
+	for(uint32_t& color : frameMemory)
+		color = 0xff8040c0;
+	output = makeFrame(outputMemory, 101, 67, 0);
+	upscaleFrame(jobs, frame, output);
+	bool flat = true;
+	for(uint32_t color : outputMemory)
+		flat = flat && color == 0xff8040c0;
+	expect("upscale a flat frame", flat);
+
+	srand(2);
+	checkUpscale(nullptr, 2, 2, 4, 4);
+	checkUpscale(nullptr, 1, 1, 9, 5);
+	checkUpscale(jobs, 320, 180, 640, 360);
+	checkUpscale(jobs, 213, 120, 640, 360);
+	checkUpscale(jobs, 640, 360, 333, 200);
+
+	destroyJobSystem(jobs);
+	if(failures)
+		printf("%d upscale checks failed\n", failures);
+	return failures ? 1 : 0;
+}